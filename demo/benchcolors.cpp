@@ -0,0 +1,123 @@
+#include "robotdriver.h"
+#include "robotcolor.h"
+#include "colorthreshold.h"
+#include "squaredetector.h"
+#include "blobextractor.h"
+#include <iostream>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define COLORS 5
+
+static const char *names[COLORS] = { "pink", "yellow", "blue", "green", "purple" };
+
+// Count the pixels two masks disagree on
+static int compareMasks(const IplImage *a, const IplImage *b) {
+    int x, y, diff = 0;
+
+    for(y = 0; y < a->height; y++) {
+        for(x = 0; x < a->width; x++) {
+            if(a->imageData[y * a->widthStep + x] != b->imageData[y * b->widthStep + x])
+                diff++;
+        }
+    }
+    return diff;
+}
+
+// Compare cvCvtColor followed by cvInRangeS with riColorThreshold, for one and for all the robotcolor.h presets,
+// then the contour pass per color with the blobs of all the colors in one scan
+int main(int argc, char *argv[]) {
+    IplImage *image = NULL, *hsv = NULL;
+    IplImage *reference[COLORS], *fused[COLORS];
+    RIColorRange ranges[COLORS];
+    SquareDetector squares;
+    BlobExtractor blobs;
+    uint64_t start;
+    double two_step_ms, fused_ms;
+    int i, n, count, diff, iterations = 100;
+
+    if(argc < 2) {
+        printf("use:\n     %s image [iterations]\n", argv[0]);
+        return 1;
+    }
+    if(argc > 2)
+        iterations = atoi(argv[2]);
+    if(iterations < 1)
+        iterations = 1;
+
+    image = cvLoadImage(argv[1], CV_LOAD_IMAGE_COLOR);
+    if(image == NULL) {
+        std::cerr << "Unable to load " << argv[1] << std::endl;
+        return 1;
+    }
+
+    ranges[0] = riColorRange(RC_PINK_LOW, RC_PINK_HIGH);
+    ranges[1] = riColorRange(RC_YELLOW_LOW, RC_YELLOW_HIGH);
+    ranges[2] = riColorRange(RC_BLUE_LOW, RC_BLUE_HIGH);
+    ranges[3] = riColorRange(RC_GREEN_LOW, RC_GREEN_HIGH);
+    ranges[4] = riColorRange(RC_PURPLE_LOW, RC_PURPLE_HIGH);
+
+    hsv = cvCreateImage(cvGetSize(image), IPL_DEPTH_8U, 3);
+    for(n = 0; n < COLORS; n++) {
+        reference[n] = cvCreateImage(cvGetSize(image), IPL_DEPTH_8U, 1);
+        fused[n] = cvCreateImage(cvGetSize(image), IPL_DEPTH_8U, 1);
+    }
+
+    printf("%ix%i, %i iterations\n", image->width, image->height, iterations);
+    printf("colors  two step ms  fused ms  speedup\n");
+
+    for(count = 1; count <= COLORS; count += COLORS - 1) {
+        start = riTimestamp();
+        for(i = 0; i < iterations; i++) {
+            cvCvtColor(image, hsv, CV_BGR2HSV);
+            for(n = 0; n < count; n++)
+                cvInRangeS(hsv, ranges[n].low, ranges[n].high, reference[n]);
+        }
+        two_step_ms = (riTimestamp() - start) / 1000.0 / iterations;
+
+        start = riTimestamp();
+        for(i = 0; i < iterations; i++)
+            riColorThreshold(image, ranges, count, fused);
+        fused_ms = (riTimestamp() - start) / 1000.0 / iterations;
+
+        printf("%6i %12.3f %9.3f %8.2f\n", count, two_step_ms, fused_ms, two_step_ms / fused_ms);
+    }
+
+    // The masks of the last run must be the same
+    for(n = 0; n < COLORS; n++) {
+        diff = compareMasks(reference[n], fused[n]);
+        printf("%-7s %i pixels in range, %i different\n", names[n], cvCountNonZero(reference[n]), diff);
+    }
+
+    // Landmarks of every color, one contour pass per color against one labeling scan
+    blobs.setColors(ranges, COLORS);
+    start = riTimestamp();
+    for(i = 0; i < iterations; i++) {
+        cvCvtColor(image, hsv, CV_BGR2HSV);
+        for(n = 0; n < COLORS; n++) {
+            cvInRangeS(hsv, ranges[n].low, ranges[n].high, reference[n]);
+            squares.find(reference[n], RI_DEFAULT_SQUARE_SIZE);
+        }
+    }
+    two_step_ms = (riTimestamp() - start) / 1000.0 / iterations;
+
+    start = riTimestamp();
+    for(i = 0; i < iterations; i++)
+        blobs.find(image);
+    fused_ms = (riTimestamp() - start) / 1000.0 / iterations;
+
+    printf("contours per color %.3f ms, blobs of all colors %.3f ms, speedup %.2f\n", two_step_ms, fused_ms, two_step_ms / fused_ms);
+    for(n = 0; n < COLORS; n++) {
+        const RIBlob *big = blobs.biggest(n);
+        if(big != NULL)
+            printf("%-7s biggest blob %i pixels at %.1f, %.1f\n", names[n], big->area, big->centroid.x, big->centroid.y);
+    }
+
+    for(n = 0; n < COLORS; n++) {
+        cvReleaseImage(&reference[n]);
+        cvReleaseImage(&fused[n]);
+    }
+    cvReleaseImage(&hsv);
+    cvReleaseImage(&image);
+    return 0;
+}
@@ -0,0 +1,88 @@
+#include "robotdriver.h"
+#include "robotcolor.h"
+#include "squaredetector.h"
+#include "parallelsquaredetector.h"
+#include <iostream>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <algorithm>
+
+// Compare the serial and the parallel square detection on an image, for 1 to N threads
+int main(int argc, char *argv[]) {
+    IplImage *image = NULL, *hsv = NULL, *threshold = NULL;
+    SquareDetector serial;
+    std::vector<RISquare> expected;
+    uint64_t start;
+    double serial_ms, ms;
+    size_t found;
+    int i, t, iterations = 50, max_threads;
+
+    if(argc < 2) {
+        printf("use:\n     %s image [iterations] [max_threads]\n", argv[0]);
+        return 1;
+    }
+    if(argc > 2)
+        iterations = atoi(argv[2]);
+    if(iterations < 1)
+        iterations = 1;
+    max_threads = argc > 3 ? atoi(argv[3]) : (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if(max_threads < 1)
+        max_threads = 1;
+
+    image = cvLoadImage(argv[1], CV_LOAD_IMAGE_COLOR);
+    if(image == NULL) {
+        std::cerr << "Unable to load " << argv[1] << std::endl;
+        return 1;
+    }
+
+    // Pick out only the pink color from the image, like findpinksquare
+    hsv = cvCreateImage(cvGetSize(image), IPL_DEPTH_8U, 3);
+    threshold = cvCreateImage(cvGetSize(image), IPL_DEPTH_8U, 1);
+    cvCvtColor(image, hsv, CV_BGR2HSV);
+    cvInRangeS(hsv, RC_PINK_LOW, RC_PINK_HIGH, threshold);
+
+    // Serial reference, the first frame allocates the work images
+    expected = serial.find(threshold, RI_DEFAULT_SQUARE_SIZE);
+    std::sort(expected.begin(), expected.end(), riSquareLess);
+    start = riTimestamp();
+    for(i = 0; i < iterations; i++)
+        serial.find(threshold, RI_DEFAULT_SQUARE_SIZE);
+    serial_ms = (riTimestamp() - start) / 1000.0 / iterations;
+
+    printf("%ix%i, %i squares, %i iterations\n", image->width, image->height, (int)expected.size(), iterations);
+    printf("threads   ms/frame  speedup  merges  match\n");
+    printf(" serial %10.3f  %7.2f       -      -\n", serial_ms, 1.0);
+
+    // Outer contours of the mask straight away, no blur, Canny or dilation
+    found = serial.findBinary(threshold, RI_DEFAULT_SQUARE_SIZE).size();
+    start = riTimestamp();
+    for(i = 0; i < iterations; i++)
+        serial.findBinary(threshold, RI_DEFAULT_SQUARE_SIZE);
+    ms = (riTimestamp() - start) / 1000.0 / iterations;
+    printf(" binary %10.3f  %7.2f       -      -  (%i squares)\n", ms, serial_ms / ms, (int)found);
+
+    for(t = 1; t <= max_threads; t++) {
+        ParallelSquareDetector parallel(t);
+        bool match;
+
+        match = parallel.find(threshold, RI_DEFAULT_SQUARE_SIZE).size() == expected.size();
+        for(i = 0; match && i < (int)expected.size(); i++) {
+            const RISquare &a = parallel.result()[i], &b = expected[i];
+            match = a.center.x == b.center.x && a.center.y == b.center.y && a.area == b.area &&
+                a.box.x == b.box.x && a.box.y == b.box.y && a.box.width == b.box.width && a.box.height == b.box.height;
+        }
+
+        start = riTimestamp();
+        for(i = 0; i < iterations; i++)
+            parallel.find(threshold, RI_DEFAULT_SQUARE_SIZE);
+        ms = (riTimestamp() - start) / 1000.0 / iterations;
+
+        printf("%7i %10.3f  %7.2f  %6u  %5s\n", parallel.threadCount(), ms, serial_ms / ms, parallel.merges(), match ? "yes" : "NO");
+    }
+
+    cvReleaseImage(&threshold);
+    cvReleaseImage(&hsv);
+    cvReleaseImage(&image);
+    return 0;
+}
@@ -0,0 +1,50 @@
+#include "robotdriver.h"
+#include "odometry.h"
+#include "motion.h"
+#include <iostream>
+#include <stdio.h>
+
+static const char *states[] = { "idle", "running", "done", "missed", "stalled", "canceled" };
+
+// Print how a motion ended
+static void report(const char *what, MotionController *motion) {
+    RIMotion m;
+
+    motion->wait(&m);
+    printf("%-8s %-8s target %7.1f done %7.1f error %6.1f path %6.1f cm %5.2f s %u commands\n",
+        what, states[m.state], m.target, m.progress, m.error, m.distance,
+        (m.finished - m.started) / 1000000.0, m.commands);
+}
+
+int main(int argc, char *argv[]) {
+    const char *IP = "192.168.10.18";
+    double side = argc > 1 ? atof(argv[1]) : 50.0;
+    int i;
+
+    // Setup the robot interface
+    RobotInterface *robot = new RobotInterface(IP, 0);
+
+    // The encoders are the feedback of the motions
+    Odometry odometry(robot);
+    MotionController motion(robot, &odometry);
+    if(odometry.start() != RI_RESP_SUCCESS || motion.start() != RI_RESP_SUCCESS) {
+        std::cout << "Failed to start the motion control!" << std::endl;
+        exit(-1);
+    }
+
+    // A square, then the same side as an arc back
+    for(i = 0; i < 4; i++) {
+        motion.driveDistance(side);
+        report("drive", &motion);
+        motion.turnAngle(90.0);
+        report("turn", &motion);
+    }
+    motion.driveArc(side / 2.0, 180.0);
+    report("arc", &motion);
+
+    // Clean up
+    motion.stop();
+    odometry.stop();
+    delete(robot);
+    return 0;
+}
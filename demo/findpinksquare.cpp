@@ -1,14 +1,27 @@
 #include "robotdriver.h"
 #include "robotcolor.h"
+#include "squaretracker.h"
+#include "colorthreshold.h"
+#include "duplicatefilter.h"
+#include "preview.h"
+#include "latency.h"
 #include <iostream>
 #include <string>
+#include <string.h>
 
-int main() {
+int main(int argc, char *argv[]) {
    int major ,minor ;
-   IplImage *image = NULL, *hsv = NULL, *threshold = NULL;
-   SquaresType *squares, *biggest, *sq_idx;
+   IplImage *image = NULL, *threshold = NULL;
+   RIColorRange pink = riColorRange(RC_PINK_LOW, RC_PINK_HIGH);
+   SquareTracker tracker;
+   DuplicateFilter duplicates;
+   LatencyStats latency;
+   const unsigned char *jpeg;
+   int jpeg_size;
+   const RITrack *track;
+   const RISquare *biggest;
    CvPoint pt1, pt2;
-   int sq_amt;
+   int sq_amt, camera_window, square_window;
    const char *IP = "192.168.10.18";
 	// Setup the robot interface
     RobotInterface *robot = new RobotInterface(IP, 0);
@@ -23,18 +36,20 @@ int main() {
 		exit(-1);
 	}
 	
-	// Create a window to display the output
-	cvNamedWindow("Rovio Camera", CV_WINDOW_AUTOSIZE);
-	cvNamedWindow("Biggest Square", CV_WINDOW_AUTOSIZE);
+	// Time every frame from its request to the move based on it
+	robot->setLatencyStats(&latency);
+
+	// Display the output from a thread of its own, or not at all with -n
+	PreviewDisplay preview(RI_PREVIEW_DEFAULT_FPS, argc > 1 && strcmp(argv[1], "-n") == 0);
+	camera_window = preview.addWindow("Rovio Camera");
+	square_window = preview.addWindow("Biggest Square");
+	preview.start();
 	
 	// Create an image to store the image from the camera
 	image = cvCreateImage(cvSize(640, 480), IPL_DEPTH_8U, 3);
 
-	// Create an image to store the HSV version in
-	// We configured the camera for 640x480 above, so use that size here
-	hsv = cvCreateImage(cvSize(640, 480), IPL_DEPTH_8U, 3);
-
 	// And an image for the thresholded version
+	// We configured the camera for 640x480 above, so use that size here
 	threshold = cvCreateImage(cvSize(640, 480), IPL_DEPTH_8U, 1);
 
 	// Move the head up to the middle position
@@ -48,78 +63,74 @@ int main() {
 			continue;
 		}
 		
-		// Get the current camera image and display it
-		
-		if(robot->getImage(image) != RI_RESP_SUCCESS) {
+		// Get the current camera image, still compressed
+		if(robot->getJpeg(&jpeg, &jpeg_size) != RI_RESP_SUCCESS) {
 			std::cout << "Unable to capture an image!" << std::endl;
 			continue;
 		}
-		cvShowImage("Rovio Camera", image);
-		
-		// Convert the image from RGB to HSV
-		cvCvtColor(image, hsv, CV_BGR2HSV);
-
-		// Pick out only the pink color from the image
-		cvInRangeS(hsv, RC_PINK_LOW, RC_PINK_HIGH, threshold);
 
-		// Find the squares in the image
-		squares = robot->findSquares(threshold, RI_DEFAULT_SQUARE_SIZE);
+		// A repeat of the last picture would give the same square, skip the decoding and the search
+		if(duplicates.check(jpeg, jpeg_size) == RI_DUP_NEW) {
+			// Skip a frame that does not decode, and do not compare the next one against it
+			if(riDecodeJpeg(jpeg, jpeg_size, image) != RI_RESP_SUCCESS) {
+				std::cout << "Unable to decode the image!" << std::endl;
+				duplicates.reset();
+				continue;
+			}
+			robot->traceMark(RI_TRACE_DECODED);
+			preview.show(camera_window, image);
 		
-		// Loop over the squares and find the biggest one
-		biggest = squares;
-		sq_idx = squares;
-		while(sq_idx != NULL) {
-			if(sq_idx->area > biggest->area)
-				biggest = sq_idx;
-			sq_idx = sq_idx->next;
-		}
+			// Pick out only the pink color from the image, without an HSV copy
+			riColorThreshold(image, &pink, 1, &threshold);
+
+			// Track the squares, searching only where they are expected to be, and pick the biggest one
+			tracker.update(threshold);
+			track = tracker.biggest();
+			robot->traceMark(RI_TRACE_PROCESSED);
+			biggest = track != NULL ? &track->square : NULL;
 		
-		// Only draw if we have squares
-		if(biggest != NULL) {
-			// Draw an X marker on the image
-			sq_amt = (int) (sqrt(biggest->area) / 2);	
-
-			// Upper Left to Lower Right
-			pt1.x = biggest->center.x - sq_amt;
-			pt1.y = biggest->center.y - sq_amt;
-			pt2.x = biggest->center.x + sq_amt;
-			pt2.y = biggest->center.y + sq_amt;
-			cvLine(image, pt1, pt2, CV_RGB(0, 255, 0), 3, CV_AA, 0);
-
-			// Lower Left to Upper Right
-			pt1.x = biggest->center.x - sq_amt;
-			pt1.y = biggest->center.y + sq_amt;
-			pt2.x = biggest->center.x + sq_amt;
-			pt2.y = biggest->center.y - sq_amt;
-			cvLine(image, pt1, pt2, CV_RGB(0, 255, 0), 3, CV_AA, 0);
+			// Only draw if we have squares
+			if(biggest != NULL) {
+				// Draw an X marker on the image
+				sq_amt = (int) (sqrt(biggest->area) / 2);	
+
+				// Upper Left to Lower Right
+				pt1.x = biggest->center.x - sq_amt;
+				pt1.y = biggest->center.y - sq_amt;
+				pt2.x = biggest->center.x + sq_amt;
+				pt2.y = biggest->center.y + sq_amt;
+				cvLine(image, pt1, pt2, CV_RGB(0, 255, 0), 3, CV_AA, 0);
+
+				// Lower Left to Upper Right
+				pt1.x = biggest->center.x - sq_amt;
+				pt1.y = biggest->center.y + sq_amt;
+				pt2.x = biggest->center.x + sq_amt;
+				pt2.y = biggest->center.y - sq_amt;
+				cvLine(image, pt1, pt2, CV_RGB(0, 255, 0), 3, CV_AA, 0);
+			}
+
+			// Display the image with the drawing on it
+			preview.show(square_window, image);
 		}
-
-		// Display the image with the drawing on it
-		cvShowImage("Biggest Square", image);
-		
-		// Update the UI (10ms wait)
-		cvWaitKey(10);
-
-		// Release the square data
-		while(squares != NULL) {
-			sq_idx = squares->next;
-			delete(squares);
-			squares = sq_idx;	
+		if(duplicates.frames() % 100 == 0) {
+			std::cout << "Skipped " << duplicates.skipped() << " of " << duplicates.frames() << " frames" << std::endl;
+			latency.print(stdout);
 		}
 
+		// Stop on q in one of the windows
+		if(preview.key() == 'q')
+			break;
+
         // Move forward unless there's something in front of the robot
        if(!robot->IRDetected())
         robot->move(RI_MOVE_FORWARD, RI_SLOWEST);
 	} while(1);	
 
-	// Clean up (although we'll never get here...)
+	// Clean up
+	preview.stop();
 	delete(robot);
-
-	cvDestroyWindow("Rovio Camera");
-	cvDestroyWindow("Biggest Square");
 	
 	// Free the images
-	cvReleaseImage(&hsv);
 	cvReleaseImage(&threshold);
 	cvReleaseImage(&image);
 
@@ -1,32 +1,32 @@
 #include "robotdriver.h"
+#include "behavior.h"
 #include <iostream>
 #include <string>
+#include <unistd.h>
 
 int main() {
-   const char *IP ="192.168.10.18";
+    const char *IP ="192.168.10.18";
 
-	// Setup the robot interface
-   RobotInterface *robot = new RobotInterface(IP, 0);
+    // Setup the robot interface
+    RobotInterface *robot = new RobotInterface(IP, 0);
 
-	// Action loop
-	do {
-		// Update the robot's sensor information
-        if(robot->update() != RI_RESP_SUCCESS) {
-			std::cout << "Failed to update sensor information!" << std::endl;
-			continue;
+    // Turn away from obstacles, drive forward otherwise
+    BehaviorEngine engine(robot);
+    engine.addRule(riBehaviorAvoid);
+    engine.addRule(riBehaviorCruise);
+    if(engine.start() != RI_RESP_SUCCESS) {
+        std::cout << "Failed to start the behavior engine!" << std::endl;
+        exit(-1);
+    }
 
-		}
+    // The engine drives, just report how the control loop keeps up
+    do {
+        sleep(5);
+        engine.printStats(stdout);
+    } while(1);
 
-		// Move forward unless there's something in front of the robot
-        if(!robot->IRDetected())
-        {robot->move(RI_MOVE_FORWARD, RI_FASTEST);
-           }
-        else
-            robot->move(RI_TURN_LEFT,RI_FASTEST);
-
-	} while(1);	
-
-	// Clean up
-	delete(robot);
-	return 0;
+    // Clean up (although we'll never get here...)
+    engine.stop();
+    delete(robot);
+    return 0;
 }
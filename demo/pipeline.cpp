@@ -0,0 +1,148 @@
+#include "robotdriver.h"
+#include "robotcolor.h"
+#include "squaretracker.h"
+#include "colorthreshold.h"
+#include "pipeline.h"
+#include "latency.h"
+#include <iostream>
+#include <unistd.h>
+
+// The pink square demo, with capture, decoding, detection, display and driving overlapped on their own threads
+
+// Age of the frames by the time the robot is told to move on them
+static LatencyStats latency;
+
+static int capture(RIFrame *frame, void *arg) {
+    RobotInterface *robot = (RobotInterface *)arg;
+    const unsigned char *jpeg;
+    int jpeg_size;
+
+    if(robot->update() != RI_RESP_SUCCESS)
+        return RI_RESP_FAILURE;
+    if(robot->getJpeg(&jpeg, &jpeg_size) != RI_RESP_SUCCESS)
+        return RI_RESP_FAILURE;
+
+    frame->timestamp = riTimestamp();
+    frame->jpeg.assign(jpeg, jpeg + jpeg_size);
+    frame->sensor = *(robot->getSensors());
+    frame->report = *(robot->getReport());
+    robot->getTrace(&frame->trace);
+    return RI_RESP_SUCCESS;
+}
+
+static int decode(RIFrame *frame, void *arg) {
+    CvSize size;
+
+    if(riJpegSize(&frame->jpeg[0], frame->jpeg.size(), &size) != RI_RESP_SUCCESS)
+        return RI_RESP_FAILURE;
+    if(riDecodeJpeg(&frame->jpeg[0], frame->jpeg.size(), riFrameImage(&frame->image, size, 3)) != RI_RESP_SUCCESS)
+        return RI_RESP_FAILURE;
+    riTraceMark(&frame->trace, RI_TRACE_DECODED);
+    return RI_RESP_SUCCESS;
+}
+
+static int threshold(RIFrame *frame, void *arg) {
+    RIColorRange *pink = (RIColorRange *)arg;
+
+    riFrameImage(&frame->mask, cvGetSize(frame->image), 1);
+    return riColorThreshold(frame->image, pink, 1, &frame->mask);
+}
+
+static int track(RIFrame *frame, void *arg) {
+    SquareTracker *tracker = (SquareTracker *)arg;
+    const RITrack *biggest;
+
+    tracker->update(frame->mask);
+    biggest = tracker->biggest();
+    if(biggest != NULL)
+        frame->squares.push_back(biggest->square);
+    riTraceMark(&frame->trace, RI_TRACE_PROCESSED);
+    return RI_RESP_SUCCESS;
+}
+
+// Only this stage draws on the image, drive only reads the squares and the sensors
+static int display(RIFrame *frame, void *arg) {
+    CvPoint pt1, pt2;
+    int sq_amt;
+
+    if(!frame->squares.empty()) {
+        const RISquare *biggest = &frame->squares[0];
+
+        // Draw an X marker on the image
+        sq_amt = (int) (sqrt(biggest->area) / 2);
+        pt1 = cvPoint(biggest->center.x - sq_amt, biggest->center.y - sq_amt);
+        pt2 = cvPoint(biggest->center.x + sq_amt, biggest->center.y + sq_amt);
+        cvLine(frame->image, pt1, pt2, CV_RGB(0, 255, 0), 3, CV_AA, 0);
+        pt1 = cvPoint(biggest->center.x - sq_amt, biggest->center.y + sq_amt);
+        pt2 = cvPoint(biggest->center.x + sq_amt, biggest->center.y - sq_amt);
+        cvLine(frame->image, pt1, pt2, CV_RGB(0, 255, 0), 3, CV_AA, 0);
+    }
+    cvShowImage("Biggest Square", frame->image);
+    cvWaitKey(1);
+    return RI_RESP_SUCCESS;
+}
+
+static int drive(RIFrame *frame, void *arg) {
+    RobotInterface *robot = (RobotInterface *)arg;
+    int ret;
+
+    // Move forward unless there was something in front of the robot when the frame was taken
+    if(frame->sensor.status & RI_STATUS_IR_DETECTOR)
+        return RI_PIPE_SKIP;
+    ret = robot->move(RI_MOVE_FORWARD, RI_SLOWEST, &frame->trace);
+    latency.add(&frame->trace);
+    return ret;
+}
+
+int main() {
+    int major, minor, source, decoder, thresholder, tracker_stage;
+    RIColorRange pink = riColorRange(RC_PINK_LOW, RC_PINK_HIGH);
+    SquareTracker tracker;
+    Pipeline pipeline;
+    const char *IP = "192.168.10.18";
+    // Setup the robot interfaces, one for the camera and one for the wheels so neither waits for the other
+    RobotInterface *robot = new RobotInterface(IP, 0);
+    RobotInterface *wheels = new RobotInterface(IP, 0);
+
+    // Print the API Version
+    robot->APIVersion(&major, &minor);
+    std::cout << "Robot API Test: API Version v" << major << "." << minor << std::endl;
+
+    // Setup the camera
+    if(robot->cameraConfigure(RI_CAMERA_DEFAULT_BRIGHTNESS, RI_CAMERA_DEFAULT_CONTRAST, 30, RI_CAMERA_RES_640, RI_CAMERA_QUALITY_HIGH)) {
+        std::cout << "Failed to configure the camera!" << std::endl;
+        exit(-1);
+    }
+
+    cvNamedWindow("Biggest Square", CV_WINDOW_AUTOSIZE);
+
+    // capture -> decode -> threshold -> track -> display
+    //                                         -> drive
+    source = pipeline.addSource("capture", capture, robot);
+    decoder = pipeline.addStage("decode", source, decode, NULL);
+    thresholder = pipeline.addStage("threshold", decoder, threshold, &pink);
+    tracker_stage = pipeline.addStage("track", thresholder, track, &tracker);
+    // Showing or driving on an old frame is pointless, they take the latest one
+    pipeline.addStage("display", tracker_stage, display, NULL, RI_PIPE_DEFAULT_DEPTH, RI_PIPE_LATEST);
+    pipeline.addStage("drive", tracker_stage, drive, wheels, RI_PIPE_DEFAULT_DEPTH, RI_PIPE_LATEST);
+
+    if(pipeline.start() != RI_RESP_SUCCESS) {
+        std::cout << "Failed to start the pipeline!" << std::endl;
+        exit(-1);
+    }
+
+    do {
+        sleep(5);
+        pipeline.printStats(stdout);
+        latency.print(stdout);
+    } while(1);
+
+    // Clean up (although we'll never get here...)
+    pipeline.stop();
+    delete(wheels);
+    delete(robot);
+
+    cvDestroyWindow("Biggest Square");
+
+    return 0;
+}
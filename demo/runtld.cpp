@@ -5,6 +5,11 @@
 #include <TLD.h>
 #include <stdio.h>
 #include <robotdriver.h>
+#include <framerecord.h>
+#include <colortracker.h>
+#include <preview.h>
+#include <latency.h>
+#include <servo.h>
 #include<unistd.h>
 using namespace cv;
 using namespace std;
@@ -15,7 +20,14 @@ bool gotBB = false;
 bool tl = false;
 bool rep = false;
 bool fromfile=false;
+bool fromrecording=false;
+bool colortrack=false;
+bool headless=false;
+bool follow=false;
 string video;
+FramePlayer player;
+FrameRecorder recorder;
+LatencyStats latency;
 
 void readBB(char* file){
   ifstream bb_file (file);
@@ -63,7 +75,14 @@ void mouseHandler(int event, int x, int y, int flags, void *param){
 
 void print_help(char** argv){
   printf("use:\n     %s -p /path/parameters.yml\n",argv[0]);
-  printf("-s    source video\n-b        bounding box file\n-tl  track and learn\n-r     repeat\n");
+  printf("-s    source video\n-f    source recording\n-w    record the robot camera\n-c    track the color of the box instead of TLD\n-b        bounding box file\n-tl  track and learn\n-r     repeat\n-n    no display, needs -b\n-d    drive towards the target\n");
+}
+
+//Next frame from the recording, or from the robot camera
+int grabFrame(RobotInterface *robot, IplImage *image){
+  if (fromrecording)
+    return player.next(image);
+  return robot->getImage(image);
 }
 
 void read_options(int argc, char** argv,VideoCapture& capture,FileStorage &fs){
@@ -86,6 +105,24 @@ void read_options(int argc, char** argv,VideoCapture& capture,FileStorage &fs){
             print_help(argv);
 
       }
+      if (strcmp(argv[i],"-f")==0){
+          if (argc>i+1){
+              // Never fall back to the live robot when a recording was asked for
+              if (player.open(argv[i+1]) != RI_RESP_SUCCESS){
+                cout << "Failed to open the recording " << argv[i+1] << "!" << endl;
+                exit(-1);
+              }
+              fromrecording = true;
+          }
+          else
+            print_help(argv);
+      }
+      if (strcmp(argv[i],"-w")==0){
+          if (argc>i+1)
+              recorder.open(argv[i+1]);
+          else
+            print_help(argv);
+      }
       if (strcmp(argv[i],"-p")==0){
           if (argc>i){
               fs.open(argv[i+1], FileStorage::READ);
@@ -96,9 +133,18 @@ void read_options(int argc, char** argv,VideoCapture& capture,FileStorage &fs){
       if (strcmp(argv[i],"-tl")==0){
           tl = true;
       }
+      if (strcmp(argv[i],"-c")==0){
+          colortrack = true;
+      }
       if (strcmp(argv[i],"-r")==0){
           rep = true;
       }
+      if (strcmp(argv[i],"-n")==0){
+          headless = true;
+      }
+      if (strcmp(argv[i],"-d")==0){
+          follow = true;
+      }
   }
 }
 
@@ -106,32 +152,45 @@ int main(int argc, char * argv[]){
 
     IplImage *image = NULL;
    const char *IP = "192.168.10.18";
+    RobotInterface *robot = NULL;
+
+   VideoCapture capture;
+  //  capture.open(image);
+    FileStorage fs;
+  //Read options
+  read_options(argc,argv,capture,fs);
+
+  if (fromrecording){
+    // Replay a recording, the robot is not needed
+    if (player.count() == 0){
+      cout << "The recording is empty!" << endl;
+      return 1;
+    }
+    image = cvCreateImage(player.frameSize(), IPL_DEPTH_8U, 3);
+  }else{
     // Setup the robot interface
-    RobotInterface *robot = new RobotInterface(IP, 0);
+    robot = new RobotInterface(IP, 0);
 
     if(robot->cameraConfigure(RI_CAMERA_DEFAULT_BRIGHTNESS, RI_CAMERA_DEFAULT_CONTRAST, 1,RI_CAMERA_RES_640, RI_CAMERA_QUALITY_HIGH)) {
         std::cout << "Failed to configure the camera!" << std::endl;
         exit(-1);
     }
+    if (recorder.isOpen())
+      robot->setRecorder(&recorder);
+    robot->setLatencyStats(&latency);
+
+    // Create an image to store the image from the camera
+    image = cvCreateImage(cvSize(640, 480), IPL_DEPTH_8U, 3);
+  }
   /* if(robot->cameraConfigure(0x30, 0x60, 30, RI_CAMERA_RES_640, RI_CAMERA_MAX_IMG_SIZE)) {
         std::cout << "Failed to configure the camera!" << std::endl;
         exit(-1);
     }*/
 
 
-    // Create an image to store the image from the camera
-    image = cvCreateImage(cvSize(640, 480), IPL_DEPTH_8U, 3);
-
     // Move the head up to the middle position
    //robot->move(RI_HEAD_MIDDLE, RI_FASTEST);
 
-
-   VideoCapture capture;
-  //  capture.open(image);
-    FileStorage fs;
-  //Read options
-  read_options(argc,argv,capture,fs);
-
  if (!fs.isOpened())
   {
     cout << "file of parameters failed to open!" << endl;
@@ -144,16 +203,23 @@ int main(int argc, char * argv[]){
     cout << "capture device failed to open!" << endl;
     return 1;
   }*/
+  //Without a display the box can't be drawn
+  if (headless && !gotBB){
+    cout << "No display, give the bounding box with -b." << endl;
+    return 1;
+  }
   //Register mouse callback to draw the bounding box
-  cvNamedWindow("TLD",CV_WINDOW_AUTOSIZE);
-  cvNamedWindow("last_gray",CV_WINDOW_AUTOSIZE);
- // cvNamedWindow("current_gray",CV_WINDOW_AUTOSIZE);
-  //cvNamedWindow("first_image",CV_WINDOW_AUTOSIZE);
-
+  if (!headless){
+    cvNamedWindow("TLD",CV_WINDOW_AUTOSIZE);
+   // cvNamedWindow("current_gray",CV_WINDOW_AUTOSIZE);
+    //cvNamedWindow("first_image",CV_WINDOW_AUTOSIZE);
 
-  cvSetMouseCallback( "TLD", mouseHandler, NULL );
+    cvSetMouseCallback( "TLD", mouseHandler, NULL );
+  }
   //TLD framework
   TLD tld;
+  //Or the hue histogram of the box, much faster for a colored target
+  ColorTracker ctracker;
   //Read parameters file
   tld.read(fs.getFirstTopLevelNode());
   Mat frame;
@@ -164,9 +230,11 @@ int main(int argc, char * argv[]){
       cvtColor(frame, last_gray, CV_RGB2GRAY);
       frame.copyTo(first);
   }else{
-       robot->getImage(image);
+       grabFrame(robot, image);
       // cvShowImage("current_image",image);
       first=image;
+      //Also needed when the box comes from -b and is never drawn
+      cvtColor(first, last_gray, CV_RGB2GRAY);
      // imshow("first_image",first);
      // frame = image;
       //capture.set(CV_CAP_PROP_FRAME_WIDTH,340);
@@ -177,6 +245,10 @@ int main(int argc, char * argv[]){
 GETBOUNDINGBOX:
   while(!gotBB)
   {
+    if (headless){
+      cout << "No display to draw another bounding box." << endl;
+      return 1;
+    }
     /*if (!fromfile){
      capture >> frame;
         //Mat frame = image;
@@ -198,15 +270,32 @@ GETBOUNDINGBOX:
       gotBB = false;
       goto GETBOUNDINGBOX;
   }
-  //Remove callback
-  cvSetMouseCallback( "TLD", NULL, NULL );
+  if (colortrack){
+      IplImage first_image = first;
+      if (ctracker.init(&first_image, cvRect(box.x, box.y, box.width, box.height)) != RI_RESP_SUCCESS){
+          cout << "No color in the bounding box, try again." << endl;
+          gotBB = false;
+          goto GETBOUNDINGBOX;
+      }
+  }
+  //Remove callback, the preview thread shows the frames from now on
+  if (!headless){
+    cvSetMouseCallback( "TLD", NULL, NULL );
+    cvDestroyWindow("TLD");
+  }
+  PreviewDisplay preview(RI_PREVIEW_DEFAULT_FPS, headless);
+  int tld_window = preview.addWindow("TLD");
+  int gray_window = preview.addWindow("last_gray");
+  preview.start();
   printf("Initial Bounding Box = x:%d y:%d h:%d w:%d\n",box.x,box.y,box.width,box.height);
   //Output file
   FILE  *bb_file = fopen("bounding_boxes.txt","w");
   //TLD initialization
 
+  if (!colortrack)
    tld.init(last_gray,box,bb_file);
-   imshow("last_gray",last_gray);
+  IplImage gray_image = last_gray;
+  preview.show(gray_window, &gray_image);
 
   ///Run-time
   Mat current_gray;
@@ -216,17 +305,43 @@ GETBOUNDINGBOX:
   bool status=true;
   int frames = 1;
   int detections = 1;
-  int current_position = 0;
+  CvRect cbox;
+  uint64_t started, took;
+  RITrace trace;
+  //The servo drives on a connection of its own while this loop tracks
+  RobotInterface *wheels = NULL;
+  VisualServo *servo = NULL;
+  if (follow && robot != NULL){
+    wheels = new RobotInterface(IP, 0);
+    servo = new VisualServo(wheels, cvGetSize(image));
+    servo->setReference(box.height);
+    //The servo adds the traces, with the moves based on them
+    robot->setLatencyStats(NULL);
+    servo->setLatencyStats(&latency);
+    servo->start();
+  }
 
 REPEAT:
   do{
-      robot->getImage(image);
+      // The end of a recording ends the run
+      if (grabFrame(robot, image) != RI_RESP_SUCCESS && fromrecording)
+        break;
       Mat frame(image);
      // imshow("current_image",frame);
+    started = riTimestamp();
+    if (colortrack){
+      //Process Frame, in color
+      ctracker.processFrame(image, &cbox, &status, bb_file);
+      pbox = BoundingBox(Rect(cbox.x, cbox.y, cbox.width, cbox.height));
+    }else{
     //get frame
     cvtColor(frame, current_gray, CV_RGB2GRAY);
     //Process Frame
     tld.processFrame(last_gray,current_gray,pts1,pts2,pbox,status,tl,bb_file);
+    }
+    took = riTimestamp() - started;
+    if (robot != NULL)
+      robot->traceMark(RI_TRACE_PROCESSED);
     //Draw Points
     if (status){
       drawPoints(frame,pts1);
@@ -235,32 +350,26 @@ REPEAT:
       detections++;
     }
 
-   current_position = (pbox.x + pbox.x + pbox.width)/2;
-    /*if(current_position > 240 && current_position < 400 );
-    else{
-        if(current_position <240){
-            robot->move(RI_MOVE_LEFT,RI_SLOWEST);
-          //  sleep(3);
-        //    robot->move(RI_STOP,RI_FASTEST);
-        }
-         else{
-            robot->move(RI_MOVE_RIGHT,RI_SLOWEST);
-         //   sleep(3);
-         //   robot->move(RI_STOP,RI_FASTEST);
-
-        }
-
-    }*/
+    //Steer towards the box, the servo corrects for the age of the frame
+    if (servo != NULL){
+      robot->getTrace(&trace);
+      servo->post(cvRect(pbox.x, pbox.y, pbox.width, pbox.height), status, &trace);
+    }
 
-    //Display
-    imshow("TLD", frame);
+    //Display, without waiting for it
+    IplImage shown = frame;
+    preview.show(tld_window, &shown);
     //swap points and images
     swap(last_gray,current_gray);
     pts1.clear();
     pts2.clear();
     frames++;
-    printf("Detection rate: %d/%d\n",detections,frames);
-    if (cvWaitKey(33) == 'q')
+    printf("Detection rate: %d/%d, %.1f ms\n",detections,frames,took / 1000.0);
+    if (robot != NULL && frames % 100 == 0)
+      latency.print(stdout);
+    if (servo != NULL && frames % 100 == 0)
+      servo->printStats(stdout);
+    if (preview.key() == 'q')
       break;
   }while(1);
 
@@ -272,8 +381,16 @@ REPEAT:
     //capture.set(CV_CAP_PROP_POS_AVI_RATIO,0);
     capture.release();
     capture.open(video);
+    if (fromrecording)
+      player.seek(0);
     goto REPEAT;
   }
   fclose(bb_file);
+  if (servo != NULL){
+    servo->stop();
+    delete servo;
+    delete wheels;
+  }
+  preview.stop();
   return 0;
 }
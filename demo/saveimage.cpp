@@ -1,5 +1,6 @@
 #include "robotdriver.h"
 #include "robotcolor.h"
+#include "imagesaver.h"
 #include <iostream>
 #include <string>
 
@@ -20,6 +21,12 @@ int main() {
         exit(-1);
     }
 
+    // Write the frames from a thread of their own, as the robot sent them
+    ImageSaver saver(RI_SAVE_DEFAULT_DIR);
+    if(saver.start() != RI_RESP_SUCCESS)
+        exit(-1);
+    robot->setImageSaver(&saver);
+
     // Create a window to display the output
     cvNamedWindow("Rovio Camera", CV_WINDOW_AUTOSIZE);
 
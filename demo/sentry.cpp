@@ -0,0 +1,60 @@
+#include "robotdriver.h"
+#include "sentry.h"
+#include "imagesaver.h"
+#include <iostream>
+#include <stdio.h>
+
+// Watch the room at low resolution, save full resolution frames while something moves
+int main() {
+    int major, minor, state = RI_SENTRY_IDLE, image_number = 0;
+    IplImage *frame = NULL;
+    const char *IP = "192.168.10.18";
+    // Setup the robot interface
+    RobotInterface *robot = new RobotInterface(IP, 0);
+
+    // Print the API Version
+    robot->APIVersion(&major, &minor);
+    std::cout << "Robot API Test: API Version v" << major << "." << minor << std::endl;
+
+    // Setup the camera, the sentry then only changes the resolution and quality
+    if(robot->cameraConfigure(RI_CAMERA_DEFAULT_BRIGHTNESS, RI_CAMERA_DEFAULT_CONTRAST, 30, RI_CAMERA_RES_640, RI_CAMERA_QUALITY_HIGH)) {
+        std::cout << "Failed to configure the camera!" << std::endl;
+        exit(-1);
+    }
+
+    // Write the full resolution frames from a thread of their own
+    ImageSaver saver(RI_SAVE_DEFAULT_DIR);
+    if(saver.start() != RI_RESP_SUCCESS)
+        exit(-1);
+    robot->setImageSaver(&saver);
+
+    SentryCapture sentry(robot);
+    sentry.start();
+
+    cvNamedWindow("Rovio Sentry", CV_WINDOW_AUTOSIZE);
+    do {
+        if(sentry.poll(&frame) != RI_RESP_SUCCESS) {
+            std::cout << "Unable to capture an image!" << std::endl;
+            continue;
+        }
+
+        if(sentry.getState() != state) {
+            state = sentry.getState();
+            printf("%s, %u frames, %u full, %llu KB\n", state == RI_SENTRY_ALERT ? "Motion" : "Quiet",
+                sentry.frames(), sentry.fullFrames(), (unsigned long long)(sentry.bytes() / 1024));
+        }
+
+        // Only the frames that are worth looking at
+        if(frame != NULL) {
+            cvShowImage("Rovio Sentry", frame);
+            robot->saveImage(frame, image_number++);
+        }
+        cvWaitKey(10);
+    } while(1);
+
+    // Clean up (although we'll never get here...)
+    sentry.stop();
+    delete(robot);
+
+    return 0;
+}
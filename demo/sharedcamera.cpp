@@ -0,0 +1,101 @@
+#include "robotdriver.h"
+#include "framering.h"
+#include <iostream>
+#include <string.h>
+#include <stdio.h>
+
+// Publish the camera frames to the other processes of the machine
+static int publish(void) {
+    int major, minor;
+    const unsigned char *jpeg;
+    int jpeg_size;
+    uint64_t timestamp;
+    CvSize size;
+    IplImage *slot;
+    const char *IP = "192.168.10.18";
+    FrameRingWriter ring;
+    // Setup the robot interface
+    RobotInterface *robot = new RobotInterface(IP, 0);
+
+    // Print the API Version
+    robot->APIVersion(&major, &minor);
+    std::cout << "Robot API Test: API Version v" << major << "." << minor << std::endl;
+
+    // Setup the camera
+    if(robot->cameraConfigure(RI_CAMERA_DEFAULT_BRIGHTNESS, RI_CAMERA_DEFAULT_CONTRAST, 30, RI_CAMERA_RES_640, RI_CAMERA_QUALITY_HIGH)) {
+        std::cout << "Failed to configure the camera!" << std::endl;
+        exit(-1);
+    }
+
+    // Room for the largest frames the camera sends
+    if(ring.create(RI_SHM_DEFAULT_NAME, riCameraSize(RI_CAMERA_RES_640), 3) != RI_RESP_SUCCESS)
+        exit(-1);
+
+    do {
+        if(robot->update() != RI_RESP_SUCCESS) {
+            std::cout << "Failed to update sensor information!" << std::endl;
+            continue;
+        }
+        timestamp = riTimestamp();
+        if(robot->getJpeg(&jpeg, &jpeg_size) != RI_RESP_SUCCESS || riJpegSize(jpeg, jpeg_size, &size) != RI_RESP_SUCCESS) {
+            std::cout << "Unable to capture an image!" << std::endl;
+            continue;
+        }
+
+        // Decode straight into the ring, once for all the readers
+        slot = ring.begin(size, 3);
+        if(slot == NULL || riDecodeJpeg(jpeg, jpeg_size, slot) != RI_RESP_SUCCESS) {
+            ring.cancel();
+            continue;
+        }
+        ring.commit(timestamp, robot->getSensors(), robot->getReport());
+
+        if(ring.count() % 100 == 0)
+            std::cout << "Published " << ring.count() << " frames" << std::endl;
+    } while(1);
+
+    // Clean up (although we'll never get here...)
+    ring.close();
+    delete(robot);
+    return 0;
+}
+
+// Show the frames another process publishes, without talking to the robot
+static int view(void) {
+    FrameRingReader ring;
+    RIShmFrame frame;
+    uint64_t last = 0;
+
+    if(ring.open(RI_SHM_DEFAULT_NAME) != RI_RESP_SUCCESS) {
+        std::cout << "Start the publisher first!" << std::endl;
+        exit(-1);
+    }
+
+    cvNamedWindow("Shared Camera", CV_WINDOW_AUTOSIZE);
+    do {
+        if(ring.wait(last, 1000) != RI_RESP_SUCCESS) {
+            std::cout << "No frame for a second" << std::endl;
+            continue;
+        }
+        if(ring.latest(&frame) != RI_RESP_SUCCESS)
+            continue;
+        last = frame.number + 1;
+
+        // Shown in place, the window keeps a copy
+        cvShowImage("Shared Camera", &frame.image);
+        if(!ring.valid(&frame))
+            std::cout << "Frame " << frame.number << " was overwritten while shown" << std::endl;
+        cvWaitKey(1);
+    } while(1);
+
+    // Clean up (although we'll never get here...)
+    ring.close();
+    cvDestroyWindow("Shared Camera");
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    if(argc > 1 && strcmp(argv[1], "-v") == 0)
+        return view();
+    return publish();
+}
@@ -0,0 +1,60 @@
+#include "robotdriver.h"
+#include "telemetry.h"
+#include <iostream>
+#include <stdio.h>
+#include <inttypes.h>
+
+// Convert a telemetry ring file written by TelemetryLog into CSV, oldest record first
+int main(int argc, char *argv[]) {
+    TelemetryReader reader;
+    RITelemetryRecord rec;
+    FILE *out = stdout;
+    uint64_t i, count, skipped = 0;
+
+    if(argc < 2) {
+        printf("use:\n     %s telemetry.bin [output.csv]\n", argv[0]);
+        return 1;
+    }
+    if(reader.open(argv[1]) != RI_RESP_SUCCESS)
+        return 1;
+    if(argc > 2) {
+        out = fopen(argv[2], "w");
+        if(out == NULL) {
+            perror("Unable to create the output file.");
+            return 1;
+        }
+    }
+
+    fprintf(out, "time_us,latency_us,command,arg,speed,result,"
+        "left_dir,left_ticks,right_dir,right_ticks,rear_dir,rear_ticks,head_position,sensor_battery,status,"
+        "x,y,theta,room_id,strength,state,brightness,cam_res,frame_rate,speaker_volume,mic_volume,wifi,battery,charging,report_head_position\n");
+
+    count = reader.count();
+    for(i = 0; i < count; i++) {
+        // Records overwritten by a live writer are skipped
+        if(!reader.get(i, &rec)) {
+            skipped++;
+            continue;
+        }
+        fprintf(out, "%" PRIu64 ",%u,%i,%i,%i,%i,"
+            "%u,%u,%u,%u,%u,%u,%u,%u,%u,"
+            "%i,%i,%f,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u\n",
+            rec.timestamp - reader.created(), rec.latency, rec.command, rec.arg, rec.speed, rec.result,
+            rec.sensor.left_wheel_dir, rec.sensor.left_wheel_enc_ticks,
+            rec.sensor.right_wheel_dir, rec.sensor.right_wheel_enc_ticks,
+            rec.sensor.rear_wheel_dir, rec.sensor.rear_wheel_enc_ticks,
+            rec.sensor.head_position, rec.sensor.battery, rec.sensor.status,
+            rec.report.x, rec.report.y, rec.report.theta, rec.report.room_id, rec.report.strength,
+            rec.report.state, rec.report.brightness, rec.report.cam_res, rec.report.frame_rate,
+            rec.report.speaker_volume, rec.report.mic_volume, rec.report.wifi,
+            rec.report.battery, rec.report.charging, rec.report.head_position);
+    }
+
+    if(out != stdout)
+        fclose(out);
+    std::cerr << "Exported " << (count - skipped) << " records";
+    if(skipped > 0)
+        std::cerr << " (" << skipped << " overwritten while reading)";
+    std::cerr << std::endl;
+    return 0;
+}
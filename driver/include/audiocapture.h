@@ -0,0 +1,111 @@
+/**
+ * @file audiocapture.h
+ * @brief Streaming microphone capture from the Rovio
+ *
+ * The AudioCapture class reads an audio stream from the robot's webserver on its own
+ * connection and thread, cuts it into timestamped PCM blocks and hands them to the caller
+ * through a lock-free ring buffer, so listening never stalls the video or the control
+ * requests.
+ *
+ * The Rovio API has no raw microphone CGI, GetAudio.cgi is where audio is posted to the
+ * speaker. The caller gives the path of a stream that answers a GET with an HTTP header
+ * followed by raw 16 bit signed little endian mono PCM at RI_AUDIO_SAMPLE_RATE, a relay
+ * in front of the robot's RTSP audio for example.
+ */
+
+#ifndef __RI_AUDIO_CAPTURE_H__
+#define __RI_AUDIO_CAPTURE_H__
+
+#include "robotdriver.h"
+#include "ringbuffer.h"
+#include <pthread.h>
+
+/***************************************
+ * Audio stream description
+ ***************************************/
+// The stream must be 16 bit signed little endian mono PCM
+#define RI_AUDIO_SAMPLE_RATE		8000
+#define RI_AUDIO_BLOCK_SAMPLES		256
+// Default number of blocks buffered between the capture thread and the reader (~2 s)
+#define RI_AUDIO_DEFAULT_BLOCKS		64
+
+/** @brief A block of audio samples */
+typedef struct {
+    uint64_t		timestamp; /* riTimestamp() when the first sample of the block was received */
+    uint32_t		sequence; /* Block number since start(), gaps mean dropped blocks */
+    uint32_t		samples; /* Number of valid samples, RI_AUDIO_BLOCK_SAMPLES except at the end of a stream */
+    int16_t		pcm[RI_AUDIO_BLOCK_SAMPLES];
+} RIAudioBlock;
+
+/**
+ * @class AudioCapture
+ * @brief Captures the microphone of the robot in the background
+ *
+ * The capture thread is the only producer of the ring and the caller of read()/front() is
+ * the only consumer. When the reader falls behind, the newest blocks are dropped instead of
+ * blocking the socket, and the count is reported by dropped().
+ */
+class AudioCapture {
+	private:
+        RobotIfType conn;               ///<Private connection to the robot
+        pthread_mutex_t sock_lock;      ///<Guards conn.sock between the capture thread and stop()
+        char path[MAX_ADDR_LEN];        ///<Path of the PCM stream
+        SpscRing<RIAudioBlock> ring;    ///<Blocks waiting to be read
+        pthread_t thread;
+        volatile bool running;
+        volatile uint32_t drop_count;
+        uint32_t sequence;
+
+        static void *captureThread(void *arg);
+        int stream(void);
+        void closeStream(void);
+
+        // Not copyable
+        AudioCapture(const AudioCapture &);
+        AudioCapture &operator=(const AudioCapture &);
+	public:
+        /**
+         * @brief AudioCapture() Create a capture of the PCM stream at endpoint, holding up to blocks audio blocks.
+         */
+        AudioCapture(RobotInterface *robot, const char *endpoint, uint32_t blocks = RI_AUDIO_DEFAULT_BLOCKS);
+        /**
+         * @brief A destructor, stops the capture.
+         */
+        ~AudioCapture();
+
+        /**
+         * @brief Capture, start the capture thread.
+         */
+        int start(void);
+        /**
+         * @brief Capture, stop the capture thread and close the connection.
+         */
+        int stop(void);
+        /**
+         * @brief Capture, returns true while the capture thread is running.
+         */
+        bool isRunning(void);
+
+        /**
+         * @brief Reader, copy the oldest block out, returns false if none is waiting.
+         */
+        bool read(RIAudioBlock *block);
+        /**
+         * @brief Reader, returns the oldest block in place or NULL, hand it back with release().
+         */
+        const RIAudioBlock *front(void);
+        /**
+         * @brief Reader, release the block returned by front().
+         */
+        void release(void);
+        /**
+         * @brief Reader, the number of blocks waiting to be read.
+         */
+        uint32_t available(void);
+        /**
+         * @brief The number of blocks dropped because the reader fell behind.
+         */
+        uint32_t dropped(void);
+};
+
+#endif /* __RI_AUDIO_CAPTURE_H__ */
@@ -0,0 +1,139 @@
+/**
+ * @file behavior.h
+ * @brief Reactive behaviors run at a fixed control rate
+ *
+ * A loop of update(), IRDetected() and move() runs as fast as HTTP allows: its reaction time
+ * follows the network, a failed poll is retried at once and the same move is sent again
+ * on every turn. BehaviorEngine polls the MCU on its own thread at a fixed rate, debounces
+ * the IR detector into a state with rising and falling edges, and asks a list of rules
+ * for a command. The command is sent when it changes and repeated at the refresh period
+ * while it lasts (see RI_MOVE_PULSE_US), never faster than the control rate. The loop keeps
+ * overrun and step time statistics to check that the rate holds.
+ */
+
+#ifndef __RI_BEHAVIOR_H__
+#define __RI_BEHAVIOR_H__
+
+#include "robotdriver.h"
+#include <pthread.h>
+#include <stdio.h>
+
+/***************************************
+ * Behavior engine description
+ ***************************************/
+#define RI_BEHAVIOR_DEFAULT_RATE	10      /* Control steps per second */
+#define RI_BEHAVIOR_DEFAULT_DEBOUNCE	2       /* Polls the IR detector must agree on to change state */
+#define RI_BEHAVIOR_DEFAULT_REFRESH	(RI_MOVE_PULSE_US / 2)  /* Resend period of a drive command, within a pulse */
+#define RI_BEHAVIOR_MAX_RULES		16
+
+/** @brief What the rules see at a control step */
+typedef struct {
+    uint64_t		timestamp; /* riTimestamp() in the middle of the poll */
+    uint32_t		step; /* Control step number */
+    bool		ir; /* Debounced IR obstacle state */
+    bool		ir_rose; /* ir became true at this step */
+    bool		ir_fell; /* ir became false at this step */
+    uint64_t		ir_since; /* riTimestamp() ir last changed, 0 if it never did */
+    RIData		sensor; /* The poll of this step */
+} RIBehaviorInput;
+
+/** @brief A drive command chosen by a rule */
+typedef struct {
+    int			movement; /* RI_STOP, RI_MOVE_*, RI_TURN_* */
+    int			speed; /* RI_FASTEST to RI_SLOWEST */
+} RIBehaviorCommand;
+
+/**
+ * @brief A rule, returns true and sets the command if it wants to drive.
+ *
+ * Rules run on the engine thread, arg is the pointer given to addRule().
+ */
+typedef bool (*RIBehaviorRule)(const RIBehaviorInput *input, RIBehaviorCommand *cmd, void *arg);
+
+/** @brief Rule, turns left while there is an obstacle, arg may point to the RIBehaviorCommand to use instead */
+bool riBehaviorAvoid(const RIBehaviorInput *input, RIBehaviorCommand *cmd, void *arg);
+/** @brief Rule, always drives forward, arg may point to the RIBehaviorCommand to use instead */
+bool riBehaviorCruise(const RIBehaviorInput *input, RIBehaviorCommand *cmd, void *arg);
+
+/** @brief Control loop statistics */
+typedef struct {
+    uint32_t		steps; /* Control steps run */
+    uint32_t		overruns; /* Steps that did not fit in their period */
+    uint32_t		errors; /* Failed polls, the step was skipped */
+    uint32_t		commands; /* Moves sent */
+    uint32_t		edges; /* Changes of the debounced IR state */
+    uint64_t		step_sum; /* Microseconds spent in the steps */
+    uint32_t		step_max;
+} RIBehaviorStats;
+
+/**
+ * @class BehaviorEngine
+ * @brief Runs prioritized reactive rules at a fixed rate on a thread of its own
+ *
+ * At each step the rules are asked in the order they were added, the first one that
+ * returns true drives, and the robot stops if none does. The engine drives through the
+ * given robot, nothing else may move it while the engine is started.
+ */
+class BehaviorEngine {
+	private:
+        RobotInterface *robot;          ///<Sends the moves
+        RobotIfType conn;               ///<Private connection for the polls
+        RIBehaviorRule rules[RI_BEHAVIOR_MAX_RULES];
+        void *rule_args[RI_BEHAVIOR_MAX_RULES];
+        int rule_count;
+        int rate;
+        int debounce;
+        uint64_t refresh;               ///<Resend period of an unchanged command, 0 never
+        pthread_mutex_t lock;           ///<Guards stats
+        RIBehaviorStats stats;
+        pthread_t thread;
+        volatile bool running;
+
+        static void *behaviorThread(void *arg);
+        void decide(const RIBehaviorInput *input, RIBehaviorCommand *cmd);
+
+        // Not copyable
+        BehaviorEngine(const BehaviorEngine &);
+        BehaviorEngine &operator=(const BehaviorEngine &);
+	public:
+        /**
+         * @brief BehaviorEngine() Create an engine running rate control steps per second.
+         */
+        BehaviorEngine(RobotInterface *robot, int rate = RI_BEHAVIOR_DEFAULT_RATE, int debounce = RI_BEHAVIOR_DEFAULT_DEBOUNCE);
+        /**
+         * @brief A destructor, stops the engine.
+         */
+        ~BehaviorEngine();
+
+        /**
+         * @brief Add a rule before start(), below the ones already added.
+         */
+        int addRule(RIBehaviorRule rule, void *arg = NULL);
+        /**
+         * @brief Send an unchanged drive command again every us microseconds, RI_BEHAVIOR_DEFAULT_REFRESH by default.
+         */
+        void setRefresh(uint64_t us);
+        /**
+         * @brief Start the control thread.
+         */
+        int start(void);
+        /**
+         * @brief Stop the control thread and the robot.
+         */
+        int stop(void);
+        /**
+         * @brief Returns true while the control thread is running.
+         */
+        bool isRunning(void);
+
+        /**
+         * @brief Copy the control loop statistics.
+         */
+        void getStats(RIBehaviorStats *out);
+        /**
+         * @brief Print the control loop statistics.
+         */
+        void printStats(FILE *out);
+};
+
+#endif /* __RI_BEHAVIOR_H__ */
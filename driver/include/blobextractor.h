@@ -0,0 +1,95 @@
+/**
+ * @file blobextractor.h
+ * @brief Connected blobs of several colors in one scan
+ *
+ * BlobExtractor classifies the pixels of a BGR image against up to RI_MAX_COLORS HSV
+ * ranges with riColorClassify(), then labels the 8-connected pixels of the same class in
+ * a single raster scan: every row is cut into runs of one class, a run is joined to the
+ * runs of the same class touching it in the row above with a union-find, and the area,
+ * centroid and bounding box of each blob are summed over its runs. All colors cost one
+ * pass over the image, where thresholding and finding contours costs one pass per color.
+ */
+
+#ifndef __RI_BLOB_EXTRACTOR_H__
+#define __RI_BLOB_EXTRACTOR_H__
+
+#include "robotdriver.h"
+#include "colorthreshold.h"
+#include <vector>
+
+#define RI_BLOB_DEFAULT_MIN_AREA	20      /* Smaller blobs are noise */
+
+/** @brief A blob of one color */
+typedef struct {
+    int			color; /* Index of the range in setColors() */
+    int			area; /* Number of pixels */
+    CvPoint2D32f	centroid; /* Mean of the pixel coordinates */
+    CvRect		box; /* Bounding box */
+} RIBlob;
+
+/** @brief A run of pixels of one class on a row */
+typedef struct {
+    int			y;
+    int			start, end; /* First pixel and the pixel after the last */
+    int			color;
+} RIBlobRun;
+
+/**
+ * @class BlobExtractor
+ * @brief Labels the blobs of several colors, without allocating per frame
+ *
+ * The vector returned by find() belongs to the extractor and is overwritten by the next
+ * call. Blobs are in raster order of their first pixel.
+ */
+class BlobExtractor {
+	private:
+        RIColorRange ranges[RI_MAX_COLORS];
+        int count;
+        int min_area;
+        IplImage *classes;              ///<Class of every pixel, 0 for none
+        std::vector<RIBlobRun> runs;
+        std::vector<int> parent;        ///<Union-find over the runs
+        std::vector<int> blob_of;       ///<Blob of each root run
+        std::vector<int64_t> sum_x, sum_y;
+        std::vector<RIBlob> blobs;      ///<Result of the last call
+
+        int root(int run);
+
+        // Not copyable
+        BlobExtractor(const BlobExtractor &);
+        BlobExtractor &operator=(const BlobExtractor &);
+	public:
+        BlobExtractor();
+        /**
+         * @brief A destructor, releases the class image.
+         */
+        ~BlobExtractor();
+
+        /**
+         * @brief Set the HSV ranges to look for, the first one a pixel is in gives its class.
+         */
+        int setColors(const RIColorRange *ranges, int count);
+        /**
+         * @brief Blobs smaller than area pixels are left out, RI_BLOB_DEFAULT_MIN_AREA by default.
+         */
+        void setMinArea(int area);
+
+        /**
+         * @brief Takes a BGR image and returns the blobs of all the colors.
+         */
+        const std::vector<RIBlob> &find(const IplImage *bgr);
+        /**
+         * @brief Returns the blobs of an image already classified, 0 for no class and n + 1 for color n.
+         */
+        const std::vector<RIBlob> &label(const IplImage *classes);
+        /**
+         * @brief The blobs found by the last call.
+         */
+        const std::vector<RIBlob> &result(void) const;
+        /**
+         * @brief The biggest blob of a color in the last call, or NULL if there was none.
+         */
+        const RIBlob *biggest(int color) const;
+};
+
+#endif /* __RI_BLOB_EXTRACTOR_H__ */
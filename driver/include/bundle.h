@@ -0,0 +1,94 @@
+/**
+ * @file bundle.h
+ * @brief Frames bundled with the sensor data of the instant they were taken
+ *
+ * getImage() and update() are separate round trips, so the encoder, IR and North Star
+ * values read next to a frame can be a few hundred milliseconds off. FrameBundler takes
+ * the frame, estimates when the camera took it from its trace, and looks the MCU polls
+ * done just before and after that instant up in the Odometry history. The odometry and
+ * the pose are interpolated to the frame time, and the IR state is that of the nearest
+ * poll, so vision, control and logging all work on the same instant without polling again.
+ */
+
+#ifndef __RI_BUNDLE_H__
+#define __RI_BUNDLE_H__
+
+#include "robotdriver.h"
+#include "odometry.h"
+#include "poseestimator.h"
+
+/***************************************
+ * Bundle description
+ ***************************************/
+#define RI_BUNDLE_DEFAULT_WAIT		100000  /* Microseconds to wait for the poll after a frame, two polls at 20Hz */
+#define RI_BUNDLE_POLL_US		2000    /* Check period while waiting for that poll */
+
+/** @brief A frame and the robot state when it was taken */
+typedef struct {
+    uint32_t		number; /* Frame number, from the trace */
+    uint64_t		timestamp; /* Estimated capture time, halfway from the request to the first byte */
+    RISensorSample	before; /* MCU polls around the capture */
+    RISensorSample	after;
+    RIData		sensor; /* Sensor data of the nearest of the two polls */
+    uint32_t		skew; /* Microseconds from the capture to that poll */
+    bool		ir_detected; /* IR obstacle flag of that poll */
+    bool		bracketed; /* False if the odometry was extrapolated, no poll came in time */
+    RIOdometrySample	odometry; /* Interpolated to the capture time */
+    bool		has_pose; /* pose is set, a PoseEstimator was given */
+    RIPose		pose; /* Interpolated to the capture time */
+    RIReport		report; /* Last North Star report, if has_pose */
+    uint64_t		report_time; /* riTimestamp() of that report, 0 if none */
+} RIBundle;
+
+/**
+ * @class FrameBundler
+ * @brief Captures frames bundled with the interpolated odometry, pose and sensor data
+ *
+ * The odometry must be started: its polls are the sensor samples. Frames are captured from
+ * one thread at a time.
+ */
+class FrameBundler {
+	private:
+        RobotInterface *robot;
+        Odometry *odometry;
+        PoseEstimator *estimator;       ///<NULL if there is no pose to bundle
+        uint64_t max_wait;
+        uint32_t frame_count;
+        uint32_t unbracketed_count;
+
+        // Not copyable
+        FrameBundler(const FrameBundler &);
+        FrameBundler &operator=(const FrameBundler &);
+	public:
+        /**
+         * @brief FrameBundler() Create a bundler on top of a running odometry, and optionally a pose estimator.
+         */
+        FrameBundler(RobotInterface *robot, Odometry *odometry, PoseEstimator *estimator = NULL);
+
+        /**
+         * @brief The longest wait for the poll after a frame, RI_BUNDLE_DEFAULT_WAIT by default.
+         */
+        void setMaxWait(uint64_t us);
+        /**
+         * @brief Capture a frame with getImage() and bundle it.
+         */
+        int capture(IplImage *image, RIBundle *bundle);
+        /**
+         * @brief Bundle a frame captured some other way, for example with getJpeg(), at the given time.
+         */
+        int align(uint64_t timestamp, RIBundle *bundle);
+
+        /**
+         * @brief The number of frames bundled.
+         */
+        uint32_t frames(void);
+        /**
+         * @brief The number of frames with no poll after them in time.
+         */
+        uint32_t unbracketed(void);
+};
+
+/** @brief The capture time of a frame from its trace, halfway from the request to the first byte */
+uint64_t riTraceCaptureTime(const RITrace *trace);
+
+#endif /* __RI_BUNDLE_H__ */
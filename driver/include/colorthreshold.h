@@ -0,0 +1,37 @@
+/**
+ * @file colorthreshold.h
+ * @brief Several HSV color thresholds of a BGR image in one pass
+ *
+ * riColorThreshold() gives the masks cvCvtColor(CV_BGR2HSV) followed by one cvInRangeS()
+ * per color would give, but reads the BGR image once, never writes the HSV image and tests
+ * all the colors with a single table lookup per pixel.
+ */
+
+#ifndef __RI_COLOR_THRESHOLD_H__
+#define __RI_COLOR_THRESHOLD_H__
+
+#include "robotdriver.h"
+
+#define RI_MAX_COLORS			8       /* Masks per call */
+
+/** @brief An HSV range, bounds included like cvInRangeS() */
+typedef struct {
+    CvScalar		low; /* H, S, V lower bounds, H in 0-179 */
+    CvScalar		high; /* H, S, V upper bounds */
+} RIColorRange;
+
+/**
+ * @brief Fill a range from the RC_*_LOW and RC_*_HIGH presets of robotcolor.h.
+ */
+RIColorRange riColorRange(CvScalar low, CvScalar high);
+
+/**
+ * @brief Threshold a BGR image against count HSV ranges, one 1 plane mask per range.
+ */
+int riColorThreshold(const IplImage *bgr, const RIColorRange *ranges, int count, IplImage **masks);
+/**
+ * @brief Classify each pixel of a BGR image by the first of count HSV ranges it is in, in a 1 plane image.
+ */
+int riColorClassify(const IplImage *bgr, const RIColorRange *ranges, int count, IplImage *classes);
+
+#endif /* __RI_COLOR_THRESHOLD_H__ */
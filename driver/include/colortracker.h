@@ -0,0 +1,105 @@
+/**
+ * @file colortracker.h
+ * @brief Hue histogram tracker, a fast alternative to TLD for colored targets
+ *
+ * ColorTracker learns the hue histogram of a box around the target, from a user selection
+ * or a findSquares() hit. On each frame it back-projects the histogram around where the
+ * target was, masks out the pixels too gray or too dark to have a meaningful hue and runs
+ * CamShift on the result, which moves and resizes the box onto the densest part of the
+ * target's color. Only the search area is converted to HSV, so a frame costs a fraction
+ * of a full frame conversion. When the target is lost the whole frame is searched.
+ */
+
+#ifndef __RI_COLOR_TRACKER_H__
+#define __RI_COLOR_TRACKER_H__
+
+#include "robotdriver.h"
+#include "squaredetector.h"
+#include <stdio.h>
+
+/***************************************
+ * Tracker description
+ ***************************************/
+#define RI_CTRACK_BINS			30      /* Hue histogram bins over 0-179 */
+#define RI_CTRACK_MIN_SATURATION	60      /* Below this the hue is noise */
+#define RI_CTRACK_MIN_VALUE		32
+#define RI_CTRACK_MAX_VALUE		255
+// The search area is the box grown by this fraction of its size on each side
+#define RI_CTRACK_MARGIN		0.5
+// Mean back-projection in the box, out of 1, under which the target is lost
+#define RI_CTRACK_MIN_SCORE		0.2
+#define RI_CTRACK_MIN_SIZE		4       /* Smallest box side, in pixels */
+
+/**
+ * @class ColorTracker
+ * @brief Follows a colored target with CamShift on a hue back-projection
+ *
+ * processFrame() reports like TLD::processFrame(): the next box, whether it was found, and
+ * the same line per frame in the bounding box file.
+ */
+class ColorTracker {
+	private:
+        CvHistogram *hist;              ///<Hue model of the target, scaled to 0-255
+        IplImage *hsv;                  ///<Work images, of the largest search area so far
+        IplImage *hue;
+        IplImage *mask;
+        IplImage *backproject;
+        IplImage view;                  ///<Header on the search area of the frame
+        CvSize size;
+        CvRect box;                     ///<Last box, in frame coordinates
+        CvBox2D ellipse;                ///<Last CamShift ellipse
+        bool ready;                     ///<A target was learned
+        bool found;
+        double last_score;
+        int min_saturation;
+
+        void prepare(const IplImage *frame, CvRect area);
+        void release(void);
+
+        // Not copyable
+        ColorTracker(const ColorTracker &);
+        ColorTracker &operator=(const ColorTracker &);
+	public:
+        ColorTracker();
+        /**
+         * @brief A destructor, frees the histogram and the work images.
+         */
+        ~ColorTracker();
+
+        /**
+         * @brief Pixels less saturated than this are ignored, in the model and in the frames.
+         */
+        void setMinSaturation(int saturation);
+
+        /**
+         * @brief Learn the target in box of a BGR frame.
+         */
+        int init(const IplImage *frame, CvRect box);
+        /**
+         * @brief Learn the target from a square found by SquareDetector.
+         */
+        int init(const IplImage *frame, const RISquare &square);
+        /**
+         * @brief Learn the target from a square found by RobotInterface::findSquares().
+         */
+        int init(const IplImage *frame, const SquaresType *square);
+        /**
+         * @brief Returns true once a target was learned.
+         */
+        bool isReady(void);
+
+        /**
+         * @brief Track the target in the next BGR frame, like TLD::processFrame().
+         */
+        int processFrame(const IplImage *frame, CvRect *bbnext, bool *lastboxfound, FILE *bb_file = NULL);
+        /**
+         * @brief The rotated box of the target in the last frame.
+         */
+        CvBox2D getEllipse(void);
+        /**
+         * @brief Mean back-projection in the last box, 0 to 1.
+         */
+        double score(void);
+};
+
+#endif /* __RI_COLOR_TRACKER_H__ */
@@ -0,0 +1,90 @@
+/**
+ * @file duplicatefilter.h
+ * @brief Detection of repeated camera frames before they are decoded
+ *
+ * When the robot stands still, or is polled faster than the camera delivers, the same
+ * picture comes back again. DuplicateFilter looks at the JPEG bytes before anything is
+ * decoded: a frame with the same bytes as the last one is a duplicate, and otherwise the
+ * DC coefficients of its 8x8 blocks (a 1/8 scale gray image libjpeg gets without running
+ * the inverse DCT) are compared to those of the last new frame. If no block changed by more
+ * than the noise level, the frame is a near duplicate and the caller can keep the results
+ * of the last one instead of decoding and processing it.
+ */
+
+#ifndef __RI_DUPLICATE_FILTER_H__
+#define __RI_DUPLICATE_FILTER_H__
+
+#include "robotdriver.h"
+
+/***************************************
+ * Filter description
+ ***************************************/
+#define RI_DUP_DEFAULT_LEVEL		6       /* Change of a block mean (0-255) that is more than noise */
+#define RI_DUP_DEFAULT_BLOCKS		0       /* Changed blocks still called a near duplicate */
+
+// Verdicts of check()
+#define RI_DUP_NEW			0       ///<The frame must be processed
+#define RI_DUP_SAME			1       ///<Same bytes as the last frame
+#define RI_DUP_SIMILAR			2       ///<Same blocks as the last new frame, within the noise level
+
+/**
+ * @class DuplicateFilter
+ * @brief Tells the new frames of a sequence from the repeated ones
+ */
+class DuplicateFilter {
+	private:
+        int level;
+        int blocks;
+        uint64_t last_hash;             ///<Of the bytes of the last frame
+        int last_size;
+        IplImage *reference;            ///<DC image of the last new frame
+        IplImage *dc;                   ///<DC image of the frame being checked
+        uint32_t frame_count;
+        uint32_t same_count;
+        uint32_t similar_count;
+
+        // Not copyable
+        DuplicateFilter(const DuplicateFilter &);
+        DuplicateFilter &operator=(const DuplicateFilter &);
+	public:
+        /**
+         * @brief DuplicateFilter() Create a filter, frames with at most blocks blocks changed by more than level are near duplicates.
+         */
+        DuplicateFilter(int level = RI_DUP_DEFAULT_LEVEL, int blocks = RI_DUP_DEFAULT_BLOCKS);
+        /**
+         * @brief A destructor, frees the DC images.
+         */
+        ~DuplicateFilter();
+
+        /**
+         * @brief Set the near duplicate test, a negative level only skips frames with the same bytes.
+         */
+        void setThreshold(int level, int blocks);
+        /**
+         * @brief Forget the last frame, the next one is new.
+         */
+        void reset(void);
+
+        /**
+         * @brief Check the next JPEG of the sequence, returns RI_DUP_NEW, RI_DUP_SAME or RI_DUP_SIMILAR.
+         */
+        int check(const unsigned char *jpeg, int size);
+        /**
+         * @brief The number of frames checked.
+         */
+        uint32_t frames(void);
+        /**
+         * @brief The number of frames found to be duplicates or near duplicates.
+         */
+        uint32_t skipped(void);
+        /**
+         * @brief The number of frames with the same bytes as the one before.
+         */
+        uint32_t same(void);
+        /**
+         * @brief The number of near duplicates.
+         */
+        uint32_t similar(void);
+};
+
+#endif /* __RI_DUPLICATE_FILTER_H__ */
@@ -0,0 +1,184 @@
+/**
+ * @file framerecord.h
+ * @brief Indexed recording of camera sessions
+ *
+ * FrameRecorder stores the JPEG frames exactly as the camera sent them, one after the
+ * other in a data file, and appends a fixed size entry per frame to an index file next to
+ * it (<path>.idx). The entry holds the capture timestamp, where the frame is in the data
+ * file and the sensor data and report cached when the frame was captured. FramePlayer maps
+ * both files, so any frame is found in O(1) by its number, or by binary search on its time,
+ * and decoded straight from the mapping without a copy or a network request.
+ */
+
+#ifndef __RI_FRAME_RECORD_H__
+#define __RI_FRAME_RECORD_H__
+
+#include "robotdriver.h"
+
+/***************************************
+ * Recording file description
+ ***************************************/
+#define RI_REC_MAGIC			0x43455252  /* "RREC" */
+#define RI_REC_VERSION			1
+#define RI_REC_INDEX_SUFFIX		".idx"
+#define RI_REC_MAX_PATH			256
+
+/** @brief The index file header, followed by one entry per frame */
+typedef struct {
+    uint32_t		magic; /* RI_REC_MAGIC */
+    uint32_t		version; /* RI_REC_VERSION */
+    uint32_t		entry_size; /* sizeof(RIFrameEntry) */
+    uint32_t		reserved0;
+    uint64_t		created; /* riTimestamp() when the recording was created */
+    uint32_t		reserved[8];
+} RIRecordHeader;
+
+/** @brief One frame of the index */
+typedef struct {
+    uint64_t		timestamp; /* riTimestamp() when the image was requested */
+    uint64_t		offset; /* Start of the JPEG in the data file */
+    uint32_t		size; /* Size of the JPEG in bytes */
+    uint32_t		number; /* Frame number, from 0 */
+    RIData		sensor; /* Sensor data cached when the frame was captured */
+    RIReport		report; /* Report cached when the frame was captured */
+} RIFrameEntry;
+
+/**
+ * @class FrameRecorder
+ * @brief Appends JPEG frames to a recording
+ *
+ * A recorder is written by one thread at a time, attach it to a RobotInterface with
+ * setRecorder() to record every getImage() and getJpeg().
+ */
+class FrameRecorder {
+	private:
+        int data_fd;
+        int index_fd;
+        uint64_t offset;                ///<End of the data file
+        uint32_t frames;
+
+        // Not copyable
+        FrameRecorder(const FrameRecorder &);
+        FrameRecorder &operator=(const FrameRecorder &);
+	public:
+        FrameRecorder();
+        /**
+         * @brief A destructor, closes the recording.
+         */
+        ~FrameRecorder();
+
+        /**
+         * @brief Create (or truncate) the recording path and its index path.idx.
+         */
+        int open(const char *path);
+        /**
+         * @brief Close the recording.
+         */
+        int close(void);
+        /**
+         * @brief Returns true if a recording is open.
+         */
+        bool isOpen(void);
+
+        /**
+         * @brief Append a JPEG frame with the sensor data and report of its capture.
+         */
+        int record(const unsigned char *jpeg, int size, uint64_t timestamp, const RIData *sensor, const RIReport *report);
+        /**
+         * @brief The number of frames recorded since the recording was opened.
+         */
+        uint32_t count(void);
+};
+
+/**
+ * @class FramePlayer
+ * @brief Reads a recording back, in order or at random
+ *
+ * next() is a drop-in frame source for getImage(), it decodes the frames one after the
+ * other at the speed of the disk.
+ */
+class FramePlayer {
+	private:
+        int data_fd;
+        int index_fd;
+        const unsigned char *data;      ///<Mapping of the data file
+        size_t data_size;
+        const RIRecordHeader *header;   ///<Mapping of the index file
+        const RIFrameEntry *entries;    ///<Right after the header
+        size_t index_size;
+        uint32_t frames;
+        uint32_t position;              ///<Frame returned by the next call to next()
+        bool loop;
+
+        // Not copyable
+        FramePlayer(const FramePlayer &);
+        FramePlayer &operator=(const FramePlayer &);
+	public:
+        FramePlayer();
+        /**
+         * @brief A destructor, closes the recording.
+         */
+        ~FramePlayer();
+
+        /**
+         * @brief Map the recording path and its index path.idx.
+         */
+        int open(const char *path);
+        /**
+         * @brief Close the recording.
+         */
+        int close(void);
+        /**
+         * @brief Returns true if a recording is open.
+         */
+        bool isOpen(void);
+
+        /**
+         * @brief The number of frames in the recording.
+         */
+        uint32_t count(void);
+        /**
+         * @brief riTimestamp() when the recording was created.
+         */
+        uint64_t created(void);
+        /**
+         * @brief The size of the frames, read from the first one.
+         */
+        CvSize frameSize(void);
+
+        /**
+         * @brief The index entry of frame i, or NULL if there is no such frame.
+         */
+        const RIFrameEntry *entry(uint32_t i);
+        /**
+         * @brief The JPEG of frame i, straight from the mapping.
+         */
+        int jpeg(uint32_t i, const unsigned char **data, int *size);
+        /**
+         * @brief Decode frame i into image.
+         */
+        int frame(uint32_t i, IplImage *image);
+
+        /**
+         * @brief Make next() return frame i.
+         */
+        int seek(uint32_t i);
+        /**
+         * @brief Make next() return the first frame captured at least us microseconds after the first one.
+         */
+        int seekTime(uint64_t us);
+        /**
+         * @brief The frame next() returns.
+         */
+        uint32_t tell(void);
+        /**
+         * @brief Start over from the first frame after the last one instead of stopping.
+         */
+        void setLoop(bool loop);
+        /**
+         * @brief Decode the next frame into image, like RobotInterface::getImage().
+         */
+        int next(IplImage *image, const RIFrameEntry **entry = NULL);
+};
+
+#endif /* __RI_FRAME_RECORD_H__ */
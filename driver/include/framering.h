@@ -0,0 +1,197 @@
+/**
+ * @file framering.h
+ * @brief Decoded camera frames shared with other processes through POSIX shared memory
+ *
+ * One process talks to the robot, decodes each frame once and writes it into a ring of
+ * fixed size slots in a shared memory object. Any number of local processes map the object
+ * read only and use the latest frame in place, without a copy and without a request to the
+ * robot of their own.
+ *
+ * The writer never waits for the readers. Each slot is guarded by a sequence counter, odd
+ * while the writer fills the slot: a reader notes the counter, reads the frame and checks
+ * the counter did not move, which tells it whether the writer came back to the slot while
+ * it was reading. With N slots a reader has N - 1 frame periods to use a frame in place.
+ */
+
+#ifndef __RI_FRAME_RING_H__
+#define __RI_FRAME_RING_H__
+
+#include "robotdriver.h"
+
+/***************************************
+ * Shared memory layout
+ ***************************************/
+#define RI_SHM_MAGIC			0x474e4952  /* "RING" */
+#define RI_SHM_VERSION			1
+#define RI_SHM_DEFAULT_NAME		"/rovio-camera"
+#define RI_SHM_DEFAULT_SLOTS		4
+#define RI_SHM_MAX_NAME			64
+#define RI_SHM_ALIGN			64      /* Slots and images start on a cache line */
+#define RI_SHM_RETRIES			8       /* Attempts at a consistent read before giving up */
+
+/** @brief Start of the shared memory object, followed by the slots */
+typedef struct {
+    volatile uint32_t	magic; /* RI_SHM_MAGIC, written last once the ring is ready */
+    uint32_t		version; /* RI_SHM_VERSION */
+    uint32_t		slots; /* Number of slots */
+    uint32_t		slot_size; /* Bytes from a slot to the next one */
+    uint32_t		width; /* Largest frame a slot holds */
+    uint32_t		height;
+    uint32_t		channels;
+    uint32_t		image_offset; /* Start of the image in a slot */
+    uint64_t		created; /* riTimestamp() when the ring was created */
+    volatile uint64_t	written; /* Frames published, the latest is in slot (written - 1) % slots */
+    uint32_t		reserved[8];
+} RIShmHeader;
+
+/** @brief Description of the frame in a slot, the image follows at image_offset */
+typedef struct {
+    volatile uint32_t	seq; /* Odd while the writer fills the slot */
+    uint32_t		width;
+    uint32_t		height;
+    uint32_t		channels;
+    uint32_t		step; /* Bytes per image row */
+    uint32_t		reserved0;
+    uint64_t		number; /* Frame number, from 0 */
+    uint64_t		timestamp; /* riTimestamp() of the capture */
+    RIData		sensor; /* Sensor data cached when the frame was captured */
+    RIReport		report;
+} RIShmSlot;
+
+/** @brief A frame of the ring as a reader sees it */
+typedef struct {
+    IplImage		image; /* Header on the pixels in shared memory, read only */
+    uint64_t		number;
+    uint64_t		timestamp;
+    RIData		sensor;
+    RIReport		report;
+    const RIShmSlot	*slot;
+    uint32_t		seq; /* Counter of the slot when the frame was read */
+} RIShmFrame;
+
+/**
+ * @class FrameRingWriter
+ * @brief Publishes frames into a shared memory ring
+ *
+ * Only one process, and one thread in it, writes a ring. The frame can be decoded straight
+ * into its slot with begin() and commit(), or copied from an image with publish().
+ */
+class FrameRingWriter {
+	private:
+        char name[RI_SHM_MAX_NAME];
+        int fd;
+        RIShmHeader *header;
+        size_t size;                    ///<Size of the mapping
+        RIShmSlot *current;             ///<Slot between begin() and commit()
+        IplImage view;                  ///<Header on the image of current
+
+        RIShmSlot *slot(uint64_t i);
+
+        // Not copyable
+        FrameRingWriter(const FrameRingWriter &);
+        FrameRingWriter &operator=(const FrameRingWriter &);
+	public:
+        FrameRingWriter();
+        /**
+         * @brief A destructor, closes and removes the ring.
+         */
+        ~FrameRingWriter();
+
+        /**
+         * @brief Create the shared memory object name with slots frames of up to max_size and channels.
+         */
+        int create(const char *name, CvSize max_size, int channels, uint32_t slots = RI_SHM_DEFAULT_SLOTS);
+        /**
+         * @brief Unmap and remove the ring, the readers keep their mapping until they close it.
+         */
+        int close(void);
+        /**
+         * @brief Returns true if a ring was created.
+         */
+        bool isOpen(void);
+
+        /**
+         * @brief Start writing the next frame, returns an image on its slot to fill in place.
+         */
+        IplImage *begin(CvSize size, int channels);
+        /**
+         * @brief Publish the frame filled since begin().
+         */
+        int commit(uint64_t timestamp, const RIData *sensor, const RIReport *report);
+        /**
+         * @brief Give up the frame started with begin(), nothing is published.
+         */
+        void cancel(void);
+        /**
+         * @brief Copy an image into the next slot and publish it.
+         */
+        int publish(const IplImage *image, uint64_t timestamp, const RIData *sensor, const RIReport *report);
+        /**
+         * @brief The number of frames published.
+         */
+        uint64_t count(void);
+};
+
+/**
+ * @class FrameRingReader
+ * @brief Reads the latest frame of a shared memory ring
+ */
+class FrameRingReader {
+	private:
+        int fd;
+        const RIShmHeader *header;
+        size_t size;
+        uint32_t torn_count;            ///<Reads the writer overtook
+
+        const RIShmSlot *slot(uint64_t i);
+
+        // Not copyable
+        FrameRingReader(const FrameRingReader &);
+        FrameRingReader &operator=(const FrameRingReader &);
+	public:
+        FrameRingReader();
+        /**
+         * @brief A destructor, unmaps the ring.
+         */
+        ~FrameRingReader();
+
+        /**
+         * @brief Map the ring name read only.
+         */
+        int open(const char *name);
+        /**
+         * @brief Unmap the ring.
+         */
+        int close(void);
+        /**
+         * @brief Returns true if a ring is mapped.
+         */
+        bool isOpen(void);
+
+        /**
+         * @brief The number of frames the writer published.
+         */
+        uint64_t count(void);
+        /**
+         * @brief Wait until more than after frames were published, up to timeout_ms milliseconds.
+         */
+        int wait(uint64_t after, int timeout_ms);
+        /**
+         * @brief The latest frame, in place in shared memory.
+         */
+        int latest(RIShmFrame *frame);
+        /**
+         * @brief Returns true if the writer did not come back to the slot of frame since latest().
+         */
+        bool valid(const RIShmFrame *frame);
+        /**
+         * @brief Copy the latest frame into image, which must have its size and channels.
+         */
+        int copyLatest(IplImage *image, RIShmFrame *frame = NULL);
+        /**
+         * @brief The number of reads the writer overtook.
+         */
+        uint32_t torn(void);
+};
+
+#endif /* __RI_FRAME_RING_H__ */
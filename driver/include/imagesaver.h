@@ -0,0 +1,111 @@
+/**
+ * @file imagesaver.h
+ * @brief Asynchronous JPEG writer
+ *
+ * The camera already sends JPEG files, so saving a frame is only a matter of writing the
+ * bytes the robot sent. ImageSaver copies them into a bounded queue and writes them to a
+ * directory from its own thread, so the capture loop never waits on the disk. When the
+ * disk falls behind, the saver either drops the new frames or makes the caller wait.
+ */
+
+#ifndef __RI_IMAGE_SAVER_H__
+#define __RI_IMAGE_SAVER_H__
+
+#include "robotdriver.h"
+#include "ringbuffer.h"
+#include <pthread.h>
+#include <vector>
+
+/***************************************
+ * Saver description
+ ***************************************/
+#define RI_SAVE_DEFAULT_DIR		"Rovio-image"
+#define RI_SAVE_DEFAULT_DEPTH		8       /* Frames waiting to be written */
+#define RI_SAVE_MAX_PATH		256
+
+// What save() does when the queue is full
+#define RI_SAVE_DROP			0       ///<The frame is dropped and counted
+#define RI_SAVE_BLOCK			1       ///<The caller waits for a free slot
+
+/** @brief A frame waiting to be written */
+typedef struct {
+    uint32_t		number; /* The file is <number>.jpeg */
+    std::vector<unsigned char> jpeg; /* Reused from frame to frame, only grows */
+} RISaveSlot;
+
+/**
+ * @brief Write a JPEG file as <directory>/<number>.jpeg.
+ */
+int riWriteJpeg(const char *directory, uint32_t number, const unsigned char *jpeg, int size);
+
+/**
+ * @class ImageSaver
+ * @brief Writes JPEG frames in the background
+ *
+ * One thread calls save(), the writer thread is the only consumer of the queue.
+ */
+class ImageSaver {
+	private:
+        char directory[RI_SAVE_MAX_PATH];
+        int policy;
+        SpscRing<RISaveSlot> ring;      ///<Frames waiting to be written
+        pthread_mutex_t lock;           ///<Only for the waits, the ring needs no lock
+        pthread_cond_t queued;          ///<A frame was queued
+        pthread_cond_t freed;           ///<A slot was written
+        pthread_t thread;
+        volatile bool running;
+        volatile uint32_t drop_count;
+        volatile uint32_t write_count;
+        volatile uint32_t error_count;
+
+        static void *writerThread(void *arg);
+
+        // Not copyable
+        ImageSaver(const ImageSaver &);
+        ImageSaver &operator=(const ImageSaver &);
+	public:
+        /**
+         * @brief ImageSaver() Create a saver writing into directory, holding up to depth frames.
+         */
+        ImageSaver(const char *directory = RI_SAVE_DEFAULT_DIR, uint32_t depth = RI_SAVE_DEFAULT_DEPTH, int policy = RI_SAVE_DROP);
+        /**
+         * @brief A destructor, writes the frames still queued and stops the writer.
+         */
+        ~ImageSaver();
+
+        /**
+         * @brief Start the writer thread, creating the directory if needed.
+         */
+        int start(void);
+        /**
+         * @brief Write the frames still queued and stop the writer thread.
+         */
+        int stop(void);
+        /**
+         * @brief Returns true while the writer thread is running.
+         */
+        bool isRunning(void);
+
+        /**
+         * @brief Queue a JPEG to be written as <number>.jpeg.
+         */
+        int save(const unsigned char *jpeg, int size, uint32_t number);
+        /**
+         * @brief The number of frames waiting to be written.
+         */
+        uint32_t pending(void);
+        /**
+         * @brief The number of frames dropped because the queue was full.
+         */
+        uint32_t dropped(void);
+        /**
+         * @brief The number of frames written.
+         */
+        uint32_t written(void);
+        /**
+         * @brief The number of frames that could not be written.
+         */
+        uint32_t errors(void);
+};
+
+#endif /* __RI_IMAGE_SAVER_H__ */
@@ -5,6 +5,8 @@
   * Workaround for missing jpeg_mem_src
   * Adapted from the actual source for jpeg_mem_src in newer versions of libjpeg
   */
+#include <jerror.h>
+
 typedef struct {
 	struct jpeg_source_mgr pub;   /* public fields */
 
@@ -30,28 +32,14 @@ METHODDEF(void) jj_term_source(j_decompress_ptr cinfo) {
 }
 
 // Fill the input buffer
+// The whole JPEG is already in the buffer, running out means it is truncated
 METHODDEF(boolean) jj_fill_mem_input_buffer(j_decompress_ptr cinfo) {
-    jj_src_ptr src = (jj_src_ptr) cinfo->src;
-  	size_t nbytes;
-
-  	nbytes = JFREAD(src->infile, src->buffer, 4096);
-
-	// If we're out of data, let the user know
-  	if (nbytes <= 0) {
-		if (src->start_of_file) {     /* Treat empty input file as fatal error */
-			printf("Empty input file\n");
-			return FALSE;
-		}
-		printf("Premature end of JPEG file\n");
-    		/* Insert a fake EOI marker */
-    		src->buffer[0] = (JOCTET) 0xFF;
-		src->buffer[1] = (JOCTET) JPEG_EOI;
-		nbytes = 2;
-	}
+	static const JOCTET fake_eoi[2] = { (JOCTET) 0xFF, (JOCTET) JPEG_EOI };
 
-	src->pub.next_input_byte = src->buffer;
-	src->pub.bytes_in_buffer = nbytes;
-	src->start_of_file = FALSE;
+	WARNMS(cinfo, JWRN_JPEG_EOF);
+	/* Insert a fake EOI marker */
+	cinfo->src->next_input_byte = fake_eoi;
+	cinfo->src->bytes_in_buffer = 2;
 
 	return TRUE;
 }
@@ -0,0 +1,85 @@
+/**
+ * @file latency.h
+ * @brief Latency breakdown of the frames, from the camera request to the move based on them
+ *
+ * RobotInterface keeps an RITrace per captured frame. getJpeg() marks when the image was
+ * requested, when the first byte and the whole JPEG arrived, getImage() when it was decoded,
+ * findSquares() when the detection was done and move() when the command based on the frame
+ * was sent and answered. Steps done outside the driver, a TLD::processFrame() for example,
+ * are marked with traceMark(). LatencyStats collects the traces and keeps, for the time
+ * between each point and the previous one reached, the count, mean, extremes and a
+ * histogram for the percentiles, and for the whole trip from the request to the command.
+ */
+
+#ifndef __RI_LATENCY_H__
+#define __RI_LATENCY_H__
+
+#include "robotdriver.h"
+#include <pthread.h>
+#include <stdio.h>
+
+/***************************************
+ * Statistics description
+ ***************************************/
+#define RI_LAT_TOTAL			RI_TRACE_POINTS     /* Stage of the request to command time */
+#define RI_LAT_STAGES			(RI_TRACE_POINTS + 1)
+#define RI_LAT_BUCKETS			256     /* 1 ms histogram buckets, the last one holds the rest */
+#define RI_LAT_BUCKET_US		1000
+
+/** @brief The times of one stage, in microseconds */
+typedef struct {
+    uint32_t		count;
+    uint64_t		sum;
+    uint32_t		min;
+    uint32_t		max;
+    uint32_t		histogram[RI_LAT_BUCKETS];
+} RILatencyStage;
+
+/** @brief The name of a stage, the point it ends at or "total" */
+const char *riLatencyName(int stage);
+/** @brief The time under which a fraction p (0 to 1) of the times of a stage are, in microseconds */
+uint32_t riLatencyPercentile(const RILatencyStage *stage, double p);
+
+/**
+ * @class LatencyStats
+ * @brief Collects frame traces into per stage statistics
+ *
+ * Traces can be added from several threads, for example from the camera and the wheels
+ * connections, and the statistics read at any time.
+ */
+class LatencyStats {
+	private:
+        RILatencyStage stages[RI_LAT_STAGES];   ///<Indexed by the point a stage ends at
+        pthread_mutex_t lock;
+
+        void addTime(int stage, uint64_t us);
+
+        // Not copyable
+        LatencyStats(const LatencyStats &);
+        LatencyStats &operator=(const LatencyStats &);
+	public:
+        LatencyStats();
+        /**
+         * @brief A destructor.
+         */
+        ~LatencyStats();
+
+        /**
+         * @brief Add the stages a trace went through.
+         */
+        void add(const RITrace *trace);
+        /**
+         * @brief Forget all the traces.
+         */
+        void reset(void);
+        /**
+         * @brief Copy the statistics of a stage, RI_TRACE_FIRST_BYTE to RI_TRACE_ACKED or RI_LAT_TOTAL.
+         */
+        int get(int stage, RILatencyStage *out);
+        /**
+         * @brief Print the frames, mean, minimum, median, 95th percentile and maximum of every stage, in milliseconds.
+         */
+        void print(FILE *out);
+};
+
+#endif /* __RI_LATENCY_H__ */
@@ -0,0 +1,142 @@
+/**
+ * @file motion.h
+ * @brief Closed loop motion primitives on the wheel encoders
+ *
+ * move() only picks a direction and a speed for a short while, so driving a given distance
+ * or turning a given angle needs polling the encoders and guessing when to stop.
+ * MotionController runs a control loop on its own thread on top of the Odometry samples:
+ * driveDistance(), turnAngle() and driveArc() start a motion, the loop drives towards the
+ * target, slows down close to it and stops on it, and wait() blocks until the motion is
+ * over and gives how far off it ended. The command of a running motion is sent at every
+ * step (see RI_MOVE_PULSE_US).
+ */
+
+#ifndef __RI_MOTION_H__
+#define __RI_MOTION_H__
+
+#include "robotdriver.h"
+#include "odometry.h"
+#include <pthread.h>
+
+/***************************************
+ * Motion description
+ ***************************************/
+#define RI_MOTION_DEFAULT_RATE		20      /* Control steps per second, at most the odometry rate */
+#define RI_MOTION_DIST_TOLERANCE	1.0     /* cm */
+#define RI_MOTION_ANGLE_TOLERANCE	3.0     /* Degrees */
+#define RI_MOTION_SLOW_CM		10.0    /* Distance left under which the speed ramps down */
+#define RI_MOTION_SLOW_DEG		30.0    /* Angle left under which the speed ramps down */
+#define RI_MOTION_STALL_US		1000000 /* Microseconds without progress before giving up */
+
+// Motion types
+#define RI_MOTION_NONE			0
+#define RI_MOTION_DRIVE			1       ///<Straight line, forward or backward
+#define RI_MOTION_TURN			2       ///<In place
+#define RI_MOTION_ARC			3       ///<Forward along a circle
+
+// Motion states
+#define RI_MOTION_IDLE			0       ///<No motion was started
+#define RI_MOTION_RUNNING		1
+#define RI_MOTION_DONE			2       ///<Stopped within the tolerance of the target
+#define RI_MOTION_MISSED		3       ///<Stopped past the tolerance, it overshot
+#define RI_MOTION_STALLED		4       ///<No progress for RI_MOTION_STALL_US, or the odometry stopped
+#define RI_MOTION_CANCELED		5
+
+/** @brief A motion and how it went */
+typedef struct {
+    int			type; /* RI_MOTION_DRIVE, RI_MOTION_TURN or RI_MOTION_ARC */
+    int			state; /* RI_MOTION_* state */
+    double		target; /* cm for a drive, degrees for a turn or an arc */
+    double		progress; /* Done so far, same unit */
+    double		error; /* target - progress, same unit */
+    double		distance; /* Path length driven, cm */
+    uint64_t		started; /* riTimestamp() of the start */
+    uint64_t		finished; /* riTimestamp() it ended, 0 while running */
+    uint32_t		commands; /* Moves sent */
+} RIMotion;
+
+/**
+ * @class MotionController
+ * @brief Drives distances, angles and arcs from the encoder feedback
+ *
+ * One motion runs at a time. The controller drives through the given robot, nothing else
+ * may move it while a motion runs.
+ */
+class MotionController {
+	private:
+        RobotInterface *robot;          ///<Sends the moves
+        Odometry *odometry;
+        int rate;
+        pthread_mutex_t lock;           ///<Guards the motion
+        pthread_cond_t finished;        ///<Signaled when a motion ends
+        RIMotion motion;
+        double radius;                  ///<Of an arc, cm
+        int speed;                      ///<Requested speed, RI_FASTEST to RI_SLOWEST
+        uint32_t generation;            ///<Motions started, tells the thread a new one began
+        volatile bool cancel_request;
+        pthread_t thread;
+        volatile bool running;
+
+        static void *motionThread(void *arg);
+        int begin(int type, double target, double radius, int speed);
+        void end(int state);
+        int rampSpeed(double left, double slow);
+
+        // Not copyable
+        MotionController(const MotionController &);
+        MotionController &operator=(const MotionController &);
+	public:
+        /**
+         * @brief MotionController() Create a controller on top of a running odometry of the robot.
+         */
+        MotionController(RobotInterface *robot, Odometry *odometry, int rate = RI_MOTION_DEFAULT_RATE);
+        /**
+         * @brief A destructor, stops the control thread.
+         */
+        ~MotionController();
+
+        /**
+         * @brief Start the control thread.
+         */
+        int start(void);
+        /**
+         * @brief Stop the control thread, a running motion is canceled.
+         */
+        int stop(void);
+        /**
+         * @brief Returns true while the control thread is running.
+         */
+        bool isRunning(void);
+
+        /**
+         * @brief Drive straight for cm centimeters, backward if negative.
+         */
+        int driveDistance(double cm, int speed = RI_FASTEST);
+        /**
+         * @brief Turn in place by deg degrees, counter-clockwise if positive.
+         */
+        int turnAngle(double deg, int speed = RI_FASTEST);
+        /**
+         * @brief Drive forward along a circle of radius_cm until the heading changed by deg degrees, to the left if positive.
+         */
+        int driveArc(double radius_cm, double deg, int speed = RI_FASTEST);
+        /**
+         * @brief Stop the running motion.
+         */
+        void cancel(void);
+
+        /**
+         * @brief Wait for the motion to end, at most timeout_ms (0 forever), and copy it.
+         */
+        int wait(RIMotion *result, uint32_t timeout_ms = 0);
+        /**
+         * @brief Copy the current or last motion without waiting.
+         */
+        void get(RIMotion *result);
+        /**
+         * @brief Returns true while a motion runs.
+         */
+        bool isBusy(void);
+};
+
+#endif /* __RI_MOTION_H__ */
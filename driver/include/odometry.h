@@ -0,0 +1,157 @@
+/**
+ * @file odometry.h
+ * @brief High rate wheel odometry of the Rovio
+ *
+ * The Odometry class polls the MCU report on its own connection and thread at a fixed rate,
+ * integrates the signed ticks of the three omni wheels into a planar pose and publishes a
+ * timestamped sample per poll, both through a lock-free ring (every sample, one reader) and
+ * as a latest value that any thread can read. The last polls are also kept with their
+ * sensor data, so the odometry and the IR state can be found for any recent instant.
+ */
+
+#ifndef __RI_ODOMETRY_H__
+#define __RI_ODOMETRY_H__
+
+#include "robotdriver.h"
+#include "ringbuffer.h"
+#include <pthread.h>
+
+/***************************************
+ * Odometry description
+ ***************************************/
+#define RI_ODO_DEFAULT_RATE		20      /* Polls per second */
+#define RI_ODO_DEFAULT_SAMPLES		256     /* Samples buffered in the ring */
+#define RI_ODO_HISTORY			64      /* Latest polls kept for bracket() */
+// Longest extrapolation of a sample with its velocities, in microseconds
+#define RI_ODO_MAX_EXTRAPOLATE		500000
+// Four ticks of an encoder is about 1cm
+#define RI_ODO_TICKS_PER_CM		4.0
+// Distance from the center of the robot to the wheels
+#define RI_ODO_WHEEL_BASE_CM		12.0
+
+/**
+ * @brief An odometry sample
+ *
+ * The pose is relative to where the odometry was started or last reset: x points forward,
+ * y to the left and theta is counter-clockwise, in -PI to PI.
+ */
+typedef struct {
+    uint64_t		timestamp; /* riTimestamp() in the middle of the MCU request */
+    uint32_t		sequence; /* Poll number, gaps mean failed polls */
+    int32_t		left_ticks; /* Signed ticks of this poll */
+    int32_t		right_ticks;
+    int32_t		rear_ticks;
+    int64_t		left_total; /* Signed ticks since start or reset */
+    int64_t		right_total;
+    int64_t		rear_total;
+    double		x, y; /* Position in cm */
+    double		theta; /* Heading in radians */
+    float		vx, vy; /* Velocity in the robot frame, cm/s */
+    float		omega; /* Turn rate, rad/s */
+} RIOdometrySample;
+
+/** @brief A poll of the MCU, its sensor data and the odometry integrated up to it */
+typedef struct {
+    RIOdometrySample	odometry;
+    RIData		sensor;
+} RISensorSample;
+
+/** @brief Wrap an angle into -PI to PI */
+double riWrapAngle(double a);
+/**
+ * @brief The odometry at a time between two samples, or extrapolated from the nearest one.
+ */
+void riOdometryInterpolate(const RIOdometrySample *before, const RIOdometrySample *after, uint64_t at, RIOdometrySample *out);
+
+/**
+ * @class Odometry
+ * @brief Integrates the wheel encoders in the background
+ */
+class Odometry {
+	private:
+        RobotIfType conn;                       ///<Private connection to the robot
+        SpscRing<RIOdometrySample> ring;        ///<Every sample, for one reader
+        RIOdometrySample last_sample;           ///<Latest sample, guarded by last_seq
+        volatile uint32_t last_seq;             ///<Odd while last_sample is being written
+        RISensorSample history[RI_ODO_HISTORY]; ///<Latest polls, oldest overwritten
+        uint32_t history_count;                 ///<Polls stored, slot = count % RI_ODO_HISTORY
+        pthread_mutex_t history_lock;
+        pthread_t thread;
+        volatile bool running;
+        volatile bool reset_request;
+        int rate;
+        double ticks_per_cm;
+        double wheel_base;
+        volatile uint32_t overrun_count;
+        volatile uint32_t error_count;
+        volatile uint32_t drop_count;
+
+        static void *odometryThread(void *arg);
+        void integrate(RIOdometrySample *s, uint64_t timestamp);
+
+        // Not copyable
+        Odometry(const Odometry &);
+        Odometry &operator=(const Odometry &);
+	public:
+        /**
+         * @brief Odometry() Create an odometry polling the robot rate times per second.
+         */
+        Odometry(RobotInterface *robot, int rate = RI_ODO_DEFAULT_RATE, uint32_t samples = RI_ODO_DEFAULT_SAMPLES);
+        /**
+         * @brief A destructor, stops the odometry.
+         */
+        ~Odometry();
+
+        /**
+         * @brief Calibration, set the encoder scale and the wheel base, call before start().
+         */
+        void setGeometry(double ticks_per_cm, double wheel_base_cm);
+        /**
+         * @brief Start the polling thread.
+         */
+        int start(void);
+        /**
+         * @brief Stop the polling thread.
+         */
+        int stop(void);
+        /**
+         * @brief Returns true while the polling thread is running.
+         */
+        bool isRunning(void);
+        /**
+         * @brief Set the pose and the tick totals back to zero at the next poll.
+         */
+        void reset(void);
+
+        /**
+         * @brief Reader, copy the oldest sample out of the ring, returns false if none is waiting.
+         */
+        bool read(RIOdometrySample *sample);
+        /**
+         * @brief Any thread, copy the latest sample, returns false before the first poll.
+         */
+        bool latest(RIOdometrySample *sample);
+        /**
+         * @brief Any thread, copy the polls just before and after a time, with their sensor data.
+         */
+        int bracket(uint64_t at, RISensorSample *before, RISensorSample *after);
+        /**
+         * @brief Any thread, the odometry at a time, interpolated between the polls around it.
+         */
+        int sampleAt(uint64_t at, RIOdometrySample *sample);
+
+        /**
+         * @brief The number of polls that did not fit in their period.
+         */
+        uint32_t overruns(void);
+        /**
+         * @brief The number of failed polls.
+         */
+        uint32_t errors(void);
+        /**
+         * @brief The number of samples dropped because the ring reader fell behind.
+         */
+        uint32_t dropped(void);
+};
+
+#endif /* __RI_ODOMETRY_H__ */
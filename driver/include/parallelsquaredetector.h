@@ -0,0 +1,107 @@
+/**
+ * @file parallelsquaredetector.h
+ * @brief Square detection split over several cores
+ *
+ * ParallelSquareDetector cuts the frame into overlapping horizontal bands and runs the
+ * SquareDetector pipeline on each of them on a pool of worker threads. Every band reports
+ * the squares whose center lies in its own rows. A band that saw a contour big enough to be
+ * a square come close to one of its cut edges cannot be trusted on that side, so the two
+ * bands sharing that edge are merged and processed again, until no edge is in doubt. The
+ * squares are then the ones SquareDetector::find() returns on the whole frame.
+ */
+
+#ifndef __RI_PARALLEL_SQUARE_DETECTOR_H__
+#define __RI_PARALLEL_SQUARE_DETECTOR_H__
+
+#include "squaredetector.h"
+#include <pthread.h>
+#include <vector>
+
+/***************************************
+ * Band layout
+ ***************************************/
+// Rows a band reads past its own rows on each side, a multiple of 4 to keep the pyramid aligned
+#define RI_PSQ_HALO			32
+// A contour this close to a cut edge may differ from the full frame one, the blur, Canny and dilation reach 16 rows
+#define RI_PSQ_GUARD			20
+
+/** @brief Consecutive bands processed as one */
+typedef struct {
+    int			first, last; /* Bands covered */
+    int			cut; /* RI_SQ_CUT_* flags of the last run */
+    bool		done; /* squares is up to date */
+    std::vector<RISquare> squares; /* Squares centered in the bands */
+} RISquareGroup;
+
+/**
+ * @class ParallelSquareDetector
+ * @brief Finds the squares in 1 plane images on several threads
+ *
+ * The worker threads and their SquareDetector are created once and wait between frames, the
+ * calling thread takes part in the work. The squares are sorted by riSquareLess(), so the
+ * same frame always gives the same vector whatever the number of threads.
+ */
+class ParallelSquareDetector {
+	private:
+        int nthreads;
+        int nbands;
+        SquareDetector *detectors;      ///<One per thread, the first one for the caller
+        pthread_t *threads;
+        pthread_mutex_t lock;           ///<Guards the fields below up to next_task
+        pthread_cond_t work_cond;       ///<A round of tasks is ready
+        pthread_cond_t done_cond;       ///<A task or a worker finished
+        uint32_t generation;            ///<Round number
+        int active;                     ///<Workers in the current round
+        int finished;                   ///<Tasks of the current round done
+        bool open;                      ///<Workers may still join the current round
+        bool quit;
+        volatile int next_task;         ///<Next task to take, atomic
+        const IplImage *image;          ///<Frame and threshold being processed
+        int threshold;
+        std::vector<int> cuts;          ///<First row of each band, then the image height
+        std::vector<RISquareGroup> groups;
+        std::vector<int> tasks;         ///<Groups to process this round
+        std::vector<RISquare> squares;  ///<Result of the last call
+        uint32_t merge_count;
+
+        static void *workerThread(void *arg);
+        void runTasks(SquareDetector *detector);
+        void runRound(void);
+        void layout(int height);
+
+        // Not copyable
+        ParallelSquareDetector(const ParallelSquareDetector &);
+        ParallelSquareDetector &operator=(const ParallelSquareDetector &);
+	public:
+        /**
+         * @brief ParallelSquareDetector() Create a detector on thread_count threads, 0 for one per online core.
+         */
+        ParallelSquareDetector(int thread_count = 0, int bands = 0);
+        /**
+         * @brief A destructor, stops the worker threads.
+         */
+        ~ParallelSquareDetector();
+
+        /**
+         * @brief Takes a 1 plane image and returns the squares in it.
+         */
+        const std::vector<RISquare> &find(const IplImage *img, int threshold);
+        /**
+         * @brief The squares found by the last call to find().
+         */
+        const std::vector<RISquare> &result(void) const;
+        /**
+         * @brief The biggest square of the last call to find(), or NULL if there was none.
+         */
+        const RISquare *biggest(void) const;
+        /**
+         * @brief The number of threads working on a frame, the caller included.
+         */
+        int threadCount(void) const;
+        /**
+         * @brief The number of band edges the last call to find() had to merge.
+         */
+        uint32_t merges(void) const;
+};
+
+#endif /* __RI_PARALLEL_SQUARE_DETECTOR_H__ */
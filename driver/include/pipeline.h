@@ -0,0 +1,194 @@
+/**
+ * @file pipeline.h
+ * @brief Vision pipeline of stages running on their own threads
+ *
+ * A Pipeline is a tree of stages. A source stage (capture) fills frames taken from a fixed
+ * pool, every other stage takes the frames of one upstream stage from a bounded lock-free
+ * queue, works on them and hands them on to the stages connected to it. Each stage runs on
+ * its own thread, so capturing the next frame, detecting in the current one and showing
+ * the last one overlap. Frames are reference counted and shared, never copied: a frame
+ * sent to two stages is the same frame, back in the pool once both are done with it.
+ *
+ * What a stage does when the queue of the next one is full is set per connection: wait
+ * for room or drop the frame. A connection can also be a one frame mailbox instead of a
+ * queue, a new frame replaces the waiting one and the next stage only ever takes the
+ * newest. Every
+ * stage counts its frames, drops, errors and busy time and reports its queue depth.
+ */
+
+#ifndef __RI_PIPELINE_H__
+#define __RI_PIPELINE_H__
+
+#include "robotdriver.h"
+#include "squaredetector.h"
+#include "ringbuffer.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <vector>
+
+/***************************************
+ * Pipeline description
+ ***************************************/
+#define RI_PIPE_DEFAULT_FRAMES		8       /* Frames in the pool, all stages together */
+#define RI_PIPE_DEFAULT_DEPTH		2       /* Frames waiting in front of a stage */
+#define RI_PIPE_MAX_NAME		32
+
+// What a stage does when the queue of the next one is full
+#define RI_PIPE_BLOCK			0       ///<Wait for room, the whole pipeline slows down to the slowest stage
+#define RI_PIPE_DROP			1       ///<Drop the frame for that stage and count it
+#define RI_PIPE_LATEST			2       ///<One frame mailbox, a new frame replaces the one waiting so the stage always takes the newest
+
+// Returned by a stage function that keeps the frame from the next stages
+#define RI_PIPE_SKIP			100
+
+class Pipeline;
+
+/**
+ * @brief A frame going through the pipeline
+ *
+ * The frames and their buffers are reused, a source stage finds the buffers of an earlier
+ * frame and only reallocates them if the size changed. Once a frame was handed to several
+ * stages they must treat the fields the others read as read only.
+ */
+typedef struct {
+    volatile int	refs; /* Holders of the frame, it returns to the pool at 0 */
+    Pipeline		*pipeline;
+    uint32_t		number; /* Frame of its source, from 0 */
+    uint64_t		timestamp; /* riTimestamp() when the source got the frame, the source may set a better one */
+    std::vector<unsigned char> jpeg; /* Compressed frame, if the source has one */
+    IplImage		*image; /* Decoded BGR frame */
+    IplImage		*mask; /* 1 plane work image, a threshold for example */
+    std::vector<RISquare> squares; /* Detections */
+    RIData		sensor; /* Sensor data cached when the frame was captured */
+    RIReport		report;
+    RITrace		trace; /* Latency trace, from RobotInterface::getTrace() */
+    void		*user; /* Free for the application, cleared with the frame */
+} RIFrame;
+
+/**
+ * @brief The work of a stage on a frame.
+ * @return RI_RESP_SUCCESS to hand the frame on, RI_PIPE_SKIP to keep it from the next stages, anything else is counted as an error.
+ */
+typedef int (*RIStageFunc)(RIFrame *frame, void *arg);
+
+/** @brief The counters of a stage */
+typedef struct {
+    const char		*name;
+    uint64_t		frames; /* Frames processed */
+    uint64_t		skipped; /* Frames the stage returned RI_PIPE_SKIP for */
+    uint64_t		errors; /* Frames the stage failed on */
+    uint64_t		dropped; /* Frames dropped in front of the stage */
+    uint64_t		busy; /* Microseconds spent in the stage function */
+    uint32_t		depth; /* Frames waiting in front of the stage now */
+    uint32_t		max_depth; /* Most frames that waited */
+    uint32_t		capacity; /* Size of the queue */
+} RIStageStats;
+
+/** @brief Reallocate an image of a frame if it is missing or of another size */
+IplImage *riFrameImage(IplImage **image, CvSize size, int channels);
+/** @brief Take one more reference to a frame, for a stage keeping it past its call */
+void riFrameRetain(RIFrame *frame);
+/** @brief Give a reference back, the frame returns to the pool with the last one */
+void riFrameRelease(RIFrame *frame);
+
+/** @brief A stage and its input queue */
+typedef struct {
+    char		name[RI_PIPE_MAX_NAME];
+    RIStageFunc		func;
+    void		*arg;
+    int			input; /* Upstream stage, -1 for a source */
+    int			policy; /* RI_PIPE_* of the connection from the upstream stage */
+    SpscRing<RIFrame *> *queue; /* NULL for a source and a RI_PIPE_LATEST stage */
+    RIFrame		*latest; /* Mailbox of a RI_PIPE_LATEST stage, under lock */
+    std::vector<int>	outputs; /* Downstream stages */
+    Pipeline		*pipeline;
+    pthread_t		thread;
+    pthread_mutex_t	lock; /* For the waits and the mailbox, the queue needs no lock */
+    pthread_cond_t	changed; /* A frame was queued or taken */
+    volatile uint64_t	frames;
+    volatile uint64_t	skipped;
+    volatile uint64_t	errors;
+    volatile uint64_t	dropped;
+    volatile uint64_t	busy;
+    volatile uint32_t	max_depth;
+} RIPipeStage;
+
+/**
+ * @class Pipeline
+ * @brief Runs stages connected by bounded queues, one thread per stage
+ *
+ * Build the tree with addSource() and addStage(), then start() it. The stages can't be
+ * changed while it runs.
+ */
+class Pipeline {
+	private:
+        std::vector<RIPipeStage *> stages;
+        std::vector<RIFrame *> frames;  ///<All the frames of the pool
+        std::vector<RIFrame *> free_frames;
+        pthread_mutex_t pool_lock;
+        pthread_cond_t pool_freed;
+        volatile bool running;
+        uint64_t started;               ///<riTimestamp() of start()
+        uint64_t ended;                 ///<riTimestamp() of stop()
+
+        static void *stageThread(void *arg);
+        RIFrame *acquire(RIPipeStage *stage);
+        RIFrame *take(RIPipeStage *stage);
+        void forward(RIPipeStage *stage, RIFrame *frame);
+        void drain(RIPipeStage *stage);
+        int add(const char *name, int input, RIStageFunc func, void *arg, uint32_t depth, int policy);
+
+        // Not copyable
+        Pipeline(const Pipeline &);
+        Pipeline &operator=(const Pipeline &);
+	public:
+        /**
+         * @brief Pipeline() Create a pipeline with a pool of frame_count frames.
+         */
+        Pipeline(uint32_t frame_count = RI_PIPE_DEFAULT_FRAMES);
+        /**
+         * @brief A destructor, stops the stages and frees the frames.
+         */
+        ~Pipeline();
+
+        /**
+         * @brief Add a source stage, func fills a frame from the pool, returns the stage number.
+         */
+        int addSource(const char *name, RIStageFunc func, void *arg);
+        /**
+         * @brief Add a stage taking the frames of stage input, returns the stage number.
+         */
+        int addStage(const char *name, int input, RIStageFunc func, void *arg, uint32_t depth = RI_PIPE_DEFAULT_DEPTH, int policy = RI_PIPE_BLOCK);
+
+        /**
+         * @brief Start a thread per stage.
+         */
+        int start(void);
+        /**
+         * @brief Stop and join the stages, the frames still queued are dropped.
+         */
+        int stop(void);
+        /**
+         * @brief Returns true while the stages are running.
+         */
+        bool isRunning(void);
+
+        /**
+         * @brief Give a frame back to the pool, use riFrameRelease().
+         */
+        void recycle(RIFrame *frame);
+        /**
+         * @brief The number of stages.
+         */
+        int stageCount(void);
+        /**
+         * @brief Copy the counters of a stage.
+         */
+        int getStats(int stage, RIStageStats *stats);
+        /**
+         * @brief Print the throughput, load and queue depth of every stage.
+         */
+        void printStats(FILE *out);
+};
+
+#endif /* __RI_PIPELINE_H__ */
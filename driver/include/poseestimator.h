@@ -0,0 +1,112 @@
+/**
+ * @file poseestimator.h
+ * @brief Pose of the robot fused from the wheel odometry and the North Star fixes
+ *
+ * The wheel odometry is fast and smooth but drifts, the North Star fixes are absolute but
+ * slow, noisy and lost when the beacon signal drops. PoseEstimator keeps the transform
+ * from the odometry frame to the North Star frame and corrects it with every fix,
+ * weighted by the signal strength, so a controller can ask for the pose at the current
+ * instant at any time without a round trip to the robot.
+ */
+
+#ifndef __RI_POSE_ESTIMATOR_H__
+#define __RI_POSE_ESTIMATOR_H__
+
+#include "robotdriver.h"
+#include "odometry.h"
+#include <pthread.h>
+
+/***************************************
+ * Pose estimate description
+ ***************************************/
+#define RI_POSE_DEFAULT_FIX_RATE	5       /* North Star polls per second */
+// One cm is equivalent to about 45 North Star ticks
+#define RI_POSE_NS_TICKS_PER_CM		45.0
+// How far a fix pulls the estimate towards itself, per signal level
+#define RI_POSE_GAIN_STRONG		0.5
+#define RI_POSE_GAIN_MID		0.25
+#define RI_POSE_GAIN_WEAK		0.1
+
+/** @brief A pose estimate, in the North Star frame once the first fix arrived */
+typedef struct {
+    uint64_t		timestamp; /* riTimestamp() the pose was predicted for */
+    double		x, y; /* Position in cm */
+    double		theta; /* Heading in radians, -PI to PI */
+    float		vx, vy; /* Velocity in the estimate frame, cm/s */
+    float		omega; /* Turn rate, rad/s */
+    int			room_id; /* Room of the last fix, -1 before the first fix */
+    int			nav_signal; /* RI_ROBOT_NAV_SIGNAL_* of the last fix */
+    uint64_t		last_fix; /* riTimestamp() of the last fix used, 0 if none */
+} RIPose;
+
+/**
+ * @class PoseEstimator
+ * @brief Fuses the Odometry samples with the North Star fixes
+ *
+ * Fixes are either polled by the estimator's own thread (start()) or fed with addFix()
+ * from reports the application already fetched. predict() can be called from any thread.
+ */
+class PoseEstimator {
+	private:
+        RobotIfType conn;               ///<Private connection for the North Star polls
+        Odometry *odometry;
+        pthread_mutex_t lock;           ///<Guards the fields below
+        double off_x, off_y, off_theta; ///<Odometry frame to North Star frame
+        int room_id;
+        int nav_signal;
+        uint64_t last_fix;
+        RIReport last_report;           ///<Last report given to addFix()
+        uint64_t last_report_time;
+        double ns_scale;
+        pthread_t thread;
+        volatile bool running;
+        int rate;
+
+        static void *fixThread(void *arg);
+        bool odometryAt(uint64_t at, RIOdometrySample *s);
+
+        // Not copyable
+        PoseEstimator(const PoseEstimator &);
+        PoseEstimator &operator=(const PoseEstimator &);
+	public:
+        /**
+         * @brief PoseEstimator() Create an estimator on top of a running odometry.
+         */
+        PoseEstimator(RobotInterface *robot, Odometry *odometry, int fix_rate = RI_POSE_DEFAULT_FIX_RATE);
+        /**
+         * @brief A destructor, stops the fix thread.
+         */
+        ~PoseEstimator();
+
+        /**
+         * @brief Calibration, North Star ticks per cm, RI_POSE_NS_TICKS_PER_CM by default.
+         */
+        void setNorthStarScale(double ticks_per_cm);
+        /**
+         * @brief Start polling the North Star fixes in the background.
+         */
+        int start(void);
+        /**
+         * @brief Stop polling the North Star fixes.
+         */
+        int stop(void);
+
+        /**
+         * @brief Correct the estimate with a North Star report taken at the given time.
+         */
+        int addFix(const RIReport *report, uint64_t timestamp);
+        /**
+         * @brief The pose predicted for the given instant, 0 meaning now.
+         */
+        int predict(RIPose *pose, uint64_t at = 0);
+        /**
+         * @brief Copy the last North Star report, returns when it was taken.
+         */
+        uint64_t lastReport(RIReport *report);
+        /**
+         * @brief Returns true once a North Star fix has been used.
+         */
+        bool isLocalized(void);
+};
+
+#endif /* __RI_POSE_ESTIMATOR_H__ */
@@ -0,0 +1,116 @@
+/**
+ * @file preview.h
+ * @brief Display of annotated frames on a thread of its own
+ *
+ * cvShowImage() and cvWaitKey() in the processing loop cost the time to render and the
+ * whole wait on every frame. PreviewDisplay takes the frames through a mailbox per window
+ * that only keeps the latest one, and a render thread shows them at a capped rate: the
+ * processing loop only pays for a copy, and a frame posted before the last one was shown
+ * simply replaces it. In headless mode nothing is copied nor shown at all, so the same
+ * program runs at the same speed with or without a screen.
+ */
+
+#ifndef __RI_PREVIEW_H__
+#define __RI_PREVIEW_H__
+
+#include "robotdriver.h"
+#include <pthread.h>
+
+/***************************************
+ * Preview description
+ ***************************************/
+#define RI_PREVIEW_DEFAULT_FPS		15
+#define RI_PREVIEW_MAX_WINDOWS		8
+#define RI_PREVIEW_MAX_NAME		64
+
+/** @brief A window and its mailbox */
+typedef struct {
+    char		name[RI_PREVIEW_MAX_NAME];
+    IplImage		*back; /* Filled by show(), only touched by the posting thread */
+    IplImage		*pending; /* Latest frame posted, waiting to be shown */
+    IplImage		*shown; /* Only touched by the render thread */
+    bool		fresh; /* pending holds a frame not shown yet */
+    volatile uint32_t	posted; /* Frames given to show() */
+    volatile uint32_t	replaced; /* Frames replaced by a newer one before they were shown */
+    volatile uint32_t	rendered; /* Frames shown */
+} RIPreviewWindow;
+
+/**
+ * @class PreviewDisplay
+ * @brief Shows frames from a render thread, the latest frame of each window wins
+ *
+ * Once started, the render thread is the only one that talks to HighGUI. Each window takes
+ * frames from one thread at a time.
+ */
+class PreviewDisplay {
+	private:
+        RIPreviewWindow windows[RI_PREVIEW_MAX_WINDOWS];
+        int window_count;
+        int period_ms;                  ///<Shortest time between two renders
+        bool headless;
+        pthread_mutex_t lock;           ///<Guards the pending frames of the mailboxes
+        pthread_t thread;
+        volatile bool running;
+        volatile int last_key;          ///<Last key pressed in a window, -1 if none
+
+        static void *renderThread(void *arg);
+        void render(void);
+
+        // Not copyable
+        PreviewDisplay(const PreviewDisplay &);
+        PreviewDisplay &operator=(const PreviewDisplay &);
+	public:
+        /**
+         * @brief PreviewDisplay() Create a display rendering at most fps frames per second, or a headless one.
+         */
+        PreviewDisplay(int fps = RI_PREVIEW_DEFAULT_FPS, bool headless = false);
+        /**
+         * @brief A destructor, stops the render thread and frees the frames.
+         */
+        ~PreviewDisplay();
+
+        /**
+         * @brief Add a window before start(), returns its number.
+         */
+        int addWindow(const char *name);
+        /**
+         * @brief Start the render thread, it creates the windows.
+         */
+        int start(void);
+        /**
+         * @brief Stop the render thread and close the windows.
+         */
+        int stop(void);
+        /**
+         * @brief Returns true while the display is started.
+         */
+        bool isRunning(void);
+        /**
+         * @brief Returns true if frames are dropped instead of shown.
+         */
+        bool isHeadless(void);
+
+        /**
+         * @brief Post a frame to a window, it replaces the frame waiting there if any.
+         */
+        int show(int window, const IplImage *image);
+        /**
+         * @brief The last key pressed in a window, -1 if none was since the last call.
+         */
+        int key(void);
+
+        /**
+         * @brief The number of frames posted to a window.
+         */
+        uint32_t posted(int window);
+        /**
+         * @brief The number of frames of a window replaced before they were shown.
+         */
+        uint32_t replaced(int window);
+        /**
+         * @brief The number of frames of a window shown.
+         */
+        uint32_t rendered(int window);
+};
+
+#endif /* __RI_PREVIEW_H__ */
@@ -0,0 +1,128 @@
+/**
+ * @file ringbuffer.h
+ * @brief Lock-free single producer / single consumer ring buffer
+ *
+ * One thread writes, one thread reads, neither of them ever blocks or takes a lock. The
+ * producer and the consumer can either copy elements with push()/pop() or work in place
+ * on the slots with the claim/publish and front/release pairs, which avoids copying
+ * large elements such as audio blocks or frames.
+ */
+
+#ifndef __RI_RING_BUFFER_H__
+#define __RI_RING_BUFFER_H__
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Keep the producer and the consumer indexes on separate cache lines
+#define RI_CACHE_LINE			64
+
+/**
+ * @class SpscRing
+ * @brief A bounded lock-free ring buffer for exactly one producer and one consumer thread
+ *
+ * The capacity is rounded up to a power of two. The slots are allocated once in the
+ * constructor, so pushing and popping never allocate.
+ */
+template <typename T>
+class SpscRing {
+	private:
+        T *slots;                   ///<The element storage
+        uint32_t mask;              ///<capacity - 1
+        char pad0[RI_CACHE_LINE];
+        volatile uint32_t head;     ///<Next slot to write, only written by the producer
+        char pad1[RI_CACHE_LINE];
+        volatile uint32_t tail;     ///<Next slot to read, only written by the consumer
+        char pad2[RI_CACHE_LINE];
+
+        // Not copyable
+        SpscRing(const SpscRing &);
+        SpscRing &operator=(const SpscRing &);
+
+	public:
+        /**
+         * @brief SpscRing() Create a ring that holds at least capacity elements.
+         */
+        SpscRing(uint32_t capacity) : head(0), tail(0) {
+            uint32_t size = 2;
+            while(size < capacity)
+                size <<= 1;
+            slots = new T[size];
+            mask = size - 1;
+        }
+        /**
+         * @brief A destructor.
+         */
+        ~SpscRing() {
+            delete[] slots;
+        }
+
+        /**
+         * @brief Producer, returns the next free slot to fill in place, or NULL if the ring is full.
+         */
+        T *claim(void) {
+            uint32_t h = head;
+            if(h - __atomic_load_n(&tail, __ATOMIC_ACQUIRE) > mask)
+                return NULL;
+            return &slots[h & mask];
+        }
+        /**
+         * @brief Producer, makes the slot returned by claim() visible to the consumer.
+         */
+        void publish(void) {
+            __atomic_store_n(&head, head + 1, __ATOMIC_RELEASE);
+        }
+        /**
+         * @brief Producer, copies an element into the ring, returns false if the ring is full.
+         */
+        bool push(const T &value) {
+            T *slot = claim();
+            if(slot == NULL)
+                return false;
+            *slot = value;
+            publish();
+            return true;
+        }
+
+        /**
+         * @brief Consumer, returns the oldest element in place, or NULL if the ring is empty.
+         */
+        T *front(void) {
+            uint32_t t = tail;
+            if(__atomic_load_n(&head, __ATOMIC_ACQUIRE) == t)
+                return NULL;
+            return &slots[t & mask];
+        }
+        /**
+         * @brief Consumer, hands the slot returned by front() back to the producer.
+         */
+        void release(void) {
+            __atomic_store_n(&tail, tail + 1, __ATOMIC_RELEASE);
+        }
+        /**
+         * @brief Consumer, copies the oldest element out of the ring, returns false if the ring is empty.
+         */
+        bool pop(T *value) {
+            T *slot = front();
+            if(slot == NULL)
+                return false;
+            *value = *slot;
+            release();
+            return true;
+        }
+
+        /**
+         * @brief Either side, the number of elements waiting to be read.
+         */
+        uint32_t size(void) const {
+            return __atomic_load_n(&head, __ATOMIC_ACQUIRE) - __atomic_load_n(&tail, __ATOMIC_ACQUIRE);
+        }
+        /**
+         * @brief The number of elements the ring can hold.
+         */
+        uint32_t capacity(void) const {
+            return mask + 1;
+        }
+};
+
+#endif /* __RI_RING_BUFFER_H__ */
@@ -19,6 +19,7 @@
 #include <opencv/highgui.h>
 #include <stdint.h>
 #include <stdbool.h>
+#include <time.h>
 
 // Sockets
 #include <sys/socket.h>
@@ -50,6 +51,10 @@
 #define RI_FASTEST		1                 ///<the fastest speed.
 #define RI_SLOWEST		10              ///<the slowest speed.
 
+// A drive command only moves the wheels for about this long, in microseconds. To keep
+// moving, a controller sends the command again within each pulse, and sends RI_STOP once.
+#define RI_MOVE_PULSE_US	150000
+
 /***************************************
  * Response Code Definitions
  ***************int************************/
@@ -131,6 +136,19 @@ typedef struct {
 #define RI_ROBOT_STATE_PATH	3
 #define RI_ROBOT_STATE_REC_PATH	4
 
+/***************************************
+ * Path recording description
+ ***************************************/
+// Path limits
+#define RI_MAX_PATHS			32
+#define RI_MAX_PATH_NAME		64
+
+/** @brief The list of paths stored on the robot */
+typedef struct {
+    int			count; /* Number of valid entries in name */
+    char		name[RI_MAX_PATHS][RI_MAX_PATH_NAME]; /* Path names as stored on the robot */
+} RIPathList;
+
 // Robot head positions
 #define RI_ROBOT_HEAD_LOW	204
 // MID is actually between 135 and 140
@@ -166,7 +184,7 @@ typedef struct {
 #define RI_CAMERA_RES_176		0
 // 320x240
 #define RI_CAMERA_RES_320		1
-// 352x240
+// 352x288
 #define RI_CAMERA_RES_352		2
 // 640x480
 #define RI_CAMERA_RES_640		3
@@ -236,12 +254,44 @@ struct MapObj {
 #define MAP_OBJ_SCORE(s)                (s & 0xF)
 #define MAP_OBJ_ENC(t,s)                (((t & 0x0F) << 4) | (s & 0xF))
 
+// Bit of a cell in RIMap.changed
+#define MAP_CELL_BIT(x,y)               (1ULL << ((y) * MAP_MAX_X + (x)))
+
+/** @brief The whole map as a flat grid, updated in place by every poll */
+typedef struct {
+    int			score1;
+    int			score2;
+    unsigned char	cells[MAP_MAX_Y][MAP_MAX_X]; /* MAP_OBJ_ENC(type, points) of each cell, points only for pellets */
+    uint64_t		changed; /* MAP_CELL_BIT() of the cells the last poll changed */
+    bool		scores_changed; /* The last poll changed a score */
+    uint32_t		polls; /* Maps parsed into it, every cell counts as changed at the first */
+} RIMap;
+
 // Error codes
 #define SERR_NONE                       (0)
 #define SERR_INVALID_MOVE               (-1)
 #define SERR_INVALID_COORD              (-2)
 #define SERR_INVALID_ROBOT              (-3)
 
+/***************************************
+ * Latency trace description
+ ***************************************/
+// Points of a frame's trip from the camera request to the move based on it
+#define RI_TRACE_REQUEST		0   ///<The image request was sent.
+#define RI_TRACE_FIRST_BYTE		1   ///<The first byte of the response arrived.
+#define RI_TRACE_RECEIVED		2   ///<The whole JPEG arrived.
+#define RI_TRACE_DECODED		3   ///<The image was decoded.
+#define RI_TRACE_PROCESSED		4   ///<Detection or tracking on the image is done.
+#define RI_TRACE_COMMAND		5   ///<The first move() based on the image was sent.
+#define RI_TRACE_ACKED			6   ///<The robot answered that move().
+#define RI_TRACE_POINTS			7
+
+/** @brief The timestamps of one frame, riTimestamp() of each point reached, 0 for the others */
+typedef struct {
+    uint32_t		frame; /* Frame number, from 0 */
+    uint64_t		t[RI_TRACE_POINTS];
+} RITrace;
+
 // ******************************************************************
 // * Robot user interface
 // ******************************************************************
@@ -257,16 +307,57 @@ typedef struct RobotIf {
     // Robot number
     int id;
 
-    // Current robot encoder counts
-    unsigned long long right_wheel_enc;
-    unsigned long long left_wheel_enc;
-    unsigned long long rear_wheel_enc;
+    // Current robot encoder counts, signed like the per-read encoder values
+    long long right_wheel_enc;
+    long long left_wheel_enc;
+    long long rear_wheel_enc;
 
     // Report caches, remember to update before calling any of the getters
     RIReport report;
     RIData sensor;
+
+    // riTimestamp() when the first byte of the last response arrived
+    uint64_t first_byte;
 } RobotIfType;
 
+// ******************************************************************
+// * Low level interface, shared by the driver modules
+// ******************************************************************
+
+/** @brief Open the socket to the webserver */
+int riOpen(RobotIfType *ri, bool game_server);
+/** @brief Close the webserver socket */
+int riClose(RobotIfType *ri);
+/** @brief Make an http request, returns the size of the response body */
+int httpRequest(RobotIfType *ri, char *cmd, char *response, int rlen, bool game_server);
+/** @brief Get sensor data from the Rovio */
+int riGetSensorData(RobotIfType *ri, RIData *sensor);
+/** @brief Get sensor report from the Rovio (North Star) */
+int riGetStatus(RobotIfType *ri, RIReport *report);
+/** @brief Robot Movement, get  wheel's encoder */
+int riGetWheelEncoder(RobotIfType *ri, int wheel);
+/** @brief Classify a raw North Star signal strength as RI_ROBOT_NAV_SIGNAL_* */
+int riNavStrength(unsigned int strength);
+/** @brief Finds a cosine of angle between vectors from pt0->pt1 and from pt0->pt2 */
+double riAngle(CvPoint* pt1, CvPoint* pt2, CvPoint* pt0);
+/** @brief Monotonic time in microseconds, the clock every driver timestamp is taken from */
+uint64_t riTimestamp(void);
+/** @brief Sleep until the next period after next on the riTimestamp() clock, returns the number of periods missed */
+int riWaitPeriod(struct timespec *next, uint64_t period_us);
+/** @brief Decode a JPEG into a pre-allocated BGR image of the same size */
+int riDecodeJpeg(const unsigned char *jpeg, int size, IplImage *image);
+/** @brief Read the size of a JPEG image from its header */
+int riJpegSize(const unsigned char *jpeg, int size, CvSize *dim);
+/** @brief Decode the DC coefficients of a JPEG into a 1/8 scale gray image */
+int riDecodeJpegDC(const unsigned char *jpeg, int size, IplImage *image);
+/** @brief The size of the frames at a RI_CAMERA_RES_* resolution */
+CvSize riCameraSize(int resolution);
+/** @brief Set a point of a trace to now, unless it was reached already */
+void riTraceMark(RITrace *trace, int point);
+/** @brief Parse a game server map into a flat map in place, marking the cells that changed */
+int riParseMap(const char *text, RIMap *map);
+/** @brief List the cells the last poll changed, returns how many were written */
+int riMapChanges(const RIMap *map, MapObjType *changes, int max);
 
 
 /**
@@ -276,9 +367,29 @@ typedef struct RobotIf {
  * The class RobotInerface provides the robot interface and function, such as:the control of the robot moving and rocker arm;infrared detect  
  * obstacles, image acquisition, image save, update the data and so on.
  */
+class TelemetryLog;
+class SquareDetector;
+class ImageSaver;
+class FrameRecorder;
+class LatencyStats;
+
 class RobotInterface {
 	private:
         RobotIfType  ri;           ///<This holds the robot interface code
+        TelemetryLog *telemetry;   ///<Records update() and move() when set
+        SquareDetector *detector;  ///<Work buffers of findSquares()
+        ImageSaver *saver;         ///<Writes saveImage() frames when set
+        FrameRecorder *recorder;   ///<Records every captured frame when set
+        unsigned char *jpeg;       ///<Last JPEG received from the camera
+        int jpeg_size;
+        uint64_t jpeg_time;        ///<riTimestamp() when it was requested
+        RITrace trace;             ///<Trace of the last captured frame
+        uint32_t trace_frames;     ///<Frames traced so far
+        LatencyStats *latency;     ///<Collects the traces when set
+
+        // Not copyable, the detector and the JPEG buffer are owned
+        RobotInterface(const RobotInterface &);
+        RobotInterface &operator=(const RobotInterface &);
 	public:
         /**
          *@brief RobotInterface() Create a new instance of the RobotInterface class to initialize the robot interface instance.
@@ -293,16 +404,73 @@ class RobotInterface {
        *@brief Robot API Version
        */
        void APIVersion(int* major, int* minor);
+      /**
+       *@brief Connection, copy the connection settings so a worker thread can talk to the robot on its own socket.
+       */
+       void getConnection(RobotIfType *conn);
 
 
       /**
         * @brief Robot Movement, move the robot or its' arm.
         */
         int move(int movement, int speed);
+        /**
+         * @brief Robot Movement, move the robot and mark the command on the trace of the frame it is based on.
+         */
+        int move(int movement, int speed, RITrace *trace);
         /**
          * @brief Robot Movement, goHome.
          */
         int goHome(void);
+
+        /**
+         * @brief Path, start recording a path on the robot.
+         */
+        int startPathRecording(void);
+        /**
+         * @brief Path, abort the current recording without saving it.
+         */
+        int abortPathRecording(void);
+        /**
+         * @brief Path, stop the current recording and store it on the robot under a name.
+         */
+        int stopPathRecording(const char *name);
+        /**
+         * @brief Path, delete a stored path.
+         */
+        int deletePath(const char *name);
+        /**
+         * @brief Path, rename a stored path.
+         */
+        int renamePath(const char *name, const char *new_name);
+        /**
+         * @brief Path, get the list of the paths stored on the robot.
+         */
+        int getPathList(RIPathList *paths);
+        /**
+         * @brief Path, delete all of the stored paths.
+         */
+        int clearAllPaths(void);
+        /**
+         * @brief Path, replay a stored path from its start to its end.
+         */
+        int playPathForward(const char *name);
+        /**
+         * @brief Path, replay a stored path from its end back to its start.
+         */
+        int playPathBackward(const char *name);
+        /**
+         * @brief Path, pause the path being played.
+         */
+        int pausePlaying(void);
+        /**
+         * @brief Path, stop the path being played.
+         */
+        int stopPlaying(void);
+        /**
+         * @brief Path, returns the robot state (idle, driving, docking, playing or recording a path).
+         */
+        int robotState(void);
         /**
          * @brief Robot Movement, get wheel's direction.
          */
@@ -314,7 +482,7 @@ class RobotInterface {
         /**
          * @brief Robot Movement, get wheel's encoder totally.
          */
-        int getWheelEncoderTotals(int wheel);
+        long long getWheelEncoderTotals(int wheel);
         /**
          * @brief Robot Movement, get robot's headposition.
          */
@@ -329,7 +497,7 @@ class RobotInterface {
          */
         int IR(int status);
         /**
-         * @brief store the status of IR detector's .
+         * @brief IR, record the status of the IR detector in the telemetry log.
          */
         int IRStatus(void);
 
@@ -376,9 +544,37 @@ class RobotInterface {
          */
         int getImage(IplImage *image);
         /**
-         * @brief Image, save an image from the camera.
+         * @brief Image, captures a JPEG from the camera without decoding it.
+         */
+        int getJpeg(const unsigned char **data, int *size);
+        /**
+         * @brief Image, the JPEG of the last captured image as the robot sent it.
+         */
+        int lastJpeg(const unsigned char **data, int *size);
+        /**
+         * @brief Image, save the last captured image as <image_number>.jpeg.
          */
         int saveImage(IplImage *image,int image_number);
+        /**
+         * @brief Image, write saveImage() frames through an asynchronous saver, NULL to write them on the calling thread.
+         */
+        void setImageSaver(ImageSaver *saver);
+        /**
+         * @brief Image, append every captured frame to a recording, NULL to stop.
+         */
+        void setRecorder(FrameRecorder *recorder);
+        /**
+         * @brief Image, mark a point of the trace of the last captured frame, for the steps done outside the driver.
+         */
+        void traceMark(int point);
+        /**
+         * @brief Image, copy the trace of the last captured frame, to carry it along with the frame.
+         */
+        void getTrace(RITrace *trace);
+        /**
+         * @brief Image, collect the trace of every captured frame, NULL to stop.
+         */
+        void setLatencyStats(LatencyStats *stats);
         /**
          * @brief Image, takes a 1 plane image and returns a list of the squares in an image.
          */
@@ -387,6 +583,10 @@ class RobotInterface {
          * @brief Image, configures the camera for use.
          */
         int cameraConfigure(int brightness, int contrast, int framerate, int resolution, int quality);
+        /**
+         * @brief Image, changes the resolution and quality of the frames.
+         */
+        int cameraResolution(int resolution, int quality);
         /**
          * @brief Image, configures the volume for use.
          */
@@ -408,6 +608,10 @@ class RobotInterface {
          * @brief Report, Reset the cached data.
          */
         void resetState(void);
+        /**
+         * @brief Reports, record every update() and move() in a telemetry log, NULL to stop.
+         */
+        void setTelemetry(TelemetryLog *log);
 
         /**
          * @brief Game API, updates the robot's location on the map.
@@ -421,6 +625,10 @@ class RobotInterface {
            * @brief Game API, get the current map from the server.
            */
          MapObjType* getMap(int *score1, int* score2);
+        /**
+         * @brief Game API, update a flat map from the server without allocating, see RIMap.changed for what changed.
+         */
+        int getMap(RIMap *map);
          };
 
 #endif    /*ROBOT_DRIVER_CPP_H*/
@@ -0,0 +1,121 @@
+/**
+ * @file sentry.h
+ * @brief Motion gated capture for unattended runs
+ *
+ * SentryCapture keeps the camera at 176x144 and low quality while nothing happens and
+ * compares each frame to the one before it. When enough pixels change, it switches the
+ * camera to full resolution with ChangeResolution.cgi and hands out the full frames until
+ * the scene has been quiet for a while, then drops back. A patrol loop then moves a few KB
+ * per poll most of the time instead of a full VGA frame.
+ */
+
+#ifndef __RI_SENTRY_H__
+#define __RI_SENTRY_H__
+
+#include "robotdriver.h"
+
+/***************************************
+ * Sentry description
+ ***************************************/
+#define RI_SENTRY_WATCH_RES		RI_CAMERA_RES_176
+#define RI_SENTRY_WATCH_QUALITY		RI_CAMERA_QUALITY_LOW
+#define RI_SENTRY_ALERT_RES		RI_CAMERA_RES_640
+#define RI_SENTRY_ALERT_QUALITY		RI_CAMERA_QUALITY_HIGH
+#define RI_SENTRY_DEFAULT_LEVEL		24      /* Change of a pixel (0-255) that is more than noise */
+#define RI_SENTRY_DEFAULT_PIXELS	60      /* Changed pixels, at watch resolution, that make motion */
+#define RI_SENTRY_DEFAULT_QUIET		(5*1000*1000)   /* Microseconds without motion before dropping back */
+
+// States
+#define RI_SENTRY_IDLE			0       ///<Not started, the camera is left alone
+#define RI_SENTRY_WATCH			1       ///<Low resolution frames, waiting for motion
+#define RI_SENTRY_ALERT			2       ///<Full resolution frames
+
+/**
+ * @class SentryCapture
+ * @brief Captures at low resolution until something moves
+ *
+ * poll() is called in the capture loop in place of getImage(). The robot must not be
+ * reconfigured by anything else while the sentry is started.
+ */
+class SentryCapture {
+	private:
+        RobotInterface *robot;
+        int level;
+        int pixels;
+        uint64_t quiet;
+        int state;
+        bool moving;                    ///<The last frame had motion
+        uint64_t last_motion;           ///<riTimestamp() of the last frame with motion
+        CvSize watch_size;
+        IplImage *small;                ///<Frame at watch resolution
+        IplImage *full;                 ///<Frame at any other resolution
+        IplImage *gray;                 ///<Small gray frame being compared
+        IplImage *previous;             ///<The one before
+        IplImage *diff;
+        bool primed;                    ///<previous can be compared to, false after a resolution change
+        CvSize last_size;               ///<Size of the last frame
+        uint32_t frame_count;
+        uint32_t full_count;
+        uint64_t byte_count;
+
+        int changedPixels(void);
+        int setState(int state);
+
+        // Not copyable
+        SentryCapture(const SentryCapture &);
+        SentryCapture &operator=(const SentryCapture &);
+	public:
+        /**
+         * @brief SentryCapture() Create a sentry on the camera of robot.
+         */
+        SentryCapture(RobotInterface *robot);
+        /**
+         * @brief A destructor, frees the frames. The camera is left as it is.
+         */
+        ~SentryCapture();
+
+        /**
+         * @brief Set what motion is: more than pixels pixels changed by more than level.
+         */
+        void setMotion(int level, int pixels);
+        /**
+         * @brief Set how long, in microseconds, the scene must be quiet before dropping back to low resolution.
+         */
+        void setQuiet(uint64_t us);
+
+        /**
+         * @brief Switch the camera to low resolution and start watching.
+         */
+        int start(void);
+        /**
+         * @brief Switch the camera back to full resolution and stop watching.
+         */
+        int stop(void);
+
+        /**
+         * @brief Capture and check the next frame, frame is set to the full resolution frame if there is one.
+         */
+        int poll(IplImage **frame);
+        /**
+         * @brief RI_SENTRY_IDLE, RI_SENTRY_WATCH or RI_SENTRY_ALERT.
+         */
+        int getState(void);
+        /**
+         * @brief Returns true if the last frame had motion.
+         */
+        bool motion(void);
+        /**
+         * @brief The number of frames polled.
+         */
+        uint32_t frames(void);
+        /**
+         * @brief The number of full resolution frames handed out.
+         */
+        uint32_t fullFrames(void);
+        /**
+         * @brief The number of JPEG bytes received.
+         */
+        uint64_t bytes(void);
+};
+
+#endif /* __RI_SENTRY_H__ */
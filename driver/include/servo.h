@@ -0,0 +1,129 @@
+/**
+ * @file servo.h
+ * @brief Visual servoing, steers the robot towards a tracked target
+ *
+ * Turning the robot from the tracking loop with blocking move() calls stalls the tracker
+ * for a round trip per frame, and by the time a frame is processed the target is no longer
+ * where it was seen. VisualServo takes the tracked boxes with the time their frame was
+ * captured through a mailbox that only keeps the latest one, and a control thread turns
+ * towards the target and keeps it at a reference size at a fixed rate. The offset is
+ * corrected for the age of the frame, from the turn the odometry measured since the
+ * capture or, without odometry, from how fast the target moved across the image. The
+ * command is sent at every step while the servo steers (see RI_MOVE_PULSE_US). The trace of
+ * each frame is carried along to the move based on it, for LatencyStats.
+ */
+
+#ifndef __RI_SERVO_H__
+#define __RI_SERVO_H__
+
+#include "robotdriver.h"
+#include "odometry.h"
+#include <pthread.h>
+#include <stdio.h>
+
+/***************************************
+ * Servo description
+ ***************************************/
+#define RI_SERVO_DEFAULT_RATE		10      /* Control steps per second, one move each while steering */
+#define RI_SERVO_HFOV_DEG		52.0    /* Horizontal field of view of the camera */
+#define RI_SERVO_DEADBAND		0.08    /* Offset from the center, fraction of the width, that is on target */
+#define RI_SERVO_FULL_TURN		0.4     /* Offset turned at RI_FASTEST */
+#define RI_SERVO_SIZE_TOLERANCE		0.2     /* Change of the box height from the reference that is on target */
+#define RI_SERVO_MAX_AGE		1000000 /* Microseconds after which a target is lost and the robot stops */
+
+/** @brief A tracked target */
+typedef struct {
+    uint64_t		timestamp; /* riTimestamp() the frame was captured, 0 if none was posted */
+    CvRect		box; /* In the frame */
+    bool		found; /* The tracker found the target in the frame */
+    RITrace		trace; /* Of the frame, its command is marked by the first move based on it */
+} RIServoTarget;
+
+/** @brief Servo statistics */
+typedef struct {
+    uint32_t		posted; /* Targets given to post() */
+    uint32_t		steps; /* Control steps run */
+    uint32_t		acted; /* Steps that steered on a target */
+    uint32_t		lost; /* Steps without a recent target, the robot was stopped */
+    uint32_t		commands; /* Moves sent */
+    uint64_t		age_sum; /* Frame age at the steps that steered, microseconds */
+    uint32_t		age_max;
+} RIServoStats;
+
+/**
+ * @class VisualServo
+ * @brief Steers towards the latest tracked target on a thread of its own
+ *
+ * Targets can be posted from the tracking thread at any rate. The servo drives through the
+ * given robot, which no other thread may use while the servo is started: give it a
+ * RobotInterface of its own, not the one the frames are captured with.
+ */
+class VisualServo {
+	private:
+        RobotInterface *robot;          ///<Sends the moves
+        Odometry *odometry;             ///<NULL to compensate from the target motion
+        int width;                      ///<Of the frames, pixels
+        double px_per_rad;
+        int rate;
+        int reference;                  ///<Box height to keep, 0 to only turn
+        pthread_mutex_t lock;           ///<Guards the targets and the statistics
+        RIServoTarget latest;
+        RIServoTarget previous;         ///<Found target before latest, for its image speed
+        RIServoStats stats;
+        uint32_t taken;                 ///<stats.posted when the thread last took latest
+        LatencyStats *latency;          ///<Collects the traces of the targets when set
+        pthread_t thread;
+        volatile bool running;
+
+        static void *servoThread(void *arg);
+        double predictCenter(const RIServoTarget *target, const RIServoTarget *before, uint64_t now, uint64_t changed);
+
+        // Not copyable
+        VisualServo(const VisualServo &);
+        VisualServo &operator=(const VisualServo &);
+	public:
+        /**
+         * @brief VisualServo() Create a servo for frames of the given size, the odometry is optional.
+         */
+        VisualServo(RobotInterface *robot, CvSize frame, Odometry *odometry = NULL, int rate = RI_SERVO_DEFAULT_RATE);
+        /**
+         * @brief A destructor, stops the servo.
+         */
+        ~VisualServo();
+
+        /**
+         * @brief The box height to keep by driving forward and backward, 0 (the default) to only turn.
+         */
+        void setReference(int box_height);
+        /**
+         * @brief Start the control thread.
+         */
+        int start(void);
+        /**
+         * @brief Stop the control thread and the robot.
+         */
+        int stop(void);
+        /**
+         * @brief Returns true while the control thread is running.
+         */
+        bool isRunning(void);
+
+        /**
+         * @brief Collect the trace of every posted frame, NULL (the default) to stop, set before start().
+         */
+        void setLatencyStats(LatencyStats *stats);
+        /**
+         * @brief Post the target tracked in a frame with its trace, it replaces the previous one.
+         */
+        void post(CvRect box, bool found, const RITrace *trace);
+        /**
+         * @brief Copy the statistics since start().
+         */
+        void getStats(RIServoStats *out);
+        /**
+         * @brief Print the statistics.
+         */
+        void printStats(FILE *out);
+};
+
+#endif /* __RI_SERVO_H__ */
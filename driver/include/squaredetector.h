@@ -0,0 +1,92 @@
+/**
+ * @file squaredetector.h
+ * @brief Reusable square detector
+ *
+ * SquareDetector runs the same detection as RobotInterface::findSquares(), but keeps its
+ * work images and contour storage from one frame to the next and returns the squares in a
+ * vector it reuses, so a detection loop stops allocating once it has seen its first frame.
+ */
+
+#ifndef __RI_SQUARE_DETECTOR_H__
+#define __RI_SQUARE_DETECTOR_H__
+
+#include "robotdriver.h"
+#include <vector>
+
+/** @brief A detected square */
+typedef struct {
+    CvPoint		center; /* Center of the bounding box of the four vertices */
+    int			area; /* Area of that bounding box */
+    CvRect		box; /* The bounding box */
+} RISquare;
+
+// findRows() flags, a contour big enough to hold a square reached a cut edge of the band
+#define RI_SQ_CUT_TOP			(1 << 0)
+#define RI_SQ_CUT_BOTTOM		(1 << 1)
+
+/**
+ * @brief Orders the squares by center, top to bottom then left to right.
+ */
+bool riSquareLess(const RISquare &a, const RISquare &b);
+
+/**
+ * @class SquareDetector
+ * @brief Finds the squares in 1 plane images, without allocating per frame
+ *
+ * The work images are only allocated when the input grows beyond what they can hold, a
+ * smaller input works on a region of them. The vector returned by find() belongs to the
+ * detector and is overwritten by the next call.
+ */
+class SquareDetector {
+	private:
+        CvSize size;                    ///<Size the work images were allocated for
+        IplImage band;                  ///<Header on the part of the input being processed
+        IplImage *smooth;               ///<Blurred copy of the input
+        IplImage *canny;
+        IplImage *pyr;
+        IplImage *pyr2;
+        CvMemStorage *storage;          ///<Contours and polygons, cleared every frame
+        std::vector<RISquare> squares;  ///<Result of the last call
+
+        int prepare(CvSize sz);
+        void release(void);
+        CvSeq *contoursIn(const IplImage *img, CvRect area, bool binary);
+        bool isSquare(CvSeq *contour, int threshold, RISquare *sq);
+
+        // Not copyable
+        SquareDetector(const SquareDetector &);
+        SquareDetector &operator=(const SquareDetector &);
+	public:
+        SquareDetector();
+        /**
+         * @brief A destructor, releases the work images.
+         */
+        ~SquareDetector();
+
+        /**
+         * @brief Takes a 1 plane image and returns the squares in it.
+         */
+        const std::vector<RISquare> &find(const IplImage *img, int threshold);
+        /**
+         * @brief Takes a binary mask and returns the squares in it, without the edge detection of find().
+         */
+        const std::vector<RISquare> &findBinary(const IplImage *mask, int threshold);
+        /**
+         * @brief Finds the squares in a part of an image, for tracking.
+         */
+        const std::vector<RISquare> &findIn(const IplImage *img, CvRect area, int threshold, bool binary = false);
+        /**
+         * @brief Finds the squares in the rows top to bottom of an image, for tiled detection.
+         */
+        int findRows(const IplImage *img, int top, int bottom, int threshold, int guard, int own_top, int own_bottom, std::vector<RISquare> *out);
+        /**
+         * @brief The squares found by the last call to find(), findBinary() or findIn().
+         */
+        const std::vector<RISquare> &result(void) const;
+        /**
+         * @brief The biggest square of the last call to find(), findBinary() or findIn(), or NULL if there was none.
+         */
+        const RISquare *biggest(void) const;
+};
+
+#endif /* __RI_SQUARE_DETECTOR_H__ */
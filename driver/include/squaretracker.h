@@ -0,0 +1,103 @@
+/**
+ * @file squaretracker.h
+ * @brief Square tracking across frames
+ *
+ * The squares barely move from one frame to the next, so once they are found SquareTracker
+ * only searches around where a constant velocity model expects each of them. The whole
+ * frame is scanned again when a square is lost and every few frames to pick up new ones.
+ * Each tracked square keeps its id for as long as it is tracked.
+ */
+
+#ifndef __RI_SQUARE_TRACKER_H__
+#define __RI_SQUARE_TRACKER_H__
+
+#include "squaredetector.h"
+#include <vector>
+
+/***************************************
+ * Tracking description
+ ***************************************/
+#define RI_TRACK_DEFAULT_REFRESH	15      /* Frames between full frame scans */
+#define RI_TRACK_MAX_MISSED		3       /* Full frame scans a square may be missing from before it is dropped */
+// The search area is the square grown by this fraction of its size on each side, plus the predicted motion
+#define RI_TRACK_MARGIN			0.5
+// Weight of the last motion in the velocity
+#define RI_TRACK_VELOCITY_GAIN		0.5
+
+/** @brief A tracked square */
+typedef struct {
+    int			id; /* Stable from the frame the square was found on */
+    RISquare		square; /* Last detection, or prediction while missed */
+    float		vx, vy; /* Center motion in pixels per frame */
+    int			hits; /* Frames the square was detected in */
+    int			missed; /* Frames it was not found in since the last detection */
+} RITrack;
+
+/** @brief A possible match of a full frame scan */
+typedef struct {
+    double		distance;
+    int			track, square;
+} RITrackPair;
+
+/**
+ * @class SquareTracker
+ * @brief Follows the squares of a sequence of images with a SquareDetector
+ */
+class SquareTracker {
+	private:
+        SquareDetector detector;
+        int threshold;
+        bool binary;                    ///<Use findBinary() instead of find()
+        int refresh;
+        uint32_t frame;
+        int next_id;
+        bool full_scan;                 ///<The last update() scanned the whole frame
+        std::vector<RITrack> tracks;
+        std::vector<RISquare> found;    ///<Copy of the detections of a full frame scan
+        std::vector<RISquare> matches;  ///<Detection around each prediction, kept between frames
+        std::vector<RITrackPair> pairs; ///<Work buffers of a full frame scan
+        std::vector<bool> track_used;
+        std::vector<bool> square_used;
+
+        void predict(RITrack *track);
+        void correct(RITrack *track, const RISquare &sq);
+        bool searchAround(const IplImage *img, const RITrack &track, RISquare *sq);
+        void scan(const IplImage *img);
+
+        // Not copyable
+        SquareTracker(const SquareTracker &);
+        SquareTracker &operator=(const SquareTracker &);
+	public:
+        /**
+         * @brief SquareTracker() Create a tracker of the squares bigger than threshold, in binary masks or in any 1 plane image.
+         */
+        SquareTracker(int threshold = RI_DEFAULT_SQUARE_SIZE, bool binary = true);
+
+        /**
+         * @brief Frames between full frame scans, 0 to only scan when a square is lost.
+         */
+        void setRefresh(int frames);
+        /**
+         * @brief Forget the tracked squares, the next update() scans the whole frame.
+         */
+        void reset(void);
+
+        /**
+         * @brief Takes the next image of the sequence and returns the tracked squares.
+         */
+        const std::vector<RITrack> &update(const IplImage *img);
+        /**
+         * @brief The squares tracked after the last update().
+         */
+        const std::vector<RITrack> &result(void) const;
+        /**
+         * @brief The biggest square detected in the last update(), or NULL if there was none.
+         */
+        const RITrack *biggest(void) const;
+        /**
+         * @brief Returns true if the last update() scanned the whole frame.
+         */
+        bool fullScan(void) const;
+};
+
+#endif /* __RI_SQUARE_TRACKER_H__ */
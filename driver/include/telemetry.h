@@ -0,0 +1,150 @@
+/**
+ * @file telemetry.h
+ * @brief Binary telemetry log of the robot
+ *
+ * TelemetryLog records every sensor/report sample and every command sent to the robot,
+ * with its timestamp and round trip latency, into a fixed size ring file. The file is
+ * memory mapped, so a record costs one copy and no system call and the logger can run at
+ * the full polling rate. TelemetryReader reads the ring file back, oldest record first,
+ * also while it is being written.
+ */
+
+#ifndef __RI_TELEMETRY_H__
+#define __RI_TELEMETRY_H__
+
+#include "robotdriver.h"
+
+/***************************************
+ * Telemetry file description
+ ***************************************/
+#define RI_TLM_MAGIC			0x4D4C5452  /* "RTLM" */
+#define RI_TLM_VERSION			1
+#define RI_TLM_DEFAULT_RECORDS		(64*1024)
+
+// Commands recorded in the log
+#define RI_TLM_CMD_UPDATE		0   ///<update(), sensor and report polled.
+#define RI_TLM_CMD_MOVE			1   ///<move(), arg holds the movement code.
+#define RI_TLM_CMD_IR_STATUS		2   ///<IRStatus(), arg holds 1 if an obstacle was detected.
+#define RI_TLM_CMD_USER			100 ///<First code free for the application.
+
+/** @brief The file header, followed by capacity records */
+typedef struct {
+    uint32_t		magic; /* RI_TLM_MAGIC */
+    uint32_t		version; /* RI_TLM_VERSION */
+    uint32_t		record_size; /* sizeof(RITelemetryRecord) */
+    uint32_t		capacity; /* Number of record slots in the ring */
+    uint64_t		written; /* Records written since the file was created, slot = index % capacity */
+    uint64_t		created; /* riTimestamp() when the file was created */
+    uint32_t		reserved[8];
+} RITelemetryHeader;
+
+/** @brief One telemetry record */
+typedef struct {
+    uint64_t		timestamp; /* riTimestamp() when the request was sent */
+    uint32_t		latency; /* Round trip of the request in microseconds */
+    int16_t		command; /* RI_TLM_CMD_* */
+    int16_t		arg; /* Command argument (movement code, ...) */
+    int32_t		result; /* Response code of the robot */
+    int32_t		speed; /* Speed of a movement, 0 otherwise */
+    RIData		sensor; /* Sensor data cached when the record was written */
+    RIReport		report; /* Report cached when the record was written */
+} RITelemetryRecord;
+
+/**
+ * @class TelemetryLog
+ * @brief Writes telemetry records into a memory mapped ring file
+ *
+ * When the ring is full the oldest records are overwritten. A log is written by one thread
+ * at a time, attach it to a RobotInterface with setTelemetry() to record update() and move().
+ */
+class TelemetryLog {
+	private:
+        int fd;
+        RITelemetryHeader *header;      ///<Start of the mapping
+        RITelemetryRecord *records;     ///<The ring, right after the header
+        size_t map_size;
+
+        // Not copyable
+        TelemetryLog(const TelemetryLog &);
+        TelemetryLog &operator=(const TelemetryLog &);
+	public:
+        TelemetryLog();
+        /**
+         * @brief A destructor, flushes and closes the file.
+         */
+        ~TelemetryLog();
+
+        /**
+         * @brief Create (or truncate) a ring file of the given number of records.
+         */
+        int open(const char *path, uint32_t capacity = RI_TLM_DEFAULT_RECORDS);
+        /**
+         * @brief Flush the records to disk and close the file.
+         */
+        int close(void);
+        /**
+         * @brief Returns true if a file is open.
+         */
+        bool isOpen(void);
+
+        /**
+         * @brief Append a record.
+         */
+        void record(int command, int arg, int speed, int result, uint64_t sent, uint64_t done, const RIData *sensor, const RIReport *report);
+        /**
+         * @brief The number of records written since the file was opened.
+         */
+        uint64_t written(void);
+};
+
+/**
+ * @class TelemetryReader
+ * @brief Reads a telemetry ring file, oldest record first
+ */
+class TelemetryReader {
+	private:
+        int fd;
+        const RITelemetryHeader *header;
+        const RITelemetryRecord *records;
+        size_t map_size;
+        uint64_t first;                 ///<Index of the oldest record when refresh() was last called
+        uint64_t last;                  ///<Index one past the newest record
+
+        // Not copyable
+        TelemetryReader(const TelemetryReader &);
+        TelemetryReader &operator=(const TelemetryReader &);
+	public:
+        TelemetryReader();
+        /**
+         * @brief A destructor, closes the file.
+         */
+        ~TelemetryReader();
+
+        /**
+         * @brief Map a ring file for reading.
+         */
+        int open(const char *path);
+        /**
+         * @brief Close the file.
+         */
+        int close(void);
+
+        /**
+         * @brief Pick up the records written since the last call, returns the number of records available.
+         */
+        uint64_t refresh(void);
+        /**
+         * @brief The number of records available, oldest first.
+         */
+        uint64_t count(void);
+        /**
+         * @brief Copy record i (0 is the oldest), returns false if it was overwritten meanwhile.
+         */
+        bool get(uint64_t i, RITelemetryRecord *rec);
+        /**
+         * @brief riTimestamp() when the file was created.
+         */
+        uint64_t created(void);
+};
+
+#endif /* __RI_TELEMETRY_H__ */
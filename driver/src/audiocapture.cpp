@@ -0,0 +1,216 @@
+/** @file audiocapture.cpp
+ *  @brief Streaming microphone capture, see audiocapture.h.
+ *
+ */
+
+#include "audiocapture.h"
+
+#include <unistd.h>
+#include <stdio.h>
+#include <string.h>
+
+// Wait before reconnecting after the stream was lost
+#define RI_AUDIO_RECONNECT_US		500000
+
+/**
+ * @param robot the robot to listen to, its connection settings are copied.
+ * @param endpoint the path of the PCM stream on the robot's webserver, without the leading /. See audiocapture.h for the format.
+ * @param blocks the number of blocks buffered for the reader.
+ */
+AudioCapture::AudioCapture(RobotInterface *robot, const char *endpoint, uint32_t blocks) : ring(blocks) {
+    robot->getConnection(&conn);
+    strncpy(path, endpoint != NULL ? endpoint : "", MAX_ADDR_LEN - 1);
+    path[MAX_ADDR_LEN - 1] = '\0';
+    conn.sock = -1;
+    pthread_mutex_init(&sock_lock, NULL);
+    running = false;
+    drop_count = 0;
+    sequence = 0;
+}
+
+AudioCapture::~AudioCapture() {
+    stop();
+    pthread_mutex_destroy(&sock_lock);
+}
+
+/** @brief Receive the stream until it ends or the capture is stopped */
+int AudioCapture::stream(void) {
+    char req[512];
+    unsigned char buf[2048];
+    RIAudioBlock scratch;
+    RIAudioBlock *block = NULL;
+    int len, hdr_len = 0, i;
+    int odd = -1;
+    char *start_of_data;
+    uint64_t now;
+
+    // The socket only changes under the lock, so stop() never shuts down a stale descriptor
+    pthread_mutex_lock(&sock_lock);
+    if(!running || riOpen(&conn, false) != RI_RESP_SUCCESS) {
+        riClose(&conn);
+        pthread_mutex_unlock(&sock_lock);
+        return RI_RESP_FAILURE;
+    }
+    pthread_mutex_unlock(&sock_lock);
+    sprintf(req, "GET /%s HTTP/1.0\nUser-Agent: RovioCMD 1.0\n\n", path);
+    send(conn.sock, req, strlen(req), 0);
+
+    // Skip the header, the samples start right after the \r\n\r\n
+    memset(req, 0, 512);
+    start_of_data = NULL;
+    while(start_of_data == NULL) {
+        len = recv(conn.sock, req + hdr_len, 511 - hdr_len, 0);
+        if(len <= 0 || !running) {
+            closeStream();
+            return RI_RESP_FAILURE;
+        }
+        hdr_len += len;
+        start_of_data = strstr(req, "\r\n\r\n");
+        if(start_of_data == NULL && hdr_len >= 511) {
+            closeStream();
+            return RI_RESP_FAILURE;
+        }
+    }
+    start_of_data += 4;
+    len = hdr_len - (start_of_data - req);
+    memcpy(buf, start_of_data, len);
+    now = riTimestamp();
+
+    // Cut the byte stream into blocks, filling the ring slots in place
+    while(running) {
+        for(i = 0; i < len; i++) {
+            // Samples may be split across two reads
+            if(odd < 0) {
+                odd = buf[i];
+                continue;
+            }
+
+            if(block == NULL) {
+                block = ring.claim();
+                if(block == NULL)
+                    block = &scratch;
+                block->timestamp = now;
+                block->sequence = sequence++;
+                block->samples = 0;
+            }
+            block->pcm[block->samples++] = (int16_t)(odd | (buf[i] << 8));
+            odd = -1;
+
+            if(block->samples == RI_AUDIO_BLOCK_SAMPLES) {
+                if(block == &scratch)
+                    __atomic_add_fetch(&drop_count, 1, __ATOMIC_RELAXED);
+                else
+                    ring.publish();
+                block = NULL;
+            }
+        }
+
+        len = recv(conn.sock, buf, sizeof(buf), 0);
+        now = riTimestamp();
+        if(len <= 0)
+            break;
+    }
+
+    // Hand over what we have of the last block
+    if(block != NULL && block->samples > 0) {
+        if(block == &scratch)
+            __atomic_add_fetch(&drop_count, 1, __ATOMIC_RELAXED);
+        else
+            ring.publish();
+    }
+
+    closeStream();
+    return RI_RESP_SUCCESS;
+}
+
+/** @brief Close the stream socket */
+void AudioCapture::closeStream(void) {
+    pthread_mutex_lock(&sock_lock);
+    riClose(&conn);
+    pthread_mutex_unlock(&sock_lock);
+}
+
+/** @brief Body of the capture thread, reconnects until stopped */
+void *AudioCapture::captureThread(void *arg) {
+    AudioCapture *ac = (AudioCapture *)arg;
+
+    while(ac->running) {
+        if(ac->stream() != RI_RESP_SUCCESS || ac->running) {
+#ifdef DEBUG_AUDIO
+            printf("Audio stream lost, reconnecting\n");
+#endif
+            usleep(RI_AUDIO_RECONNECT_US);
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @return RI_RESP_SUCCESS, RI_RESP_BUSY if the capture is already running, RI_RESP_NO_PARAM if no endpoint was given.
+ * @note The microphone gain is set with RobotInterface::volumeConfigure().
+ */
+int AudioCapture::start(void) {
+    if(running)
+        return RI_RESP_BUSY;
+    if(path[0] == '\0')
+        return RI_RESP_NO_PARAM;
+
+    running = true;
+    sequence = 0;
+    if(pthread_create(&thread, NULL, captureThread, this) != 0) {
+        running = false;
+        perror("Unable to start the audio capture thread.");
+        return RI_RESP_FAILURE;
+    }
+    return RI_RESP_SUCCESS;
+}
+
+/**
+ * @return RI_RESP_SUCCESS.
+ * @note Blocks still in the ring can be read after the capture is stopped.
+ */
+int AudioCapture::stop(void) {
+    if(!running)
+        return RI_RESP_SUCCESS;
+
+    // Wake the thread up if it is waiting on the socket
+    pthread_mutex_lock(&sock_lock);
+    running = false;
+    if(conn.sock != -1)
+        shutdown(conn.sock, SHUT_RDWR);
+    pthread_mutex_unlock(&sock_lock);
+    pthread_join(thread, NULL);
+    return RI_RESP_SUCCESS;
+}
+
+bool AudioCapture::isRunning(void) {
+    return running;
+}
+
+/**
+ * @param block filled in with the oldest captured block.
+ * @return true if a block was read.
+ */
+bool AudioCapture::read(RIAudioBlock *block) {
+    return ring.pop(block);
+}
+
+/**
+ * @return the oldest captured block, or NULL if none is waiting.
+ * @note The block stays valid until release() is called, no copy is made.
+ */
+const RIAudioBlock *AudioCapture::front(void) {
+    return ring.front();
+}
+
+void AudioCapture::release(void) {
+    ring.release();
+}
+
+uint32_t AudioCapture::available(void) {
+    return ring.size();
+}
+
+uint32_t AudioCapture::dropped(void) {
+    return __atomic_load_n(&drop_count, __ATOMIC_RELAXED);
+}
@@ -0,0 +1,234 @@
+/** @file behavior.cpp
+ *  @brief Fixed rate reactive behaviors, see behavior.h.
+ *
+ */
+
+#include "behavior.h"
+
+#include <string.h>
+#include <time.h>
+
+/**
+ * @param input the inputs of the step.
+ * @param cmd set to a fast left turn, or to *arg.
+ * @param arg NULL or an RIBehaviorCommand.
+ * @return true while the debounced IR detector sees an obstacle.
+ */
+bool riBehaviorAvoid(const RIBehaviorInput *input, RIBehaviorCommand *cmd, void *arg) {
+    if(!input->ir)
+        return false;
+    if(arg != NULL) {
+        memcpy(cmd, arg, sizeof(RIBehaviorCommand));
+    } else {
+        cmd->movement = RI_TURN_LEFT;
+        cmd->speed = RI_FASTEST;
+    }
+    return true;
+}
+
+/**
+ * @param cmd set to forward at full speed, or to *arg.
+ * @param arg NULL or an RIBehaviorCommand.
+ * @return true, whatever the inputs of the step.
+ */
+bool riBehaviorCruise(const RIBehaviorInput *, RIBehaviorCommand *cmd, void *arg) {
+    if(arg != NULL) {
+        memcpy(cmd, arg, sizeof(RIBehaviorCommand));
+    } else {
+        cmd->movement = RI_MOVE_FORWARD;
+        cmd->speed = RI_FASTEST;
+    }
+    return true;
+}
+
+/**
+ * @param robot the robot to drive, its connection settings are copied for the polls.
+ * @param rate the number of control steps per second.
+ * @param debounce the number of polls in a row the IR detector must agree on before its state changes.
+ */
+BehaviorEngine::BehaviorEngine(RobotInterface *robot, int rate, int debounce) {
+    this->robot = robot;
+    robot->getConnection(&conn);
+    rule_count = 0;
+    this->rate = rate > 0 ? rate : RI_BEHAVIOR_DEFAULT_RATE;
+    this->debounce = debounce > 0 ? debounce : 1;
+    refresh = RI_BEHAVIOR_DEFAULT_REFRESH;
+    pthread_mutex_init(&lock, NULL);
+    memset(&stats, 0, sizeof(RIBehaviorStats));
+    running = false;
+}
+
+BehaviorEngine::~BehaviorEngine() {
+    stop();
+    pthread_mutex_destroy(&lock);
+}
+
+/**
+ * @param rule the rule.
+ * @param arg given to the rule at every step.
+ * @return RI_RESP_SUCCESS, RI_RESP_BUSY if the engine is started, RI_RESP_PARAM_RANGE_ERR if it has RI_BEHAVIOR_MAX_RULES rules.
+ */
+int BehaviorEngine::addRule(RIBehaviorRule rule, void *arg) {
+    if(running)
+        return RI_RESP_BUSY;
+    if(rule_count >= RI_BEHAVIOR_MAX_RULES)
+        return RI_RESP_PARAM_RANGE_ERR;
+
+    rules[rule_count] = rule;
+    rule_args[rule_count] = arg;
+    rule_count++;
+    return RI_RESP_SUCCESS;
+}
+
+/**
+ * @param us the microseconds after which the current drive command is sent again, 0 to send it only once.
+ * @note The wheels stop RI_MOVE_PULSE_US after a drive command, a longer period makes the robot stutter.
+ */
+void BehaviorEngine::setRefresh(uint64_t us) {
+    if(running)
+        return;
+    refresh = us;
+}
+
+/** @brief The command of the first rule that wants to drive, stop if none does */
+void BehaviorEngine::decide(const RIBehaviorInput *input, RIBehaviorCommand *cmd) {
+    int i;
+
+    for(i = 0; i < rule_count; i++) {
+        if(rules[i](input, cmd, rule_args[i]))
+            return;
+    }
+    cmd->movement = RI_STOP;
+    cmd->speed = RI_SLOWEST;
+}
+
+/** @brief Body of the control thread */
+void *BehaviorEngine::behaviorThread(void *arg) {
+    BehaviorEngine *be = (BehaviorEngine *)arg;
+    RIBehaviorInput input;
+    RIBehaviorCommand cmd, last;
+    struct timespec next;
+    uint64_t started, done, last_sent = 0, period = 1000000ULL / be->rate;
+    bool raw, moved;
+    int agree = 0, resp;
+
+    memset(&input, 0, sizeof(RIBehaviorInput));
+    last.movement = -1;
+    last.speed = -1;
+    clock_gettime(CLOCK_MONOTONIC, &next);
+
+    while(be->running) {
+        started = riTimestamp();
+        resp = riGetSensorData(&(be->conn), &(input.sensor));
+        done = riTimestamp();
+        moved = false;
+
+        if(resp == RI_RESP_SUCCESS) {
+            input.timestamp = started + (done - started) / 2;
+
+            // The state only changes once the detector agreed for debounce polls
+            raw = (input.sensor.status & RI_STATUS_IR_DETECTOR) != 0;
+            agree = raw != input.ir ? agree + 1 : 0;
+            if(agree >= be->debounce) {
+                input.ir = raw;
+                input.ir_rose = raw;
+                input.ir_fell = !raw;
+                input.ir_since = input.timestamp;
+                agree = 0;
+            }
+
+            be->decide(&input, &cmd);
+            if(cmd.movement != last.movement || cmd.speed != last.speed ||
+                    (cmd.movement != RI_STOP && be->refresh != 0 && done - last_sent >= be->refresh)) {
+                be->robot->move(cmd.movement, cmd.speed);
+                last = cmd;
+                last_sent = riTimestamp();
+                moved = true;
+            }
+            input.step++;
+        }
+
+        done = riTimestamp();
+        pthread_mutex_lock(&be->lock);
+        be->stats.steps++;
+        if(resp != RI_RESP_SUCCESS)
+            be->stats.errors++;
+        if(moved)
+            be->stats.commands++;
+        if(input.ir_rose || input.ir_fell)
+            be->stats.edges++;
+        be->stats.step_sum += done - started;
+        if(done - started > be->stats.step_max)
+            be->stats.step_max = (uint32_t)(done - started);
+        pthread_mutex_unlock(&be->lock);
+        input.ir_rose = false;
+        input.ir_fell = false;
+
+        // Wait for the next period, skip the missed ones on overrun
+        if(riWaitPeriod(&next, period) > 0) {
+            pthread_mutex_lock(&be->lock);
+            be->stats.overruns++;
+            pthread_mutex_unlock(&be->lock);
+        }
+    }
+
+    if(last.movement != RI_STOP && last.movement != -1)
+        be->robot->move(RI_STOP, RI_SLOWEST);
+    return NULL;
+}
+
+/**
+ * @return RI_RESP_SUCCESS, RI_RESP_BUSY if the engine is already started, RI_RESP_FAILURE if the control thread can't be started.
+ * @note A poll takes a full HTTP round trip, rates above what the link sustains are counted as overruns.
+ */
+int BehaviorEngine::start(void) {
+    if(running)
+        return RI_RESP_BUSY;
+
+    memset(&stats, 0, sizeof(RIBehaviorStats));
+    running = true;
+    if(pthread_create(&thread, NULL, behaviorThread, this) != 0) {
+        running = false;
+        perror("Unable to start the behavior thread.");
+        return RI_RESP_FAILURE;
+    }
+    return RI_RESP_SUCCESS;
+}
+
+/**
+ * @return RI_RESP_SUCCESS.
+ * @note The robot is stopped if the last command moved it.
+ */
+int BehaviorEngine::stop(void) {
+    if(!running)
+        return RI_RESP_SUCCESS;
+
+    running = false;
+    pthread_join(thread, NULL);
+    return RI_RESP_SUCCESS;
+}
+
+bool BehaviorEngine::isRunning(void) {
+    return running;
+}
+
+/**
+ * @param out filled with a copy of the statistics since start().
+ */
+void BehaviorEngine::getStats(RIBehaviorStats *out) {
+    pthread_mutex_lock(&lock);
+    memcpy(out, &stats, sizeof(RIBehaviorStats));
+    pthread_mutex_unlock(&lock);
+}
+
+/**
+ * @param out where to print, stdout for example.
+ */
+void BehaviorEngine::printStats(FILE *out) {
+    RIBehaviorStats s;
+
+    getStats(&s);
+    fprintf(out, "steps %u, overruns %u, errors %u, commands %u, IR edges %u, step mean %.1f ms max %.1f ms\n",
+        s.steps, s.overruns, s.errors, s.commands, s.edges,
+        s.steps > 0 ? s.step_sum / 1000.0 / s.steps : 0.0, s.step_max / 1000.0);
+}
@@ -0,0 +1,180 @@
+/** @file blobextractor.cpp
+ *  @brief Connected blobs of several colors in one scan, see blobextractor.h.
+ *
+ */
+
+#include "blobextractor.h"
+
+BlobExtractor::BlobExtractor() {
+    count = 0;
+    min_area = RI_BLOB_DEFAULT_MIN_AREA;
+    classes = NULL;
+    blobs.reserve(32);
+}
+
+BlobExtractor::~BlobExtractor() {
+    if(classes != NULL)
+        cvReleaseImage(&classes);
+}
+
+/**
+ * @param ranges count HSV ranges, for example riColorRange(RC_PINK_LOW, RC_PINK_HIGH).
+ * @param count the number of ranges, 1 to RI_MAX_COLORS.
+ * @return RI_RESP_SUCCESS, RI_RESP_PARAM_RANGE_ERR if count is out of range.
+ */
+int BlobExtractor::setColors(const RIColorRange *ranges, int count) {
+    int n;
+
+    if(count < 1 || count > RI_MAX_COLORS)
+        return RI_RESP_PARAM_RANGE_ERR;
+    for(n = 0; n < count; n++)
+        this->ranges[n] = ranges[n];
+    this->count = count;
+    return RI_RESP_SUCCESS;
+}
+
+void BlobExtractor::setMinArea(int area) {
+    min_area = area;
+}
+
+/** @brief Root of the set of a run, halving the path on the way */
+int BlobExtractor::root(int run) {
+    while(parent[run] != run) {
+        parent[run] = parent[parent[run]];
+        run = parent[run];
+    }
+    return run;
+}
+
+/**
+ * @param bgr an 8 bit 3 plane image.
+ * @return the blobs found, empty if setColors() was not called or the image is not 8 bit BGR.
+ */
+const std::vector<RIBlob> &BlobExtractor::find(const IplImage *bgr) {
+    if(classes != NULL && (classes->width != bgr->width || classes->height != bgr->height))
+        cvReleaseImage(&classes);
+    if(classes == NULL)
+        classes = cvCreateImage(cvGetSize(bgr), IPL_DEPTH_8U, 1);
+
+    if(count == 0 || riColorClassify(bgr, ranges, count, classes) != RI_RESP_SUCCESS) {
+        blobs.clear();
+        return blobs;
+    }
+    return label(classes);
+}
+
+/**
+ * @param img an 8 bit 1 plane image, 0 for the background and n + 1 for the pixels of color n.
+ * @return the blobs found.
+ * @note Two pixels of the same class are connected when they touch by a side or a corner, like the contours of cvFindContours().
+ */
+const std::vector<RIBlob> &BlobExtractor::label(const IplImage *img) {
+    const uint8_t *row;
+    RIBlobRun run;
+    RIBlob *blob;
+    int x, y, i, j, a, b, c, prev_begin = 0, prev_end = 0, len;
+
+    runs.clear();
+    parent.clear();
+    blobs.clear();
+
+    for(y = 0; y < img->height; y++) {
+        row = (const uint8_t *)img->imageData + y * img->widthStep;
+        j = prev_begin;
+        x = 0;
+        while(x < img->width) {
+            c = row[x];
+            if(c == 0) {
+                x++;
+                continue;
+            }
+
+            run.y = y;
+            run.start = x;
+            while(x < img->width && row[x] == c)
+                x++;
+            run.end = x;
+            run.color = c - 1;
+            runs.push_back(run);
+            parent.push_back(runs.size() - 1);
+
+            // The runs above that end before this one starts, minus a corner, are left of it for good
+            while(j < prev_end && runs[j].end < run.start)
+                j++;
+            // Join the runs above of the same class touching this one, the oldest run stays the root
+            for(i = j; i < prev_end && runs[i].start <= run.end; i++) {
+                if(runs[i].color != run.color)
+                    continue;
+                a = root(i);
+                b = root(runs.size() - 1);
+                if(a < b)
+                    parent[b] = a;
+                else if(b < a)
+                    parent[a] = b;
+            }
+        }
+        prev_begin = prev_end;
+        prev_end = runs.size();
+    }
+
+    // One blob per root, a root comes before the rest of its runs
+    blob_of.resize(runs.size());
+    sum_x.clear();
+    sum_y.clear();
+    for(i = 0; i < (int)runs.size(); i++) {
+        a = root(i);
+        len = runs[i].end - runs[i].start;
+        if(a == i) {
+            blob_of[i] = blobs.size();
+            blobs.resize(blobs.size() + 1);
+            blob = &blobs.back();
+            blob->color = runs[i].color;
+            blob->area = 0;
+            blob->box = cvRect(runs[i].start, runs[i].y, len, 1);
+            sum_x.push_back(0);
+            sum_y.push_back(0);
+        } else {
+            blob_of[i] = blob_of[a];
+            blob = &blobs[blob_of[i]];
+        }
+
+        blob->area += len;
+        sum_x[blob_of[i]] += (int64_t)(runs[i].start + runs[i].end - 1) * len / 2;
+        sum_y[blob_of[i]] += (int64_t)runs[i].y * len;
+        if(runs[i].start < blob->box.x) {
+            blob->box.width += blob->box.x - runs[i].start;
+            blob->box.x = runs[i].start;
+        }
+        if(runs[i].end > blob->box.x + blob->box.width)
+            blob->box.width = runs[i].end - blob->box.x;
+        blob->box.height = runs[i].y - blob->box.y + 1;
+    }
+
+    // Keep the big enough ones, in place
+    for(i = 0, j = 0; i < (int)blobs.size(); i++) {
+        if(blobs[i].area < min_area)
+            continue;
+        blobs[i].centroid = cvPoint2D32f((double)sum_x[i] / blobs[i].area, (double)sum_y[i] / blobs[i].area);
+        blobs[j++] = blobs[i];
+    }
+    blobs.resize(j);
+    return blobs;
+}
+
+const std::vector<RIBlob> &BlobExtractor::result(void) const {
+    return blobs;
+}
+
+/**
+ * @param color index of the range in setColors().
+ */
+const RIBlob *BlobExtractor::biggest(int color) const {
+    const RIBlob *big = NULL;
+    size_t i;
+
+    for(i = 0; i < blobs.size(); i++) {
+        if(blobs[i].color == color && (big == NULL || blobs[i].area > big->area))
+            big = &blobs[i];
+    }
+    return big;
+}
@@ -0,0 +1,117 @@
+/** @file bundle.cpp
+ *  @brief Frames bundled with the sensor data, see bundle.h.
+ *
+ */
+
+#include "bundle.h"
+
+#include <unistd.h>
+#include <string.h>
+
+/**
+ * @param trace the trace of the frame, from getTrace().
+ * @return the time the camera most likely took the frame, the request time if the first byte was not marked.
+ * @note The camera answers with the frame it has when the request arrives, so the capture is
+ * about half the time to the first byte after the request.
+ */
+uint64_t riTraceCaptureTime(const RITrace *trace) {
+    uint64_t request = trace->t[RI_TRACE_REQUEST];
+    uint64_t first = trace->t[RI_TRACE_FIRST_BYTE];
+
+    if(first < request)
+        return request;
+    return request + (first - request) / 2;
+}
+
+/**
+ * @param robot the robot the frames are captured from.
+ * @param odometry a started odometry of the same robot, its polls are the sensor samples.
+ * @param estimator a pose estimator on that odometry, NULL to bundle no pose.
+ */
+FrameBundler::FrameBundler(RobotInterface *robot, Odometry *odometry, PoseEstimator *estimator) {
+    this->robot = robot;
+    this->odometry = odometry;
+    this->estimator = estimator;
+    max_wait = RI_BUNDLE_DEFAULT_WAIT;
+    frame_count = 0;
+    unbracketed_count = 0;
+}
+
+/**
+ * @param us the microseconds to wait, 0 to bundle with the polls done so far.
+ */
+void FrameBundler::setMaxWait(uint64_t us) {
+    max_wait = us;
+}
+
+/**
+ * @param image the image to capture into.
+ * @param bundle filled in with the state of the robot when the frame was taken.
+ * @return RI_RESP_SUCCESS, the response of getImage() if it failed, RI_RESP_FAILURE if the odometry has no poll yet.
+ */
+int FrameBundler::capture(IplImage *image, RIBundle *bundle) {
+    RITrace trace;
+    int resp;
+
+    resp = robot->getImage(image);
+    if(resp != RI_RESP_SUCCESS)
+        return resp;
+
+    robot->getTrace(&trace);
+    resp = align(riTraceCaptureTime(&trace), bundle);
+    bundle->number = trace.frame;
+    return resp;
+}
+
+/**
+ * @param timestamp riTimestamp() the frame was taken at.
+ * @param bundle filled in with the state of the robot at that time, its number is left at 0.
+ * @return RI_RESP_SUCCESS, RI_RESP_FAILURE if the odometry has no poll yet.
+ * @note Waits up to the maximum wait for the poll after the frame. Without it the odometry
+ * is extrapolated from the latest poll, and bundle->bracketed is false.
+ */
+int FrameBundler::align(uint64_t timestamp, RIBundle *bundle) {
+    RISensorSample *nearest;
+    uint64_t deadline = riTimestamp() + max_wait;
+    int resp;
+
+    memset(bundle, 0, sizeof(RIBundle));
+    bundle->timestamp = timestamp;
+
+    // The poll after the frame is usually in flight
+    while((resp = odometry->bracket(timestamp, &(bundle->before), &(bundle->after))) == RI_RESP_BUSY &&
+            riTimestamp() < deadline)
+        usleep(RI_BUNDLE_POLL_US);
+    if(resp == RI_RESP_FAILURE)
+        return RI_RESP_FAILURE;
+
+    bundle->bracketed = resp == RI_RESP_SUCCESS;
+    if(!bundle->bracketed)
+        unbracketed_count++;
+    riOdometryInterpolate(&(bundle->before.odometry), &(bundle->after.odometry), timestamp, &(bundle->odometry));
+
+    if(timestamp - bundle->before.odometry.timestamp <= bundle->after.odometry.timestamp - timestamp)
+        nearest = &(bundle->before);
+    else
+        nearest = &(bundle->after);
+    memcpy(&(bundle->sensor), &(nearest->sensor), sizeof(RIData));
+    bundle->skew = (uint32_t)(nearest->odometry.timestamp > timestamp ?
+        nearest->odometry.timestamp - timestamp : timestamp - nearest->odometry.timestamp);
+    bundle->ir_detected = (nearest->sensor.status & RI_STATUS_IR_DETECTOR) != 0;
+
+    if(estimator != NULL) {
+        bundle->has_pose = estimator->predict(&(bundle->pose), timestamp) == RI_RESP_SUCCESS;
+        bundle->report_time = estimator->lastReport(&(bundle->report));
+    }
+
+    frame_count++;
+    return RI_RESP_SUCCESS;
+}
+
+uint32_t FrameBundler::frames(void) {
+    return frame_count;
+}
+
+uint32_t FrameBundler::unbracketed(void) {
+    return unbracketed_count;
+}
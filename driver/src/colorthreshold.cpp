@@ -0,0 +1,255 @@
+/** @file colorthreshold.cpp
+ *  @brief Several HSV color thresholds in one pass, see colorthreshold.h.
+ *
+ */
+
+#include "colorthreshold.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+// Fixed point of the OpenCV 8 bit BGR to HSV conversion, the masks match it bit for bit
+#define RI_HSV_SHIFT			12
+#define RI_HSV_ROUND			(1 << (RI_HSV_SHIFT - 1))
+#define RI_HSV_BLOCK			16      /* Pixels converted at once */
+
+/** @brief Tables of one call: the fixed point divisions and one bit per color for each H, S and V value */
+typedef struct {
+    int			sdiv[256]; /* 255 / v */
+    int			hdiv[256]; /* 180 / (6 * diff) */
+    uint8_t		h[256], s[256], v[256]; /* Bit n set if the value is in range n */
+} RIColorLut;
+
+RIColorRange riColorRange(CvScalar low, CvScalar high) {
+    RIColorRange range;
+
+    range.low = low;
+    range.high = high;
+    return range;
+}
+
+/** @brief Build the tables for the given ranges */
+static void riColorLutInit(RIColorLut *lut, const RIColorRange *ranges, int count) {
+    int i, n;
+
+    lut->sdiv[0] = 0;
+    lut->hdiv[0] = 0;
+    for(i = 1; i < 256; i++) {
+        lut->sdiv[i] = cvRound((255 << RI_HSV_SHIFT) / (1.0 * i));
+        lut->hdiv[i] = cvRound((180 << RI_HSV_SHIFT) / (6.0 * i));
+    }
+
+    for(i = 0; i < 256; i++) {
+        lut->h[i] = 0;
+        lut->s[i] = 0;
+        lut->v[i] = 0;
+        for(n = 0; n < count; n++) {
+            if(i >= ranges[n].low.val[0] && i <= ranges[n].high.val[0])
+                lut->h[i] |= 1 << n;
+            if(i >= ranges[n].low.val[1] && i <= ranges[n].high.val[1])
+                lut->s[i] |= 1 << n;
+            if(i >= ranges[n].low.val[2] && i <= ranges[n].high.val[2])
+                lut->v[i] |= 1 << n;
+        }
+    }
+}
+
+/** @brief Value, chroma and hue numerator of a pixel, like cvCvtColor() computes them */
+static inline void riHsvPrepare(int b, int g, int r, uint8_t *v, uint8_t *diff, int16_t *hnum) {
+    int max = b, min = b, d;
+
+    max = g > max ? g : max;
+    max = r > max ? r : max;
+    min = g < min ? g : min;
+    min = r < min ? r : min;
+    d = max - min;
+
+    *v = max;
+    *diff = d;
+    if(max == r)
+        *hnum = g - b;
+    else if(max == g)
+        *hnum = b - r + 2 * d;
+    else
+        *hnum = r - g + 4 * d;
+}
+
+#ifdef __SSE2__
+/** @brief riHsvPrepare() on 16 pixels */
+static inline void riHsvPrepare16(const uint8_t *src, uint8_t *v, uint8_t *diff, int16_t *hnum) {
+    __m128i t00, t01, t02, t10, t11, t12, t20, t21, t22, t30, t31, t32;
+    __m128i b, g, r, max, min, d, vr, vg, zero = _mm_setzero_si128();
+    __m128i b16, g16, r16, d16, vr16, vg16, hr, hg, hb;
+    int half;
+
+    // Deinterleave BGRBGR... into three planes with unpacks only
+    t00 = _mm_loadu_si128((const __m128i *)src);
+    t01 = _mm_loadu_si128((const __m128i *)(src + 16));
+    t02 = _mm_loadu_si128((const __m128i *)(src + 32));
+
+    t10 = _mm_unpacklo_epi8(t00, _mm_unpackhi_epi64(t01, t01));
+    t11 = _mm_unpackhi_epi8(t00, _mm_unpacklo_epi64(t02, t02));
+    t12 = _mm_unpacklo_epi8(t01, _mm_unpackhi_epi64(t02, t02));
+
+    t20 = _mm_unpacklo_epi8(t10, _mm_unpackhi_epi64(t11, t11));
+    t21 = _mm_unpackhi_epi8(t10, _mm_unpacklo_epi64(t12, t12));
+    t22 = _mm_unpacklo_epi8(t11, _mm_unpackhi_epi64(t12, t12));
+
+    t30 = _mm_unpacklo_epi8(t20, _mm_unpackhi_epi64(t21, t21));
+    t31 = _mm_unpackhi_epi8(t20, _mm_unpacklo_epi64(t22, t22));
+    t32 = _mm_unpacklo_epi8(t21, _mm_unpackhi_epi64(t22, t22));
+
+    b = _mm_unpacklo_epi8(t30, _mm_unpackhi_epi64(t31, t31));
+    g = _mm_unpackhi_epi8(t30, _mm_unpacklo_epi64(t32, t32));
+    r = _mm_unpacklo_epi8(t31, _mm_unpackhi_epi64(t32, t32));
+
+    max = _mm_max_epu8(_mm_max_epu8(b, g), r);
+    min = _mm_min_epu8(_mm_min_epu8(b, g), r);
+    d = _mm_sub_epi8(max, min);
+    vr = _mm_cmpeq_epi8(max, r);
+    vg = _mm_cmpeq_epi8(max, g);
+    _mm_storeu_si128((__m128i *)v, max);
+    _mm_storeu_si128((__m128i *)diff, d);
+
+    // The hue numerator needs 16 bits, red wins over green and green over blue
+    for(half = 0; half < 2; half++) {
+        if(half == 0) {
+            b16 = _mm_unpacklo_epi8(b, zero);
+            g16 = _mm_unpacklo_epi8(g, zero);
+            r16 = _mm_unpacklo_epi8(r, zero);
+            d16 = _mm_unpacklo_epi8(d, zero);
+            vr16 = _mm_unpacklo_epi8(vr, vr);
+            vg16 = _mm_unpacklo_epi8(vg, vg);
+        } else {
+            b16 = _mm_unpackhi_epi8(b, zero);
+            g16 = _mm_unpackhi_epi8(g, zero);
+            r16 = _mm_unpackhi_epi8(r, zero);
+            d16 = _mm_unpackhi_epi8(d, zero);
+            vr16 = _mm_unpackhi_epi8(vr, vr);
+            vg16 = _mm_unpackhi_epi8(vg, vg);
+        }
+        hr = _mm_sub_epi16(g16, b16);
+        hg = _mm_add_epi16(_mm_sub_epi16(b16, r16), _mm_slli_epi16(d16, 1));
+        hb = _mm_add_epi16(_mm_sub_epi16(r16, g16), _mm_slli_epi16(d16, 2));
+        hg = _mm_or_si128(_mm_and_si128(vg16, hg), _mm_andnot_si128(vg16, hb));
+        hr = _mm_or_si128(_mm_and_si128(vr16, hr), _mm_andnot_si128(vr16, hg));
+        _mm_storeu_si128((__m128i *)(hnum + half * 8), hr);
+    }
+}
+#endif
+
+/** @brief One bit per range for each pixel of a row, bit n set if the pixel is in range n */
+static void riColorBitsRow(const uint8_t *src, int width, const RIColorLut *lut, uint8_t *dst) {
+    uint8_t v[RI_HSV_BLOCK], diff[RI_HSV_BLOCK];
+    int16_t hnum[RI_HSV_BLOCK];
+    int x, i, len, s, h;
+    unsigned bits;
+
+    for(x = 0; x < width; x += len) {
+        len = width - x < RI_HSV_BLOCK ? width - x : RI_HSV_BLOCK;
+#ifdef __SSE2__
+        if(len == RI_HSV_BLOCK)
+            riHsvPrepare16(src + x * 3, v, diff, hnum);
+        else
+#endif
+        for(i = 0; i < len; i++)
+            riHsvPrepare(src[(x + i) * 3], src[(x + i) * 3 + 1], src[(x + i) * 3 + 2], &v[i], &diff[i], &hnum[i]);
+
+        for(i = 0; i < len; i++) {
+            s = (diff[i] * lut->sdiv[v[i]] + RI_HSV_ROUND) >> RI_HSV_SHIFT;
+            bits = lut->v[v[i]] & lut->s[s];
+            // Most pixels are too dark or too grey for every color, no need for the hue
+            if(bits != 0) {
+                h = (hnum[i] * lut->hdiv[diff[i]] + RI_HSV_ROUND) >> RI_HSV_SHIFT;
+                if(h < 0)
+                    h += 180;
+                bits &= lut->h[h];
+            }
+            dst[x + i] = bits;
+        }
+    }
+}
+
+/** @brief Check the image formats shared by riColorThreshold() and riColorClassify() */
+static int riColorCheck(const IplImage *bgr, int count, IplImage **out, int nout) {
+    int n;
+
+    if(count < 1 || count > RI_MAX_COLORS)
+        return RI_RESP_PARAM_RANGE_ERR;
+    if(bgr->depth != IPL_DEPTH_8U || bgr->nChannels != 3)
+        return RI_RESP_FAILURE;
+    for(n = 0; n < nout; n++) {
+        if(out[n]->depth != IPL_DEPTH_8U || out[n]->nChannels != 1 ||
+            out[n]->width != bgr->width || out[n]->height != bgr->height)
+            return RI_RESP_FAILURE;
+    }
+    return RI_RESP_SUCCESS;
+}
+
+/**
+ * @param bgr an 8 bit 3 plane image, as returned by getImage().
+ * @param ranges count HSV ranges, for example riColorRange(RC_PINK_LOW, RC_PINK_HIGH).
+ * @param count the number of ranges, 1 to RI_MAX_COLORS.
+ * @param masks count 8 bit 1 plane images of the size of bgr, set to 255 where the pixel is in the range and 0 elsewhere.
+ * @return RI_RESP_SUCCESS, RI_RESP_PARAM_RANGE_ERR if count is out of range, RI_RESP_FAILURE if an image has the wrong size or format.
+ * @note The hue is computed as cvCvtColor(CV_BGR2HSV) does for 8 bit images, in 0-179, so the masks are the ones of cvCvtColor() followed by cvInRangeS(). The image ROIs are ignored.
+ */
+int riColorThreshold(const IplImage *bgr, const RIColorRange *ranges, int count, IplImage **masks) {
+    RIColorLut lut;
+    uint8_t *dst[RI_MAX_COLORS];
+    unsigned bits;
+    int x, y, n, ret;
+
+    if((ret = riColorCheck(bgr, count, masks, count)) != RI_RESP_SUCCESS)
+        return ret;
+
+    riColorLutInit(&lut, ranges, count);
+    for(y = 0; y < bgr->height; y++) {
+        for(n = 0; n < count; n++)
+            dst[n] = (uint8_t *)masks[n]->imageData + y * masks[n]->widthStep;
+
+        // The first mask holds the bits until they are spread over the masks
+        riColorBitsRow((const uint8_t *)bgr->imageData + y * bgr->widthStep, bgr->width, &lut, dst[0]);
+        for(x = 0; x < bgr->width; x++) {
+            bits = dst[0][x];
+            for(n = 0; n < count; n++)
+                dst[n][x] = (uint8_t)(-(int)((bits >> n) & 1));
+        }
+    }
+    return RI_RESP_SUCCESS;
+}
+
+/**
+ * @param bgr an 8 bit 3 plane image, as returned by getImage().
+ * @param ranges count HSV ranges, the first one a pixel is in gives its class.
+ * @param count the number of ranges, 1 to RI_MAX_COLORS.
+ * @param classes an 8 bit 1 plane image of the size of bgr, set to n + 1 where the pixel is in range n and to 0 where it is in none.
+ * @return RI_RESP_SUCCESS, RI_RESP_PARAM_RANGE_ERR if count is out of range, RI_RESP_FAILURE if an image has the wrong size or format.
+ */
+int riColorClassify(const IplImage *bgr, const RIColorRange *ranges, int count, IplImage *classes) {
+    RIColorLut lut;
+    uint8_t first[1 << RI_MAX_COLORS];
+    uint8_t *dst;
+    int x, y, n, ret;
+
+    if((ret = riColorCheck(bgr, count, &classes, 1)) != RI_RESP_SUCCESS)
+        return ret;
+
+    // Class of every combination of bits, the lowest range wins
+    first[0] = 0;
+    for(x = 1; x < (1 << RI_MAX_COLORS); x++) {
+        for(n = 0; !(x & (1 << n)); n++)
+            ;
+        first[x] = n + 1;
+    }
+
+    riColorLutInit(&lut, ranges, count);
+    for(y = 0; y < bgr->height; y++) {
+        dst = (uint8_t *)classes->imageData + y * classes->widthStep;
+        riColorBitsRow((const uint8_t *)bgr->imageData + y * bgr->widthStep, bgr->width, &lut, dst);
+        for(x = 0; x < bgr->width; x++)
+            dst[x] = first[dst[x]];
+    }
+    return RI_RESP_SUCCESS;
+}
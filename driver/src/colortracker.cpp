@@ -0,0 +1,236 @@
+/** @file colortracker.cpp
+ *  @brief Hue histogram tracker, see colortracker.h.
+ *
+ */
+
+#include "colortracker.h"
+
+#include <math.h>
+
+/** @brief Intersection of a box with the frame */
+static CvRect riClipRect(CvRect r, const IplImage *frame) {
+    int x2 = r.x + r.width, y2 = r.y + r.height;
+
+    if(r.x < 0)
+        r.x = 0;
+    if(r.y < 0)
+        r.y = 0;
+    if(x2 > frame->width)
+        x2 = frame->width;
+    if(y2 > frame->height)
+        y2 = frame->height;
+    r.width = x2 > r.x ? x2 - r.x : 0;
+    r.height = y2 > r.y ? y2 - r.y : 0;
+    return r;
+}
+
+ColorTracker::ColorTracker() {
+    hist = NULL;
+    hsv = NULL;
+    hue = NULL;
+    mask = NULL;
+    backproject = NULL;
+    size = cvSize(0, 0);
+    box = cvRect(0, 0, 0, 0);
+    ellipse.center = cvPoint2D32f(0, 0);
+    ellipse.size.width = 0;
+    ellipse.size.height = 0;
+    ellipse.angle = 0;
+    ready = false;
+    found = false;
+    last_score = 0;
+    min_saturation = RI_CTRACK_MIN_SATURATION;
+}
+
+ColorTracker::~ColorTracker() {
+    release();
+    if(hist != NULL)
+        cvReleaseHist(&hist);
+}
+
+void ColorTracker::release(void) {
+    if(hsv != NULL)
+        cvReleaseImage(&hsv);
+    if(hue != NULL)
+        cvReleaseImage(&hue);
+    if(mask != NULL)
+        cvReleaseImage(&mask);
+    if(backproject != NULL)
+        cvReleaseImage(&backproject);
+    size = cvSize(0, 0);
+}
+
+void ColorTracker::setMinSaturation(int saturation) {
+    min_saturation = saturation;
+}
+
+/**
+ * @brief Convert an area of the frame to hue and mask out the pixels without a meaningful hue
+ *
+ * The work images only grow, their region is set to the size of the area, so the results
+ * are in area coordinates.
+ */
+void ColorTracker::prepare(const IplImage *frame, CvRect area) {
+    CvSize sz = cvSize(area.width, area.height);
+    CvRect roi = cvRect(0, 0, sz.width, sz.height);
+
+    if(sz.width > size.width || sz.height > size.height) {
+        CvSize alloc = cvSize(sz.width > size.width ? sz.width : size.width, sz.height > size.height ? sz.height : size.height);
+
+        release();
+        hsv = cvCreateImage(alloc, IPL_DEPTH_8U, 3);
+        hue = cvCreateImage(alloc, IPL_DEPTH_8U, 1);
+        mask = cvCreateImage(alloc, IPL_DEPTH_8U, 1);
+        backproject = cvCreateImage(alloc, IPL_DEPTH_8U, 1);
+        size = alloc;
+    }
+    cvSetImageROI(hsv, roi);
+    cvSetImageROI(hue, roi);
+    cvSetImageROI(mask, roi);
+    cvSetImageROI(backproject, roi);
+
+    // Work on the area in place
+    cvInitImageHeader(&view, sz, frame->depth, frame->nChannels);
+    view.widthStep = frame->widthStep;
+    view.imageData = frame->imageData + area.y * frame->widthStep + area.x * frame->nChannels;
+    view.imageSize = sz.height * frame->widthStep;
+
+    cvCvtColor(&view, hsv, CV_BGR2HSV);
+    cvInRangeS(hsv, cvScalar(0, min_saturation, RI_CTRACK_MIN_VALUE, 0), cvScalar(180, 255, RI_CTRACK_MAX_VALUE, 0), mask);
+    cvSplit(hsv, hue, NULL, NULL, NULL);
+}
+
+/**
+ * @param frame a BGR frame.
+ * @param box the target in the frame, clipped to it.
+ * @return RI_RESP_SUCCESS, RI_RESP_PARAM_RANGE_ERR if the box is too small, RI_RESP_FAILURE if nothing in the box has a color.
+ */
+int ColorTracker::init(const IplImage *frame, CvRect box) {
+    int bins = RI_CTRACK_BINS;
+    float range[] = {0, 180};
+    float *ranges[] = {range};
+    float max = 0;
+
+    box = riClipRect(box, frame);
+    if(box.width < RI_CTRACK_MIN_SIZE || box.height < RI_CTRACK_MIN_SIZE)
+        return RI_RESP_PARAM_RANGE_ERR;
+
+    prepare(frame, box);
+    if(hist == NULL)
+        hist = cvCreateHist(1, &bins, CV_HIST_ARRAY, ranges, 1);
+    cvCalcHist(&hue, hist, 0, mask);
+
+    // Scale the model so that the back-projection of its main hue is 255
+    cvGetMinMaxHistValue(hist, NULL, &max, NULL, NULL);
+    if(max <= 0) {
+        ready = false;
+        found = false;
+        return RI_RESP_FAILURE;
+    }
+    cvConvertScale(hist->bins, hist->bins, 255.0 / max, 0);
+
+    this->box = box;
+    ready = true;
+    found = true;
+    last_score = 1;
+    return RI_RESP_SUCCESS;
+}
+
+/**
+ * @param frame a BGR frame.
+ * @param square a square of that frame.
+ * @return see init().
+ */
+int ColorTracker::init(const IplImage *frame, const RISquare &square) {
+    return init(frame, square.box);
+}
+
+/**
+ * @param frame a BGR frame.
+ * @param square a square of that frame, only its center and area are known so the box is the upright square of that area.
+ * @return see init(), RI_RESP_NO_PARAM if square is NULL.
+ */
+int ColorTracker::init(const IplImage *frame, const SquaresType *square) {
+    int side;
+
+    if(square == NULL)
+        return RI_RESP_NO_PARAM;
+    side = (int)(sqrt((double)square->area) + 0.5);
+    return init(frame, cvRect(square->center.x - side / 2, square->center.y - side / 2, side, side));
+}
+
+bool ColorTracker::isReady(void) {
+    return ready;
+}
+
+/**
+ * @param frame the next BGR frame.
+ * @param bbnext set to the box of the target, the last known one if it was lost.
+ * @param lastboxfound set to true if the target was found in this frame.
+ * @param bb_file if not NULL, gets "x1,y1,x2,y2,score" or "NaN,NaN,NaN,NaN,NaN" like the TLD bounding box file.
+ * @return RI_RESP_SUCCESS, RI_RESP_FAILURE if no target was learned.
+ * @note Only the box grown by RI_CTRACK_MARGIN on each side is searched while the target is found, the whole frame once it is lost.
+ */
+int ColorTracker::processFrame(const IplImage *frame, CvRect *bbnext, bool *lastboxfound, FILE *bb_file) {
+    CvConnectedComp comp;
+    CvRect area, window;
+    int mw, mh;
+
+    if(!isReady()) {
+        *lastboxfound = false;
+        return RI_RESP_FAILURE;
+    }
+
+    if(found) {
+        mw = (int)(box.width * RI_CTRACK_MARGIN) + 1;
+        mh = (int)(box.height * RI_CTRACK_MARGIN) + 1;
+        area = riClipRect(cvRect(box.x - mw, box.y - mh, box.width + 2 * mw, box.height + 2 * mh), frame);
+        window = riClipRect(box, frame);
+        window.x -= area.x;
+        window.y -= area.y;
+    } else {
+        area = cvRect(0, 0, frame->width, frame->height);
+        window = area;
+    }
+    if(window.width < 1 || window.height < 1) {
+        area = cvRect(0, 0, frame->width, frame->height);
+        window = area;
+    }
+
+    // Probability of each pixel to be the target, only where the hue means something
+    prepare(frame, area);
+    cvCalcBackProject(&hue, backproject, hist);
+    cvAnd(backproject, mask, backproject, NULL);
+
+    cvCamShift(backproject, window, cvTermCriteria(CV_TERMCRIT_EPS | CV_TERMCRIT_ITER, 10, 1), &comp, &ellipse);
+    comp.rect.x += area.x;
+    comp.rect.y += area.y;
+    ellipse.center.x += area.x;
+    ellipse.center.y += area.y;
+
+    if(comp.rect.width >= RI_CTRACK_MIN_SIZE && comp.rect.height >= RI_CTRACK_MIN_SIZE)
+        last_score = comp.area / (255.0 * comp.rect.width * comp.rect.height);
+    else
+        last_score = 0;
+    found = last_score >= RI_CTRACK_MIN_SCORE;
+    if(found)
+        box = comp.rect;
+
+    *bbnext = box;
+    *lastboxfound = found;
+    if(bb_file != NULL) {
+        if(found)
+            fprintf(bb_file, "%d,%d,%d,%d,%f\n", box.x, box.y, box.x + box.width, box.y + box.height, last_score);
+        else
+            fprintf(bb_file, "NaN,NaN,NaN,NaN,NaN\n");
+    }
+    return RI_RESP_SUCCESS;
+}
+
+CvBox2D ColorTracker::getEllipse(void) {
+    return ellipse;
+}
+
+double ColorTracker::score(void) {
+    return last_score;
+}
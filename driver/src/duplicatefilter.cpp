@@ -0,0 +1,135 @@
+/** @file duplicatefilter.cpp
+ *  @brief Detection of repeated camera frames, see duplicatefilter.h.
+ *
+ */
+
+#include "duplicatefilter.h"
+
+#include <string.h>
+#include <stdlib.h>
+
+/** @brief 64 bit FNV-1a of the bytes */
+static uint64_t riHashBytes(const unsigned char *p, int size) {
+    uint64_t h = 14695981039346656037ULL;
+    int i;
+
+    for(i = 0; i < size; i++) {
+        h ^= p[i];
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+/**
+ * @param level the change of a block mean, out of 255, over which the block changed.
+ * @param blocks the number of changed blocks a near duplicate may have.
+ */
+DuplicateFilter::DuplicateFilter(int level, int blocks) {
+    this->level = level;
+    this->blocks = blocks;
+    reference = NULL;
+    dc = NULL;
+    frame_count = 0;
+    same_count = 0;
+    similar_count = 0;
+    reset();
+}
+
+DuplicateFilter::~DuplicateFilter() {
+    if(reference != NULL)
+        cvReleaseImage(&reference);
+    if(dc != NULL)
+        cvReleaseImage(&dc);
+}
+
+void DuplicateFilter::setThreshold(int level, int blocks) {
+    this->level = level;
+    this->blocks = blocks;
+}
+
+void DuplicateFilter::reset(void) {
+    last_hash = 0;
+    last_size = 0;
+    // The reference is only trusted after a new frame was decoded into it
+    if(reference != NULL)
+        cvReleaseImage(&reference);
+}
+
+/**
+ * @param jpeg the bytes of the frame, as the camera sent them.
+ * @param size the number of bytes.
+ * @return RI_DUP_SAME or RI_DUP_SIMILAR if the last results still hold, RI_DUP_NEW if the frame must be processed.
+ * @note Near duplicates are compared to the last new frame, not to the frame before, so a slow drift is still caught.
+ */
+int DuplicateFilter::check(const unsigned char *jpeg, int size) {
+    uint64_t hash = riHashBytes(jpeg, size);
+    CvSize full, small;
+    IplImage *swap;
+    int x, y, d, changed = 0;
+
+    frame_count++;
+    if(size == last_size && hash == last_hash) {
+        same_count++;
+        return RI_DUP_SAME;
+    }
+    last_size = size;
+    last_hash = hash;
+
+    if(level < 0 || riJpegSize(jpeg, size, &full) != RI_RESP_SUCCESS)
+        return RI_DUP_NEW;
+
+    // One pixel per 8x8 block
+    small = cvSize((full.width + 7) / 8, (full.height + 7) / 8);
+    if(dc == NULL || dc->width != small.width || dc->height != small.height) {
+        if(dc != NULL)
+            cvReleaseImage(&dc);
+        dc = cvCreateImage(small, IPL_DEPTH_8U, 1);
+        if(reference != NULL)
+            cvReleaseImage(&reference);
+    }
+    if(riDecodeJpegDC(jpeg, size, dc) != RI_RESP_SUCCESS) {
+        if(reference != NULL)
+            cvReleaseImage(&reference);
+        return RI_DUP_NEW;
+    }
+
+    if(reference != NULL) {
+        for(y = 0; y < small.height && changed <= blocks; y++) {
+            const unsigned char *a = (const unsigned char *)(dc->imageData + y * dc->widthStep);
+            const unsigned char *b = (const unsigned char *)(reference->imageData + y * reference->widthStep);
+            for(x = 0; x < small.width; x++) {
+                d = abs(a[x] - b[x]);
+                if(d > level)
+                    changed++;
+            }
+        }
+        if(changed <= blocks) {
+            similar_count++;
+            return RI_DUP_SIMILAR;
+        }
+    } else {
+        reference = cvCreateImage(small, IPL_DEPTH_8U, 1);
+    }
+
+    // This frame is the reference of the next ones
+    swap = reference;
+    reference = dc;
+    dc = swap;
+    return RI_DUP_NEW;
+}
+
+uint32_t DuplicateFilter::frames(void) {
+    return frame_count;
+}
+
+uint32_t DuplicateFilter::skipped(void) {
+    return same_count + similar_count;
+}
+
+uint32_t DuplicateFilter::same(void) {
+    return same_count;
+}
+
+uint32_t DuplicateFilter::similar(void) {
+    return similar_count;
+}
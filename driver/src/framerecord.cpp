@@ -0,0 +1,375 @@
+/** @file framerecord.cpp
+ *  @brief Indexed recording writer and player, see framerecord.h.
+ *
+ */
+
+#include "framerecord.h"
+
+#include <unistd.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/** @brief write() all of buf, retrying short writes */
+static int riWriteAll(int fd, const void *buf, size_t len) {
+    const char *p = (const char *)buf;
+    ssize_t done;
+
+    while(len > 0) {
+        done = write(fd, p, len);
+        if(done < 0) {
+            if(errno == EINTR)
+                continue;
+            return RI_RESP_FAILURE;
+        }
+        p += done;
+        len -= done;
+    }
+    return RI_RESP_SUCCESS;
+}
+
+/**********************************************************
+ * Writer
+ **********************************************************/
+FrameRecorder::FrameRecorder() {
+    data_fd = -1;
+    index_fd = -1;
+    offset = 0;
+    frames = 0;
+}
+
+FrameRecorder::~FrameRecorder() {
+    close();
+}
+
+/**
+ * @param path the data file, the index is written to path.idx. Existing files are overwritten.
+ * @return RI_RESP_SUCCESS or RI_RESP_FAILURE.
+ */
+int FrameRecorder::open(const char *path) {
+    char index_path[RI_REC_MAX_PATH + sizeof(RI_REC_INDEX_SUFFIX)];
+    RIRecordHeader header;
+
+    close();
+    if(strlen(path) >= RI_REC_MAX_PATH)
+        return RI_RESP_PARAM_RANGE_ERR;
+    sprintf(index_path, "%s%s", path, RI_REC_INDEX_SUFFIX);
+
+    data_fd = ::open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if(data_fd == -1) {
+        perror("Unable to create the recording.");
+        return RI_RESP_FAILURE;
+    }
+    index_fd = ::open(index_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if(index_fd == -1) {
+        perror("Unable to create the recording index.");
+        close();
+        return RI_RESP_FAILURE;
+    }
+
+    memset(&header, 0, sizeof(header));
+    header.magic = RI_REC_MAGIC;
+    header.version = RI_REC_VERSION;
+    header.entry_size = sizeof(RIFrameEntry);
+    header.created = riTimestamp();
+    if(riWriteAll(index_fd, &header, sizeof(header)) != RI_RESP_SUCCESS) {
+        perror("Unable to write the recording index.");
+        close();
+        return RI_RESP_FAILURE;
+    }
+    return RI_RESP_SUCCESS;
+}
+
+/**
+ * @return RI_RESP_SUCCESS.
+ */
+int FrameRecorder::close(void) {
+    if(data_fd != -1)
+        ::close(data_fd);
+    if(index_fd != -1)
+        ::close(index_fd);
+    data_fd = -1;
+    index_fd = -1;
+    offset = 0;
+    frames = 0;
+    return RI_RESP_SUCCESS;
+}
+
+bool FrameRecorder::isOpen(void) {
+    return index_fd != -1;
+}
+
+/**
+ * @param jpeg the bytes of the JPEG file.
+ * @param size the number of bytes.
+ * @param timestamp riTimestamp() when the image was requested.
+ * @param sensor the sensor data to store, may be NULL.
+ * @param report the report to store, may be NULL.
+ * @return RI_RESP_SUCCESS, RI_RESP_FAILURE if nothing is open or the disk refused the frame.
+ * @note The frame goes to the data file first, so a reader never finds an entry without its frame.
+ */
+int FrameRecorder::record(const unsigned char *jpeg, int size, uint64_t timestamp, const RIData *sensor, const RIReport *report) {
+    RIFrameEntry entry;
+
+    if(index_fd == -1 || jpeg == NULL || size <= 0)
+        return RI_RESP_FAILURE;
+
+    memset(&entry, 0, sizeof(entry));
+    entry.timestamp = timestamp;
+    entry.offset = offset;
+    entry.size = size;
+    entry.number = frames;
+    if(sensor != NULL)
+        memcpy(&entry.sensor, sensor, sizeof(RIData));
+    if(report != NULL)
+        memcpy(&entry.report, report, sizeof(RIReport));
+
+    if(riWriteAll(data_fd, jpeg, size) != RI_RESP_SUCCESS) {
+        perror("Unable to write a frame.");
+        // Keep the offsets of the next entries right
+        offset = lseek(data_fd, 0, SEEK_END);
+        return RI_RESP_FAILURE;
+    }
+    offset += size;
+    if(riWriteAll(index_fd, &entry, sizeof(entry)) != RI_RESP_SUCCESS) {
+        perror("Unable to write the recording index.");
+        return RI_RESP_FAILURE;
+    }
+    frames++;
+    return RI_RESP_SUCCESS;
+}
+
+uint32_t FrameRecorder::count(void) {
+    return frames;
+}
+
+/**********************************************************
+ * Player
+ **********************************************************/
+FramePlayer::FramePlayer() {
+    data_fd = -1;
+    index_fd = -1;
+    data = NULL;
+    data_size = 0;
+    header = NULL;
+    entries = NULL;
+    index_size = 0;
+    frames = 0;
+    position = 0;
+    loop = false;
+}
+
+FramePlayer::~FramePlayer() {
+    close();
+}
+
+/**
+ * @param path the data file written by FrameRecorder, the index is read from path.idx.
+ * @return RI_RESP_SUCCESS, RI_RESP_FAILURE if the files can't be read or are not a recording.
+ * @note A recording cut short (the recorder did not close it) is played up to its last complete frame.
+ */
+int FramePlayer::open(const char *path) {
+    char index_path[RI_REC_MAX_PATH + sizeof(RI_REC_INDEX_SUFFIX)];
+    struct stat st;
+    void *map;
+
+    close();
+    if(strlen(path) >= RI_REC_MAX_PATH)
+        return RI_RESP_PARAM_RANGE_ERR;
+    sprintf(index_path, "%s%s", path, RI_REC_INDEX_SUFFIX);
+
+    index_fd = ::open(index_path, O_RDONLY);
+    if(index_fd == -1) {
+        perror("Unable to open the recording index.");
+        return RI_RESP_FAILURE;
+    }
+    if(fstat(index_fd, &st) == -1 || (size_t)st.st_size < sizeof(RIRecordHeader)) {
+        printf("Not a recording: %s\n", path);
+        close();
+        return RI_RESP_FAILURE;
+    }
+    index_size = st.st_size;
+    map = mmap(NULL, index_size, PROT_READ, MAP_SHARED, index_fd, 0);
+    if(map == MAP_FAILED) {
+        perror("Unable to map the recording index.");
+        close();
+        return RI_RESP_FAILURE;
+    }
+    header = (const RIRecordHeader *)map;
+    entries = (const RIFrameEntry *)(header + 1);
+    if(header->magic != RI_REC_MAGIC || header->version != RI_REC_VERSION ||
+            header->entry_size != sizeof(RIFrameEntry)) {
+        printf("Not a recording: %s\n", path);
+        close();
+        return RI_RESP_FAILURE;
+    }
+    frames = (index_size - sizeof(RIRecordHeader)) / sizeof(RIFrameEntry);
+
+    data_fd = ::open(path, O_RDONLY);
+    if(data_fd == -1 || fstat(data_fd, &st) == -1) {
+        perror("Unable to open the recording.");
+        close();
+        return RI_RESP_FAILURE;
+    }
+    data_size = st.st_size;
+    if(data_size > 0) {
+        map = mmap(NULL, data_size, PROT_READ, MAP_SHARED, data_fd, 0);
+        if(map == MAP_FAILED) {
+            perror("Unable to map the recording.");
+            close();
+            return RI_RESP_FAILURE;
+        }
+        data = (const unsigned char *)map;
+        // Played one after the other
+        madvise(map, data_size, MADV_SEQUENTIAL);
+    }
+
+    // Drop the entries of frames that did not make it to the data file
+    while(frames > 0 && entries[frames - 1].offset + entries[frames - 1].size > data_size)
+        frames--;
+    return RI_RESP_SUCCESS;
+}
+
+/**
+ * @return RI_RESP_SUCCESS.
+ */
+int FramePlayer::close(void) {
+    if(data != NULL)
+        munmap((void *)data, data_size);
+    if(header != NULL)
+        munmap((void *)header, index_size);
+    if(data_fd != -1)
+        ::close(data_fd);
+    if(index_fd != -1)
+        ::close(index_fd);
+    data_fd = -1;
+    index_fd = -1;
+    data = NULL;
+    data_size = 0;
+    header = NULL;
+    entries = NULL;
+    index_size = 0;
+    frames = 0;
+    position = 0;
+    return RI_RESP_SUCCESS;
+}
+
+bool FramePlayer::isOpen(void) {
+    return header != NULL;
+}
+
+uint32_t FramePlayer::count(void) {
+    return frames;
+}
+
+uint64_t FramePlayer::created(void) {
+    if(header == NULL)
+        return 0;
+    return header->created;
+}
+
+/**
+ * @return the size of the first frame, 0x0 if there is none or it is not a JPEG.
+ * @note Use it to allocate the image given to next().
+ */
+CvSize FramePlayer::frameSize(void) {
+    CvSize size = cvSize(0, 0);
+
+    if(frames > 0)
+        riJpegSize(data + entries[0].offset, entries[0].size, &size);
+    return size;
+}
+
+const RIFrameEntry *FramePlayer::entry(uint32_t i) {
+    if(i >= frames)
+        return NULL;
+    return &entries[i];
+}
+
+/**
+ * @param i the frame number.
+ * @param data set to the JPEG bytes, valid until close().
+ * @param size set to the number of bytes.
+ * @return RI_RESP_SUCCESS, RI_RESP_PARAM_RANGE_ERR if there is no such frame.
+ */
+int FramePlayer::jpeg(uint32_t i, const unsigned char **data, int *size) {
+    if(i >= frames)
+        return RI_RESP_PARAM_RANGE_ERR;
+    *data = this->data + entries[i].offset;
+    *size = entries[i].size;
+    return RI_RESP_SUCCESS;
+}
+
+/**
+ * @param i the frame number.
+ * @param image a BGR image of frameSize().
+ * @return RI_RESP_SUCCESS, RI_RESP_PARAM_RANGE_ERR if there is no such frame, RI_RESP_FAILURE if it can't be decoded into image.
+ */
+int FramePlayer::frame(uint32_t i, IplImage *image) {
+    if(i >= frames)
+        return RI_RESP_PARAM_RANGE_ERR;
+    return riDecodeJpeg(data + entries[i].offset, entries[i].size, image);
+}
+
+/**
+ * @return RI_RESP_SUCCESS, RI_RESP_PARAM_RANGE_ERR if there is no such frame.
+ */
+int FramePlayer::seek(uint32_t i) {
+    if(i >= frames)
+        return RI_RESP_PARAM_RANGE_ERR;
+    position = i;
+    return RI_RESP_SUCCESS;
+}
+
+/**
+ * @param us the time from the first frame, in microseconds.
+ * @return RI_RESP_SUCCESS, RI_RESP_PARAM_RANGE_ERR if the recording ends before.
+ */
+int FramePlayer::seekTime(uint64_t us) {
+    uint32_t low = 0, high = frames, mid;
+    uint64_t t;
+
+    if(frames == 0)
+        return RI_RESP_PARAM_RANGE_ERR;
+
+    // First entry at or after t, the timestamps only grow
+    t = entries[0].timestamp + us;
+    while(low < high) {
+        mid = low + (high - low) / 2;
+        if(entries[mid].timestamp < t)
+            low = mid + 1;
+        else
+            high = mid;
+    }
+    return seek(low);
+}
+
+uint32_t FramePlayer::tell(void) {
+    return position;
+}
+
+void FramePlayer::setLoop(bool loop) {
+    this->loop = loop;
+}
+
+/**
+ * @param image a BGR image of frameSize().
+ * @param entry set to the index entry of the frame if not NULL, for its timestamp and sensor data.
+ * @return RI_RESP_SUCCESS, RI_RESP_FAILURE at the end of the recording or if the frame can't be decoded.
+ */
+int FramePlayer::next(IplImage *image, const RIFrameEntry **entry) {
+    uint32_t i;
+
+    if(position >= frames) {
+        if(!loop || frames == 0)
+            return RI_RESP_FAILURE;
+        position = 0;
+    }
+    i = position++;
+    if(entry != NULL)
+        *entry = &entries[i];
+    return riDecodeJpeg(data + entries[i].offset, entries[i].size, image);
+}
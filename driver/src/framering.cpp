@@ -0,0 +1,394 @@
+/** @file framering.cpp
+ *  @brief Shared memory frame ring writer and reader, see framering.h.
+ *
+ */
+
+#include "framering.h"
+
+#include <unistd.h>
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define RI_SHM_ROUND(x) (((x) + RI_SHM_ALIGN - 1) / RI_SHM_ALIGN * RI_SHM_ALIGN)
+
+/** @brief Bytes per row of an 8 bit image, aligned like cvCreateImage() does */
+static uint32_t riShmStep(uint32_t width, uint32_t channels) {
+    return (width * channels + 3) & ~3;
+}
+
+/**********************************************************
+ * Writer
+ **********************************************************/
+FrameRingWriter::FrameRingWriter() {
+    name[0] = '\0';
+    fd = -1;
+    header = NULL;
+    size = 0;
+    current = NULL;
+}
+
+FrameRingWriter::~FrameRingWriter() {
+    close();
+}
+
+RIShmSlot *FrameRingWriter::slot(uint64_t i) {
+    return (RIShmSlot *)((char *)header + RI_SHM_ROUND(sizeof(RIShmHeader)) + (i % header->slots) * header->slot_size);
+}
+
+/**
+ * @param name the shared memory object, "/rovio-camera" for example. An older ring of that name is removed.
+ * @param max_size the largest frame that will be published.
+ * @param channels the most channels a frame will have, 3 for BGR.
+ * @param slots the number of frames in the ring, at least 2.
+ * @return RI_RESP_SUCCESS, RI_RESP_PARAM_RANGE_ERR for a bad name or size, RI_RESP_FAILURE if the object can't be created.
+ */
+int FrameRingWriter::create(const char *name, CvSize max_size, int channels, uint32_t slots) {
+    uint32_t image_offset, slot_size;
+    void *map;
+
+    close();
+    if(name[0] != '/' || strlen(name) >= RI_SHM_MAX_NAME)
+        return RI_RESP_PARAM_RANGE_ERR;
+    if(max_size.width <= 0 || max_size.height <= 0 || channels <= 0 || slots < 2)
+        return RI_RESP_PARAM_RANGE_ERR;
+
+    image_offset = RI_SHM_ROUND(sizeof(RIShmSlot));
+    slot_size = image_offset + RI_SHM_ROUND(riShmStep(max_size.width, channels) * max_size.height);
+
+    // Readers of an older ring keep it until they close it
+    shm_unlink(name);
+    fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0644);
+    if(fd == -1) {
+        perror("Unable to create the frame ring.");
+        return RI_RESP_FAILURE;
+    }
+    strcpy(this->name, name);
+
+    size = RI_SHM_ROUND(sizeof(RIShmHeader)) + (size_t)slots * slot_size;
+    if(ftruncate(fd, size) == -1) {
+        perror("Unable to size the frame ring.");
+        close();
+        return RI_RESP_FAILURE;
+    }
+    map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if(map == MAP_FAILED) {
+        perror("Unable to map the frame ring.");
+        size = 0;
+        close();
+        return RI_RESP_FAILURE;
+    }
+
+    // ftruncate() zeroed it, every slot counter starts even
+    header = (RIShmHeader *)map;
+    header->version = RI_SHM_VERSION;
+    header->slots = slots;
+    header->slot_size = slot_size;
+    header->width = max_size.width;
+    header->height = max_size.height;
+    header->channels = channels;
+    header->image_offset = image_offset;
+    header->created = riTimestamp();
+    header->written = 0;
+    __atomic_store_n(&(header->magic), RI_SHM_MAGIC, __ATOMIC_RELEASE);
+    return RI_RESP_SUCCESS;
+}
+
+/**
+ * @return RI_RESP_SUCCESS.
+ */
+int FrameRingWriter::close(void) {
+    if(header != NULL)
+        munmap(header, size);
+    if(fd != -1) {
+        ::close(fd);
+        shm_unlink(name);
+    }
+    name[0] = '\0';
+    fd = -1;
+    header = NULL;
+    size = 0;
+    current = NULL;
+    return RI_RESP_SUCCESS;
+}
+
+bool FrameRingWriter::isOpen(void) {
+    return header != NULL;
+}
+
+/**
+ * @param size the size of the frame.
+ * @param channels its channels.
+ * @return an 8 bit image on the next slot, valid until commit() or cancel(), NULL if the frame doesn't fit in a slot.
+ * @note The slot is the oldest of the ring, its readers see their frame turn invalid from here.
+ */
+IplImage *FrameRingWriter::begin(CvSize size, int channels) {
+    RIShmSlot *s;
+
+    if(header == NULL || size.width <= 0 || size.height <= 0 || channels <= 0)
+        return NULL;
+    if((uint64_t)riShmStep(size.width, channels) * size.height > header->slot_size - header->image_offset)
+        return NULL;
+    if(current != NULL)
+        cancel();
+
+    // Odd while the slot is written, the stores to the slot can't move before this one
+    s = slot(header->written);
+    __atomic_store_n(&(s->seq), s->seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+
+    s->width = size.width;
+    s->height = size.height;
+    s->channels = channels;
+    s->step = riShmStep(size.width, channels);
+    cvInitImageHeader(&view, size, IPL_DEPTH_8U, channels);
+    view.widthStep = s->step;
+    view.imageData = (char *)s + header->image_offset;
+    current = s;
+    return &view;
+}
+
+/**
+ * @param timestamp riTimestamp() of the capture.
+ * @param sensor the sensor data to publish with the frame, may be NULL.
+ * @param report the report to publish with the frame, may be NULL.
+ * @return RI_RESP_SUCCESS, RI_RESP_FAILURE if begin() was not called.
+ */
+int FrameRingWriter::commit(uint64_t timestamp, const RIData *sensor, const RIReport *report) {
+    RIShmSlot *s = current;
+
+    if(s == NULL)
+        return RI_RESP_FAILURE;
+
+    s->number = header->written;
+    s->timestamp = timestamp;
+    if(sensor != NULL)
+        memcpy(&(s->sensor), sensor, sizeof(RIData));
+    else
+        memset(&(s->sensor), 0, sizeof(RIData));
+    if(report != NULL)
+        memcpy(&(s->report), report, sizeof(RIReport));
+    else
+        memset(&(s->report), 0, sizeof(RIReport));
+
+    // Even again once the frame is complete, then make it the latest
+    __atomic_store_n(&(s->seq), s->seq + 1, __ATOMIC_RELEASE);
+    __atomic_store_n(&(header->written), header->written + 1, __ATOMIC_RELEASE);
+    current = NULL;
+    return RI_RESP_SUCCESS;
+}
+
+void FrameRingWriter::cancel(void) {
+    if(current == NULL)
+        return;
+    // The old frame of the slot is damaged, the counter moved on so its readers know it
+    __atomic_store_n(&(current->seq), current->seq + 1, __ATOMIC_RELEASE);
+    current = NULL;
+}
+
+/**
+ * @param image an 8 bit frame that fits in a slot.
+ * @param timestamp riTimestamp() of the capture.
+ * @param sensor the sensor data to publish with the frame, may be NULL.
+ * @param report the report to publish with the frame, may be NULL.
+ * @return RI_RESP_SUCCESS, RI_RESP_PARAM_RANGE_ERR if the frame doesn't fit in a slot.
+ */
+int FrameRingWriter::publish(const IplImage *image, uint64_t timestamp, const RIData *sensor, const RIReport *report) {
+    IplImage *dst;
+    int y;
+
+    if(image->depth != IPL_DEPTH_8U)
+        return RI_RESP_PARAM_RANGE_ERR;
+    dst = begin(cvSize(image->width, image->height), image->nChannels);
+    if(dst == NULL)
+        return RI_RESP_PARAM_RANGE_ERR;
+    for(y = 0; y < image->height; y++)
+        memcpy(dst->imageData + y * dst->widthStep, image->imageData + y * image->widthStep, image->width * image->nChannels);
+    return commit(timestamp, sensor, report);
+}
+
+uint64_t FrameRingWriter::count(void) {
+    if(header == NULL)
+        return 0;
+    return header->written;
+}
+
+/**********************************************************
+ * Reader
+ **********************************************************/
+FrameRingReader::FrameRingReader() {
+    fd = -1;
+    header = NULL;
+    size = 0;
+    torn_count = 0;
+}
+
+FrameRingReader::~FrameRingReader() {
+    close();
+}
+
+const RIShmSlot *FrameRingReader::slot(uint64_t i) {
+    return (const RIShmSlot *)((const char *)header + RI_SHM_ROUND(sizeof(RIShmHeader)) + (i % header->slots) * header->slot_size);
+}
+
+/**
+ * @param name the shared memory object the writer created.
+ * @return RI_RESP_SUCCESS, RI_RESP_FAILURE if there is no such ring or it is not ready yet.
+ */
+int FrameRingReader::open(const char *name) {
+    struct stat st;
+    void *map;
+
+    close();
+    fd = shm_open(name, O_RDONLY, 0);
+    if(fd == -1) {
+        perror("Unable to open the frame ring.");
+        return RI_RESP_FAILURE;
+    }
+    if(fstat(fd, &st) == -1 || (size_t)st.st_size < sizeof(RIShmHeader)) {
+        printf("Not a frame ring: %s\n", name);
+        close();
+        return RI_RESP_FAILURE;
+    }
+    size = st.st_size;
+    map = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+    if(map == MAP_FAILED) {
+        perror("Unable to map the frame ring.");
+        size = 0;
+        close();
+        return RI_RESP_FAILURE;
+    }
+    header = (const RIShmHeader *)map;
+    if(__atomic_load_n(&(header->magic), __ATOMIC_ACQUIRE) != RI_SHM_MAGIC || header->version != RI_SHM_VERSION ||
+            header->slots < 2 || RI_SHM_ROUND(sizeof(RIShmHeader)) + (size_t)header->slots * header->slot_size > size) {
+        printf("Not a frame ring: %s\n", name);
+        close();
+        return RI_RESP_FAILURE;
+    }
+    return RI_RESP_SUCCESS;
+}
+
+/**
+ * @return RI_RESP_SUCCESS.
+ */
+int FrameRingReader::close(void) {
+    if(header != NULL)
+        munmap((void *)header, size);
+    if(fd != -1)
+        ::close(fd);
+    fd = -1;
+    header = NULL;
+    size = 0;
+    return RI_RESP_SUCCESS;
+}
+
+bool FrameRingReader::isOpen(void) {
+    return header != NULL;
+}
+
+uint64_t FrameRingReader::count(void) {
+    if(header == NULL)
+        return 0;
+    return __atomic_load_n(&(header->written), __ATOMIC_ACQUIRE);
+}
+
+/**
+ * @param after the count() of the last frame used, 0 for the first frame.
+ * @param timeout_ms the longest wait, negative to wait for ever.
+ * @return RI_RESP_SUCCESS, RI_RESP_FAILURE on timeout or if no ring is mapped.
+ * @note The writer doesn't signal the readers, this polls every millisecond.
+ */
+int FrameRingReader::wait(uint64_t after, int timeout_ms) {
+    uint64_t end = riTimestamp() + (uint64_t)timeout_ms * 1000;
+
+    if(header == NULL)
+        return RI_RESP_FAILURE;
+    while(count() <= after) {
+        if(timeout_ms >= 0 && riTimestamp() >= end)
+            return RI_RESP_FAILURE;
+        usleep(1000);
+    }
+    return RI_RESP_SUCCESS;
+}
+
+/**
+ * @param frame filled with the latest frame, its image points into the ring.
+ * @return RI_RESP_SUCCESS, RI_RESP_FAILURE if nothing was published yet, RI_RESP_BUSY if the writer kept overtaking the read.
+ * @note Check valid() once done with the pixels, the writer may have come back to the slot meanwhile.
+ */
+int FrameRingReader::latest(RIShmFrame *frame) {
+    const RIShmSlot *s;
+    uint64_t written;
+    int i;
+
+    if(header == NULL)
+        return RI_RESP_FAILURE;
+
+    for(i = 0; i < RI_SHM_RETRIES; i++) {
+        written = count();
+        if(written == 0)
+            return RI_RESP_FAILURE;
+        s = slot(written - 1);
+
+        frame->seq = __atomic_load_n(&(s->seq), __ATOMIC_ACQUIRE);
+        if(frame->seq & 1)
+            continue;
+        frame->number = s->number;
+        frame->timestamp = s->timestamp;
+        memcpy(&(frame->sensor), (const void *)&(s->sensor), sizeof(RIData));
+        memcpy(&(frame->report), (const void *)&(s->report), sizeof(RIReport));
+        cvInitImageHeader(&(frame->image), cvSize(s->width, s->height), IPL_DEPTH_8U, s->channels);
+        frame->image.widthStep = s->step;
+        frame->image.imageData = (char *)s + header->image_offset;
+        frame->slot = s;
+        if(valid(frame))
+            return RI_RESP_SUCCESS;
+    }
+    torn_count++;
+    return RI_RESP_BUSY;
+}
+
+/**
+ * @param frame a frame filled by latest().
+ * @return true if what was read of the frame is consistent.
+ */
+bool FrameRingReader::valid(const RIShmFrame *frame) {
+    // The reads of the frame can't move after this one
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    return __atomic_load_n(&(frame->slot->seq), __ATOMIC_RELAXED) == frame->seq;
+}
+
+/**
+ * @param image an 8 bit image of the size and channels of the frames.
+ * @param frame if not NULL, filled with the frame description. Its image is the one in the ring.
+ * @return RI_RESP_SUCCESS, RI_RESP_PARAM_RANGE_ERR if the latest frame has another size, see latest() for the rest.
+ */
+int FrameRingReader::copyLatest(IplImage *image, RIShmFrame *frame) {
+    RIShmFrame f;
+    int i, y, ret;
+
+    for(i = 0; i < RI_SHM_RETRIES; i++) {
+        ret = latest(&f);
+        if(ret != RI_RESP_SUCCESS)
+            return ret;
+        if(f.image.width != image->width || f.image.height != image->height || f.image.nChannels != image->nChannels ||
+                image->depth != IPL_DEPTH_8U)
+            return RI_RESP_PARAM_RANGE_ERR;
+
+        for(y = 0; y < image->height; y++)
+            memcpy(image->imageData + y * image->widthStep, f.image.imageData + y * f.image.widthStep, image->width * image->nChannels);
+        if(valid(&f)) {
+            if(frame != NULL)
+                *frame = f;
+            return RI_RESP_SUCCESS;
+        }
+        torn_count++;
+    }
+    return RI_RESP_BUSY;
+}
+
+uint32_t FrameRingReader::torn(void) {
+    return torn_count;
+}
@@ -0,0 +1,183 @@
+/** @file imagesaver.cpp
+ *  @brief Asynchronous JPEG writer, see imagesaver.h.
+ *
+ */
+
+#include "imagesaver.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/stat.h>
+
+/**
+ * @param directory the directory to write into.
+ * @param number the file name.
+ * @param jpeg the bytes of the JPEG file.
+ * @param size the number of bytes.
+ * @return RI_RESP_SUCCESS, RI_RESP_FAILURE if the file could not be written.
+ */
+int riWriteJpeg(const char *directory, uint32_t number, const unsigned char *jpeg, int size) {
+    char path[RI_SAVE_MAX_PATH + 16];
+    FILE *f;
+    size_t done;
+
+    snprintf(path, sizeof(path), "%s/%u.jpeg", directory, number);
+    f = fopen(path, "wb");
+    if(f == NULL)
+        return RI_RESP_FAILURE;
+    done = fwrite(jpeg, 1, size, f);
+    if(fclose(f) != 0 || done != (size_t)size)
+        return RI_RESP_FAILURE;
+    return RI_RESP_SUCCESS;
+}
+
+/**
+ * @param directory the directory the frames are written into, created by start() if needed.
+ * @param depth the number of frames that can wait to be written.
+ * @param policy RI_SAVE_DROP or RI_SAVE_BLOCK, what save() does when the queue is full.
+ */
+ImageSaver::ImageSaver(const char *directory, uint32_t depth, int policy) : ring(depth) {
+    strncpy(this->directory, directory, RI_SAVE_MAX_PATH - 1);
+    this->directory[RI_SAVE_MAX_PATH - 1] = '\0';
+    this->policy = policy;
+    pthread_mutex_init(&lock, NULL);
+    pthread_cond_init(&queued, NULL);
+    pthread_cond_init(&freed, NULL);
+    running = false;
+    drop_count = 0;
+    write_count = 0;
+    error_count = 0;
+}
+
+ImageSaver::~ImageSaver() {
+    stop();
+    pthread_cond_destroy(&freed);
+    pthread_cond_destroy(&queued);
+    pthread_mutex_destroy(&lock);
+}
+
+/** @brief Body of the writer thread, writes until stopped and the queue is empty */
+void *ImageSaver::writerThread(void *arg) {
+    ImageSaver *is = (ImageSaver *)arg;
+    RISaveSlot *slot;
+
+    while(true) {
+        pthread_mutex_lock(&(is->lock));
+        while(is->running && is->ring.size() == 0)
+            pthread_cond_wait(&(is->queued), &(is->lock));
+        pthread_mutex_unlock(&(is->lock));
+
+        slot = is->ring.front();
+        if(slot == NULL)
+            break;
+
+        if(riWriteJpeg(is->directory, slot->number, &slot->jpeg[0], slot->jpeg.size()) == RI_RESP_SUCCESS) {
+            __atomic_add_fetch(&(is->write_count), 1, __ATOMIC_RELAXED);
+        } else {
+            // Only tell once, the count says the rest
+            if(__atomic_fetch_add(&(is->error_count), 1, __ATOMIC_RELAXED) == 0)
+                perror("Unable to write an image.");
+        }
+        is->ring.release();
+
+        pthread_mutex_lock(&(is->lock));
+        pthread_cond_signal(&(is->freed));
+        pthread_mutex_unlock(&(is->lock));
+    }
+    return NULL;
+}
+
+/**
+ * @return RI_RESP_SUCCESS, RI_RESP_BUSY if the writer is already running, RI_RESP_FAILURE if the directory cannot be created.
+ */
+int ImageSaver::start(void) {
+    if(running)
+        return RI_RESP_BUSY;
+
+    if(mkdir(directory, 0755) != 0 && errno != EEXIST) {
+        perror("Unable to create the image directory.");
+        return RI_RESP_FAILURE;
+    }
+
+    running = true;
+    if(pthread_create(&thread, NULL, writerThread, this) != 0) {
+        running = false;
+        perror("Unable to start the image writer thread.");
+        return RI_RESP_FAILURE;
+    }
+    return RI_RESP_SUCCESS;
+}
+
+/**
+ * @return RI_RESP_SUCCESS.
+ * @note Returns once the frames queued before the call are on disk.
+ */
+int ImageSaver::stop(void) {
+    if(!running)
+        return RI_RESP_SUCCESS;
+
+    pthread_mutex_lock(&lock);
+    running = false;
+    pthread_cond_signal(&queued);
+    // Callers blocked on a full queue give up
+    pthread_cond_broadcast(&freed);
+    pthread_mutex_unlock(&lock);
+    pthread_join(thread, NULL);
+    return RI_RESP_SUCCESS;
+}
+
+bool ImageSaver::isRunning(void) {
+    return running;
+}
+
+/**
+ * @param jpeg the bytes of a JPEG file, for example from RobotInterface::lastJpeg().
+ * @param size the number of bytes.
+ * @param number the file name, <number>.jpeg.
+ * @return RI_RESP_SUCCESS, RI_RESP_BUSY if the queue is full and the frame was dropped, RI_RESP_FAILURE if there is no data.
+ * @note The bytes are copied, the caller can reuse its buffer as soon as save() returns. With RI_SAVE_BLOCK the call waits for the writer while the queue is full, it only drops the frame if the writer is not running.
+ */
+int ImageSaver::save(const unsigned char *jpeg, int size, uint32_t number) {
+    RISaveSlot *slot;
+
+    if(jpeg == NULL || size <= 0)
+        return RI_RESP_FAILURE;
+
+    slot = ring.claim();
+    if(slot == NULL && policy == RI_SAVE_BLOCK) {
+        pthread_mutex_lock(&lock);
+        while(running && (slot = ring.claim()) == NULL)
+            pthread_cond_wait(&freed, &lock);
+        pthread_mutex_unlock(&lock);
+    }
+    if(slot == NULL) {
+        __atomic_add_fetch(&drop_count, 1, __ATOMIC_RELAXED);
+        return RI_RESP_BUSY;
+    }
+
+    slot->number = number;
+    slot->jpeg.assign(jpeg, jpeg + size);
+    ring.publish();
+
+    pthread_mutex_lock(&lock);
+    pthread_cond_signal(&queued);
+    pthread_mutex_unlock(&lock);
+    return RI_RESP_SUCCESS;
+}
+
+uint32_t ImageSaver::pending(void) {
+    return ring.size();
+}
+
+uint32_t ImageSaver::dropped(void) {
+    return __atomic_load_n(&drop_count, __ATOMIC_RELAXED);
+}
+
+uint32_t ImageSaver::written(void) {
+    return __atomic_load_n(&write_count, __ATOMIC_RELAXED);
+}
+
+uint32_t ImageSaver::errors(void) {
+    return __atomic_load_n(&error_count, __ATOMIC_RELAXED);
+}
@@ -0,0 +1,128 @@
+/** @file latency.cpp
+ *  @brief Frame latency statistics, see latency.h.
+ *
+ */
+
+#include "latency.h"
+
+#include <string.h>
+
+static const char *riLatencyNames[RI_LAT_STAGES] = {
+    "request", "first byte", "received", "decoded", "processed", "command", "acked", "total"
+};
+
+const char *riLatencyName(int stage) {
+    if(stage < 0 || stage >= RI_LAT_STAGES)
+        return "unknown";
+    return riLatencyNames[stage];
+}
+
+/**
+ * @param stage the statistics of a stage.
+ * @param p the fraction of the times, 0.5 for the median.
+ * @return the upper bound of the histogram bucket the percentile is in, capped by the maximum time, 0 if the stage is empty.
+ */
+uint32_t riLatencyPercentile(const RILatencyStage *stage, double p) {
+    uint64_t rank, seen = 0;
+    uint32_t bound;
+    int i;
+
+    if(stage->count == 0)
+        return 0;
+    rank = (uint64_t)(p * stage->count + 0.5);
+    if(rank < 1)
+        rank = 1;
+    for(i = 0; i < RI_LAT_BUCKETS - 1; i++) {
+        seen += stage->histogram[i];
+        if(seen >= rank)
+            break;
+    }
+    bound = (uint32_t)(i + 1) * RI_LAT_BUCKET_US;
+    return bound < stage->max ? bound : stage->max;
+}
+
+LatencyStats::LatencyStats() {
+    pthread_mutex_init(&lock, NULL);
+    reset();
+}
+
+LatencyStats::~LatencyStats() {
+    pthread_mutex_destroy(&lock);
+}
+
+void LatencyStats::reset(void) {
+    int i;
+
+    pthread_mutex_lock(&lock);
+    memset(stages, 0, sizeof(stages));
+    for(i = 0; i < RI_LAT_STAGES; i++)
+        stages[i].min = UINT32_MAX;
+    pthread_mutex_unlock(&lock);
+}
+
+void LatencyStats::addTime(int stage, uint64_t us) {
+    RILatencyStage *s = &stages[stage];
+    uint32_t t = us > UINT32_MAX ? UINT32_MAX : (uint32_t)us;
+    uint32_t bucket = t / RI_LAT_BUCKET_US;
+
+    s->count++;
+    s->sum += t;
+    if(t < s->min)
+        s->min = t;
+    if(t > s->max)
+        s->max = t;
+    s->histogram[bucket < RI_LAT_BUCKETS ? bucket : RI_LAT_BUCKETS - 1]++;
+}
+
+/**
+ * @param trace a trace, the points it did not reach are 0.
+ * @note A stage is the time from the last point reached before the one it ends at, so a frame that was never decoded by getImage() still counts its processing.
+ */
+void LatencyStats::add(const RITrace *trace) {
+    int i, last = -1;
+
+    pthread_mutex_lock(&lock);
+    for(i = 0; i < RI_TRACE_POINTS; i++) {
+        if(trace->t[i] == 0)
+            continue;
+        if(last >= 0 && trace->t[i] >= trace->t[last])
+            addTime(i, trace->t[i] - trace->t[last]);
+        last = i;
+    }
+    if(trace->t[RI_TRACE_REQUEST] != 0 && trace->t[RI_TRACE_COMMAND] >= trace->t[RI_TRACE_REQUEST])
+        addTime(RI_LAT_TOTAL, trace->t[RI_TRACE_COMMAND] - trace->t[RI_TRACE_REQUEST]);
+    pthread_mutex_unlock(&lock);
+}
+
+/**
+ * @param stage RI_TRACE_FIRST_BYTE to RI_TRACE_ACKED, or RI_LAT_TOTAL.
+ * @param out filled with a copy of the statistics.
+ * @return RI_RESP_SUCCESS, RI_RESP_PARAM_RANGE_ERR if there is no such stage.
+ */
+int LatencyStats::get(int stage, RILatencyStage *out) {
+    if(stage <= RI_TRACE_REQUEST || stage >= RI_LAT_STAGES)
+        return RI_RESP_PARAM_RANGE_ERR;
+
+    pthread_mutex_lock(&lock);
+    memcpy(out, &stages[stage], sizeof(RILatencyStage));
+    pthread_mutex_unlock(&lock);
+    return RI_RESP_SUCCESS;
+}
+
+/**
+ * @param out where to print, stdout for example.
+ */
+void LatencyStats::print(FILE *out) {
+    RILatencyStage s;
+    int i;
+
+    fprintf(out, "stage          frames     mean      min      p50      p95      max (ms)\n");
+    for(i = RI_TRACE_FIRST_BYTE; i < RI_LAT_STAGES; i++) {
+        get(i, &s);
+        if(s.count == 0)
+            continue;
+        fprintf(out, "%-12s %8u %8.1f %8.1f %8.1f %8.1f %8.1f\n", riLatencyName(i), s.count,
+            s.sum / 1000.0 / s.count, s.min / 1000.0, riLatencyPercentile(&s, 0.5) / 1000.0,
+            riLatencyPercentile(&s, 0.95) / 1000.0, s.max / 1000.0);
+    }
+}
@@ -0,0 +1,336 @@
+/** @file motion.cpp
+ *  @brief Closed loop motion primitives, see motion.h.
+ *
+ */
+
+#include "motion.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <errno.h>
+
+#define RI_DEG(rad)			((rad) * 180.0 / M_PI)
+
+/**
+ * @param robot the robot to drive.
+ * @param odometry a started odometry of the same robot, the feedback of the loop.
+ * @param rate the number of control steps per second, a step must be shorter than RI_MOVE_PULSE_US for the robot to move smoothly.
+ */
+MotionController::MotionController(RobotInterface *robot, Odometry *odometry, int rate) {
+    this->robot = robot;
+    this->odometry = odometry;
+    this->rate = rate > 0 ? rate : RI_MOTION_DEFAULT_RATE;
+    pthread_mutex_init(&lock, NULL);
+    pthread_cond_init(&finished, NULL);
+    memset(&motion, 0, sizeof(RIMotion));
+    motion.state = RI_MOTION_IDLE;
+    radius = 0.0;
+    speed = RI_FASTEST;
+    generation = 0;
+    cancel_request = false;
+    running = false;
+}
+
+MotionController::~MotionController() {
+    stop();
+    pthread_cond_destroy(&finished);
+    pthread_mutex_destroy(&lock);
+}
+
+/** @brief The speed for what is left of a motion, ramped down to RI_SLOWEST under slow */
+int MotionController::rampSpeed(double left, double slow) {
+    int s;
+
+    left = fabs(left);
+    if(left >= slow)
+        return speed;
+    s = speed + (int)((RI_SLOWEST - speed) * (1.0 - left / slow) + 0.5);
+    return s > RI_SLOWEST ? RI_SLOWEST : s;
+}
+
+/** @brief End the running motion, the lock must be held */
+void MotionController::end(int state) {
+    motion.state = state;
+    motion.finished = riTimestamp();
+    pthread_cond_broadcast(&finished);
+}
+
+/** @brief Body of the control thread */
+void *MotionController::motionThread(void *arg) {
+    MotionController *mc = (MotionController *)arg;
+    RIOdometrySample first, prev, s;
+    struct timespec next;
+    uint64_t now, moved = 0, period = 1000000ULL / mc->rate;
+    uint32_t seen = 0;
+    double heading = 0.0, distance = 0.0, progress, left, tol, slow, lag, step;
+    int type, movement, last_movement = RI_STOP, state, spd;
+    double target, radius;
+    bool active, fresh, turning = false;
+
+    clock_gettime(CLOCK_MONOTONIC, &next);
+    while(mc->running) {
+        pthread_mutex_lock(&mc->lock);
+        active = mc->motion.state == RI_MOTION_RUNNING;
+        type = mc->motion.type;
+        target = mc->motion.target;
+        radius = mc->radius;
+        fresh = mc->generation != seen;
+        seen = mc->generation;
+        pthread_mutex_unlock(&mc->lock);
+
+        now = riTimestamp();
+        state = RI_MOTION_RUNNING;
+        movement = RI_STOP;
+        progress = 0.0;
+        left = 0.0;
+        tol = 0.0;
+        slow = 1.0;
+
+        if(active && fresh) {
+            // A new motion, measured from the latest sample
+            if(!mc->odometry->latest(&first))
+                state = RI_MOTION_STALLED;
+            prev = first;
+            heading = 0.0;
+            distance = 0.0;
+            turning = false;
+            moved = now;
+        }
+
+        if(active && state == RI_MOTION_RUNNING) {
+            if(mc->odometry->latest(&s) && s.sequence != prev.sequence) {
+                step = hypot(s.x - prev.x, s.y - prev.y);
+                distance += step;
+                heading += riWrapAngle(s.theta - prev.theta);
+                if(step > 0.05 || fabs(s.theta - prev.theta) > 0.001)
+                    moved = now;
+                prev = s;
+            }
+
+            switch(type) {
+            case RI_MOTION_DRIVE:
+                // Along the heading at the start, drift sideways does not count
+                progress = (prev.x - first.x) * cos(first.theta) + (prev.y - first.y) * sin(first.theta);
+                left = target - progress;
+                tol = RI_MOTION_DIST_TOLERANCE;
+                slow = RI_MOTION_SLOW_CM;
+                movement = left > 0.0 ? RI_MOVE_FORWARD : RI_MOVE_BACKWARD;
+                break;
+            case RI_MOTION_TURN:
+                progress = RI_DEG(heading);
+                left = target - progress;
+                tol = RI_MOTION_ANGLE_TOLERANCE;
+                slow = RI_MOTION_SLOW_DEG;
+                movement = left > 0.0 ? RI_TURN_LEFT : RI_TURN_RIGHT;
+                break;
+            default:
+                // Drive forward, turn when the heading lags the circle by the tolerance, until it caught up
+                progress = RI_DEG(heading);
+                left = target - progress;
+                tol = RI_MOTION_ANGLE_TOLERANCE;
+                slow = RI_MOTION_SLOW_DEG;
+                lag = RI_DEG(distance / radius) - fabs(progress);
+                turning = lag > (turning ? 0.0 : tol);
+                if(!turning)
+                    movement = RI_MOVE_FORWARD;
+                else
+                    movement = target > 0.0 ? RI_TURN_LEFT : RI_TURN_RIGHT;
+                break;
+            }
+
+            if(mc->cancel_request)
+                state = RI_MOTION_CANCELED;
+            else if(fabs(left) <= tol)
+                state = RI_MOTION_DONE;
+            else if(left * target < 0.0)
+                state = RI_MOTION_MISSED;
+            else if(now - moved > RI_MOTION_STALL_US)
+                state = RI_MOTION_STALLED;
+        }
+
+        if(!active || state != RI_MOTION_RUNNING)
+            movement = RI_STOP;
+        spd = movement == RI_STOP ? RI_SLOWEST : mc->rampSpeed(left, slow);
+        // Every step renews the drive pulse, a stop is sent once
+        if(movement != RI_STOP || last_movement != RI_STOP) {
+            mc->robot->move(movement, spd);
+            last_movement = movement;
+            if(active) {
+                pthread_mutex_lock(&mc->lock);
+                mc->motion.commands++;
+                pthread_mutex_unlock(&mc->lock);
+            }
+        }
+
+        if(active) {
+            pthread_mutex_lock(&mc->lock);
+            mc->motion.progress = progress;
+            mc->motion.error = left;
+            mc->motion.distance = distance;
+            if(state != RI_MOTION_RUNNING)
+                mc->end(state);
+            pthread_mutex_unlock(&mc->lock);
+        }
+
+        // Wait for the next period, skip the missed ones on overrun
+        riWaitPeriod(&next, period);
+    }
+
+    if(last_movement != RI_STOP)
+        mc->robot->move(RI_STOP, RI_SLOWEST);
+    pthread_mutex_lock(&mc->lock);
+    if(mc->motion.state == RI_MOTION_RUNNING)
+        mc->end(RI_MOTION_CANCELED);
+    pthread_mutex_unlock(&mc->lock);
+    return NULL;
+}
+
+/**
+ * @return RI_RESP_SUCCESS, RI_RESP_BUSY if the controller is already started, RI_RESP_FAILURE if the control thread can't be started.
+ */
+int MotionController::start(void) {
+    if(running)
+        return RI_RESP_BUSY;
+
+    running = true;
+    if(pthread_create(&thread, NULL, motionThread, this) != 0) {
+        running = false;
+        perror("Unable to start the motion thread.");
+        return RI_RESP_FAILURE;
+    }
+    return RI_RESP_SUCCESS;
+}
+
+/**
+ * @return RI_RESP_SUCCESS.
+ * @note The robot is stopped if it was moving.
+ */
+int MotionController::stop(void) {
+    if(!running)
+        return RI_RESP_SUCCESS;
+
+    running = false;
+    pthread_join(thread, NULL);
+    return RI_RESP_SUCCESS;
+}
+
+bool MotionController::isRunning(void) {
+    return running;
+}
+
+/** @brief Start a motion if none is running */
+int MotionController::begin(int type, double target, double radius, int speed) {
+    if(!running)
+        return RI_RESP_FAILURE;
+    if(speed < RI_FASTEST || speed > RI_SLOWEST)
+        return RI_RESP_PARAM_RANGE_ERR;
+
+    pthread_mutex_lock(&lock);
+    if(motion.state == RI_MOTION_RUNNING) {
+        pthread_mutex_unlock(&lock);
+        return RI_RESP_BUSY;
+    }
+    memset(&motion, 0, sizeof(RIMotion));
+    motion.type = type;
+    motion.state = RI_MOTION_RUNNING;
+    motion.target = target;
+    motion.error = target;
+    motion.started = riTimestamp();
+    this->radius = radius;
+    this->speed = speed;
+    cancel_request = false;
+    generation++;
+    pthread_mutex_unlock(&lock);
+    return RI_RESP_SUCCESS;
+}
+
+/**
+ * @param cm the distance, positive forward.
+ * @param speed RI_FASTEST to RI_SLOWEST, the speed drops to RI_SLOWEST over the last RI_MOTION_SLOW_CM.
+ * @return RI_RESP_SUCCESS, RI_RESP_BUSY if a motion is running, RI_RESP_PARAM_RANGE_ERR if the speed is out of range, RI_RESP_FAILURE if the controller is not started.
+ */
+int MotionController::driveDistance(double cm, int speed) {
+    return begin(RI_MOTION_DRIVE, cm, 0.0, speed);
+}
+
+/**
+ * @param deg the angle, positive counter-clockwise (to the left).
+ * @param speed RI_FASTEST to RI_SLOWEST, the speed drops to RI_SLOWEST over the last RI_MOTION_SLOW_DEG.
+ * @return see driveDistance().
+ */
+int MotionController::turnAngle(double deg, int speed) {
+    return begin(RI_MOTION_TURN, deg, 0.0, speed);
+}
+
+/**
+ * @param radius_cm the radius of the circle, more than 0.
+ * @param deg the heading change at the end of the arc, positive to the left.
+ * @param speed RI_FASTEST to RI_SLOWEST.
+ * @return see driveDistance(), RI_RESP_PARAM_RANGE_ERR if the radius is not positive.
+ * @note move() has no curvature, the arc is driven forward with short turns whenever the heading lags the circle by more than RI_MOTION_ANGLE_TOLERANCE.
+ */
+int MotionController::driveArc(double radius_cm, double deg, int speed) {
+    if(radius_cm <= 0.0)
+        return RI_RESP_PARAM_RANGE_ERR;
+    return begin(RI_MOTION_ARC, deg, radius_cm, speed);
+}
+
+void MotionController::cancel(void) {
+    cancel_request = true;
+}
+
+/**
+ * @param result filled in with the motion, may be NULL.
+ * @param timeout_ms the longest wait, 0 to wait until the motion ends.
+ * @return RI_RESP_SUCCESS if the motion ended within tolerance, RI_RESP_BUSY if it still runs after the timeout, RI_RESP_FAILURE if it missed, stalled, was canceled or none was started.
+ */
+int MotionController::wait(RIMotion *result, uint32_t timeout_ms) {
+    struct timespec deadline;
+    int state, err = 0;
+
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += timeout_ms / 1000;
+    deadline.tv_nsec += (timeout_ms % 1000) * 1000000L;
+    if(deadline.tv_nsec >= 1000000000L) {
+        deadline.tv_nsec -= 1000000000L;
+        deadline.tv_sec++;
+    }
+
+    pthread_mutex_lock(&lock);
+    while(motion.state == RI_MOTION_RUNNING && err != ETIMEDOUT) {
+        if(timeout_ms == 0)
+            pthread_cond_wait(&finished, &lock);
+        else
+            err = pthread_cond_timedwait(&finished, &lock, &deadline);
+    }
+    state = motion.state;
+    if(result != NULL)
+        memcpy(result, &motion, sizeof(RIMotion));
+    pthread_mutex_unlock(&lock);
+
+    if(state == RI_MOTION_DONE)
+        return RI_RESP_SUCCESS;
+    if(state == RI_MOTION_RUNNING)
+        return RI_RESP_BUSY;
+    return RI_RESP_FAILURE;
+}
+
+/**
+ * @param result filled in with the motion.
+ */
+void MotionController::get(RIMotion *result) {
+    pthread_mutex_lock(&lock);
+    memcpy(result, &motion, sizeof(RIMotion));
+    pthread_mutex_unlock(&lock);
+}
+
+bool MotionController::isBusy(void) {
+    bool busy;
+
+    pthread_mutex_lock(&lock);
+    busy = motion.state == RI_MOTION_RUNNING;
+    pthread_mutex_unlock(&lock);
+    return busy;
+}
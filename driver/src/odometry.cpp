@@ -0,0 +1,338 @@
+/** @file odometry.cpp
+ *  @brief High rate wheel odometry, see odometry.h.
+ *
+ */
+
+#include "odometry.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+
+#define RI_SQRT3			1.7320508075688772
+
+/**
+ * @param a an angle in radians.
+ * @return the same angle in -PI to PI.
+ */
+double riWrapAngle(double a) {
+    while(a > M_PI)
+        a -= 2.0 * M_PI;
+    while(a < -M_PI)
+        a += 2.0 * M_PI;
+    return a;
+}
+
+/**
+ * @param before the sample at or before at.
+ * @param after the sample at or after at, may be before itself.
+ * @param at the time wanted, as given by riTimestamp().
+ * @param out filled with the sample, its timestamp set to at. The tick counts are those of after.
+ * @note Outside the two samples, or when they have the same time, the nearest one is moved along
+ * its velocities for at most RI_ODO_MAX_EXTRAPOLATE.
+ */
+void riOdometryInterpolate(const RIOdometrySample *before, const RIOdometrySample *after, uint64_t at, RIOdometrySample *out) {
+    const RIOdometrySample *from;
+    double f, dt, heading;
+
+    if(before->timestamp < after->timestamp && at >= before->timestamp && at <= after->timestamp) {
+        f = (double)(at - before->timestamp) / (double)(after->timestamp - before->timestamp);
+        memcpy(out, after, sizeof(RIOdometrySample));
+        out->x = before->x + f * (after->x - before->x);
+        out->y = before->y + f * (after->y - before->y);
+        out->theta = riWrapAngle(before->theta + f * riWrapAngle(after->theta - before->theta));
+        out->timestamp = at;
+        return;
+    }
+
+    from = at <= before->timestamp ? before : after;
+    memcpy(out, from, sizeof(RIOdometrySample));
+    dt = at >= from->timestamp ? (double)(at - from->timestamp) : -(double)(from->timestamp - at);
+    if(dt > RI_ODO_MAX_EXTRAPOLATE)
+        dt = RI_ODO_MAX_EXTRAPOLATE;
+    else if(dt < -RI_ODO_MAX_EXTRAPOLATE)
+        dt = -RI_ODO_MAX_EXTRAPOLATE;
+    dt /= 1000000.0;
+
+    // The velocities are in the robot frame
+    heading = from->theta + from->omega * dt / 2.0;
+    out->x += (from->vx * cos(heading) - from->vy * sin(heading)) * dt;
+    out->y += (from->vx * sin(heading) + from->vy * cos(heading)) * dt;
+    out->theta = riWrapAngle(from->theta + from->omega * dt);
+    out->timestamp = at;
+}
+
+/**
+ * @param robot the robot to follow, its connection settings are copied.
+ * @param rate the number of MCU polls per second.
+ * @param samples the number of samples buffered for the ring reader.
+ */
+Odometry::Odometry(RobotInterface *robot, int rate, uint32_t samples) : ring(samples) {
+    robot->getConnection(&conn);
+    memset(&last_sample, 0, sizeof(RIOdometrySample));
+    last_seq = 0;
+    history_count = 0;
+    pthread_mutex_init(&history_lock, NULL);
+    running = false;
+    reset_request = false;
+    this->rate = rate > 0 ? rate : RI_ODO_DEFAULT_RATE;
+    ticks_per_cm = RI_ODO_TICKS_PER_CM;
+    wheel_base = RI_ODO_WHEEL_BASE_CM;
+    overrun_count = 0;
+    error_count = 0;
+    drop_count = 0;
+}
+
+Odometry::~Odometry() {
+    stop();
+    pthread_mutex_destroy(&history_lock);
+}
+
+/**
+ * @param ticks_per_cm encoder ticks per cm of wheel travel, RI_ODO_TICKS_PER_CM by default.
+ * @param wheel_base_cm distance from the center of the robot to the wheels, RI_ODO_WHEEL_BASE_CM by default.
+ */
+void Odometry::setGeometry(double ticks_per_cm, double wheel_base_cm) {
+    if(running)
+        return;
+    this->ticks_per_cm = ticks_per_cm;
+    wheel_base = wheel_base_cm;
+}
+
+/**
+ * @brief Integrate one poll of the three wheels into the pose
+ *
+ * The left and right wheels sit at the front, 60 degrees either side of the x axis, the
+ * rear wheel drives sideways. A wheel reports the travel of its contact point along its
+ * drive direction, positive forward (to the left for the rear wheel):
+ * <pre>
+ *   left  = sqrt(3)/2 dx - 1/2 dy - R dtheta
+ *   right = sqrt(3)/2 dx + 1/2 dy + R dtheta
+ *   rear  = dy - R dtheta
+ * </pre>
+ * which is inverted below, then rotated into the odometry frame at the mid-heading.
+ */
+void Odometry::integrate(RIOdometrySample *s, uint64_t timestamp) {
+    double l, r, b, dx, dy, dth, mid, dt;
+
+    s->left_ticks = riGetWheelEncoder(&conn, RI_WHEEL_LEFT);
+    s->right_ticks = riGetWheelEncoder(&conn, RI_WHEEL_RIGHT);
+    s->rear_ticks = riGetWheelEncoder(&conn, RI_WHEEL_REAR);
+    s->left_total += s->left_ticks;
+    s->right_total += s->right_ticks;
+    s->rear_total += s->rear_ticks;
+
+    l = s->left_ticks / ticks_per_cm;
+    r = s->right_ticks / ticks_per_cm;
+    b = s->rear_ticks / ticks_per_cm;
+
+    dx = (l + r) / RI_SQRT3;
+    dth = (r - l - b) / (3.0 * wheel_base);
+    dy = (2.0 * b + r - l) / 3.0;
+
+    mid = s->theta + dth / 2.0;
+    s->x += dx * cos(mid) - dy * sin(mid);
+    s->y += dx * sin(mid) + dy * cos(mid);
+    s->theta = riWrapAngle(s->theta + dth);
+
+    // Velocities over the time since the previous sample
+    dt = s->timestamp != 0 ? (timestamp - s->timestamp) / 1000000.0 : 0.0;
+    if(dt > 0.0) {
+        s->vx = dx / dt;
+        s->vy = dy / dt;
+        s->omega = dth / dt;
+    }
+    s->timestamp = timestamp;
+}
+
+/** @brief Body of the polling thread */
+void *Odometry::odometryThread(void *arg) {
+    Odometry *odo = (Odometry *)arg;
+    RIOdometrySample s;
+    struct timespec next;
+    uint64_t sent, done, period = 1000000ULL / odo->rate;
+    uint32_t sequence = 0;
+    RISensorSample *h;
+
+    memset(&s, 0, sizeof(RIOdometrySample));
+    clock_gettime(CLOCK_MONOTONIC, &next);
+
+    while(odo->running) {
+        if(odo->reset_request) {
+            memset(&s, 0, sizeof(RIOdometrySample));
+            pthread_mutex_lock(&odo->history_lock);
+            odo->history_count = 0;
+            pthread_mutex_unlock(&odo->history_lock);
+            odo->reset_request = false;
+        }
+
+        sent = riTimestamp();
+        if(riGetSensorData(&(odo->conn), &(odo->conn.sensor)) == RI_RESP_SUCCESS) {
+            done = riTimestamp();
+            odo->integrate(&s, sent + (done - sent) / 2);
+            s.sequence = sequence;
+
+            // Publish the latest sample
+            __atomic_store_n(&odo->last_seq, odo->last_seq + 1, __ATOMIC_RELAXED);
+            __atomic_thread_fence(__ATOMIC_RELEASE);
+            memcpy(&odo->last_sample, &s, sizeof(RIOdometrySample));
+            __atomic_store_n(&odo->last_seq, odo->last_seq + 1, __ATOMIC_RELEASE);
+
+            if(!odo->ring.push(s))
+                __atomic_add_fetch(&odo->drop_count, 1, __ATOMIC_RELAXED);
+
+            pthread_mutex_lock(&odo->history_lock);
+            h = &odo->history[odo->history_count % RI_ODO_HISTORY];
+            memcpy(&h->odometry, &s, sizeof(RIOdometrySample));
+            memcpy(&h->sensor, &(odo->conn.sensor), sizeof(RIData));
+            odo->history_count++;
+            pthread_mutex_unlock(&odo->history_lock);
+        } else {
+            __atomic_add_fetch(&odo->error_count, 1, __ATOMIC_RELAXED);
+        }
+        sequence++;
+
+        // Wait for the next period, skip the missed ones on overrun
+        if(riWaitPeriod(&next, period) > 0)
+            __atomic_add_fetch(&odo->overrun_count, 1, __ATOMIC_RELAXED);
+    }
+    return NULL;
+}
+
+/**
+ * @return RI_RESP_SUCCESS, RI_RESP_BUSY if the odometry is already running.
+ * @note The pose starts at zero. A poll takes a full HTTP round trip, rates above what the link sustains are counted as overruns.
+ */
+int Odometry::start(void) {
+    if(running)
+        return RI_RESP_BUSY;
+
+    running = true;
+    reset_request = true;
+    if(pthread_create(&thread, NULL, odometryThread, this) != 0) {
+        running = false;
+        perror("Unable to start the odometry thread.");
+        return RI_RESP_FAILURE;
+    }
+    return RI_RESP_SUCCESS;
+}
+
+/**
+ * @return RI_RESP_SUCCESS.
+ */
+int Odometry::stop(void) {
+    if(!running)
+        return RI_RESP_SUCCESS;
+
+    running = false;
+    pthread_join(thread, NULL);
+    return RI_RESP_SUCCESS;
+}
+
+bool Odometry::isRunning(void) {
+    return running;
+}
+
+void Odometry::reset(void) {
+    reset_request = true;
+}
+
+/**
+ * @param sample filled in with the oldest sample of the ring.
+ * @return true if a sample was read.
+ * @note Only one thread may read the ring.
+ */
+bool Odometry::read(RIOdometrySample *sample) {
+    return ring.pop(sample);
+}
+
+/**
+ * @param sample filled in with the latest sample.
+ * @return true on success, false if no poll has succeeded yet.
+ */
+bool Odometry::latest(RIOdometrySample *sample) {
+    uint32_t seq;
+
+    // Retry while the polling thread is writing the sample
+    do {
+        seq = __atomic_load_n(&last_seq, __ATOMIC_ACQUIRE);
+        if(seq & 1)
+            continue;
+        memcpy(sample, &last_sample, sizeof(RIOdometrySample));
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    } while((seq & 1) || seq != __atomic_load_n(&last_seq, __ATOMIC_RELAXED));
+
+    return seq != 0;
+}
+
+/**
+ * @param at the time wanted, as given by riTimestamp().
+ * @param before filled with the latest poll at or before at.
+ * @param after filled with the earliest poll at or after at.
+ * @return RI_RESP_SUCCESS if at is between two polls, RI_RESP_BUSY if no poll was done after at yet
+ * (both are the latest poll), RI_RESP_PARAM_RANGE_ERR if at is older than the history (both are the
+ * oldest poll), RI_RESP_FAILURE before the first poll.
+ */
+int Odometry::bracket(uint64_t at, RISensorSample *before, RISensorSample *after) {
+    uint32_t oldest, i;
+    RISensorSample *h;
+    int resp;
+
+    pthread_mutex_lock(&history_lock);
+    if(history_count == 0) {
+        pthread_mutex_unlock(&history_lock);
+        return RI_RESP_FAILURE;
+    }
+    oldest = history_count > RI_ODO_HISTORY ? history_count - RI_ODO_HISTORY : 0;
+
+    // Newest first, the wanted time is usually recent
+    for(i = history_count; i > oldest; i--) {
+        if(history[(i - 1) % RI_ODO_HISTORY].odometry.timestamp <= at)
+            break;
+    }
+    if(i == history_count) {
+        h = &history[(i - 1) % RI_ODO_HISTORY];
+        memcpy(before, h, sizeof(RISensorSample));
+        memcpy(after, h, sizeof(RISensorSample));
+        resp = RI_RESP_BUSY;
+    } else if(i == oldest) {
+        h = &history[oldest % RI_ODO_HISTORY];
+        memcpy(before, h, sizeof(RISensorSample));
+        memcpy(after, h, sizeof(RISensorSample));
+        resp = RI_RESP_PARAM_RANGE_ERR;
+    } else {
+        memcpy(before, &history[(i - 1) % RI_ODO_HISTORY], sizeof(RISensorSample));
+        memcpy(after, &history[i % RI_ODO_HISTORY], sizeof(RISensorSample));
+        resp = RI_RESP_SUCCESS;
+    }
+    pthread_mutex_unlock(&history_lock);
+    return resp;
+}
+
+/**
+ * @param at the time wanted, as given by riTimestamp().
+ * @param sample filled with the odometry at that time.
+ * @return the response of bracket(), the sample is extrapolated unless RI_RESP_SUCCESS, and not set on RI_RESP_FAILURE.
+ */
+int Odometry::sampleAt(uint64_t at, RIOdometrySample *sample) {
+    RISensorSample before, after;
+    int resp;
+
+    resp = bracket(at, &before, &after);
+    if(resp != RI_RESP_FAILURE)
+        riOdometryInterpolate(&before.odometry, &after.odometry, at, sample);
+    return resp;
+}
+
+uint32_t Odometry::overruns(void) {
+    return __atomic_load_n(&overrun_count, __ATOMIC_RELAXED);
+}
+
+uint32_t Odometry::errors(void) {
+    return __atomic_load_n(&error_count, __ATOMIC_RELAXED);
+}
+
+uint32_t Odometry::dropped(void) {
+    return __atomic_load_n(&drop_count, __ATOMIC_RELAXED);
+}
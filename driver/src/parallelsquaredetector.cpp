@@ -0,0 +1,249 @@
+/** @file parallelsquaredetector.cpp
+ *  @brief Square detection split over several cores, see parallelsquaredetector.h.
+ *
+ */
+
+#include "parallelsquaredetector.h"
+
+#include <unistd.h>
+#include <stdio.h>
+#include <algorithm>
+
+/** @brief What a worker thread needs to know */
+typedef struct {
+    ParallelSquareDetector *owner;
+    SquareDetector *detector;
+} RISquareWorker;
+
+/**
+ * @param thread_count the number of threads working on a frame, the caller included, 0 for one per online core.
+ * @param bands the number of bands the frame is cut into, 0 for one per thread. Bands are never thinner than RI_PSQ_HALO rows.
+ */
+ParallelSquareDetector::ParallelSquareDetector(int thread_count, int bands) {
+    RISquareWorker *worker;
+    int i;
+
+    if(thread_count <= 0)
+        thread_count = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if(thread_count <= 0)
+        thread_count = 1;
+    nthreads = thread_count;
+    nbands = bands > 0 ? bands : thread_count;
+
+    pthread_mutex_init(&lock, NULL);
+    pthread_cond_init(&work_cond, NULL);
+    pthread_cond_init(&done_cond, NULL);
+    generation = 0;
+    active = 0;
+    finished = 0;
+    open = false;
+    quit = false;
+    next_task = 0;
+    image = NULL;
+    threshold = 0;
+    merge_count = 0;
+    squares.reserve(16);
+
+    detectors = new SquareDetector[nthreads];
+    threads = new pthread_t[nthreads];
+    for(i = 1; i < nthreads; i++) {
+        worker = new RISquareWorker;
+        worker->owner = this;
+        worker->detector = &detectors[i];
+        if(pthread_create(&threads[i], NULL, workerThread, worker) != 0) {
+            perror("Unable to start a square detector thread.");
+            delete worker;
+            break;
+        }
+    }
+    // Carry on with the threads that did start
+    nthreads = i;
+}
+
+ParallelSquareDetector::~ParallelSquareDetector() {
+    int i;
+
+    pthread_mutex_lock(&lock);
+    quit = true;
+    pthread_cond_broadcast(&work_cond);
+    pthread_mutex_unlock(&lock);
+    for(i = 1; i < nthreads; i++)
+        pthread_join(threads[i], NULL);
+
+    delete [] threads;
+    delete [] detectors;
+    pthread_cond_destroy(&done_cond);
+    pthread_cond_destroy(&work_cond);
+    pthread_mutex_destroy(&lock);
+}
+
+/** @brief Body of the worker threads, run the tasks of every new round */
+void *ParallelSquareDetector::workerThread(void *arg) {
+    RISquareWorker *worker = (RISquareWorker *)arg;
+    ParallelSquareDetector *psd = worker->owner;
+    uint32_t seen = 0;
+
+    pthread_mutex_lock(&(psd->lock));
+    while(!psd->quit) {
+        // Late for a round that is over, wait for the next one
+        if(psd->generation == seen || !psd->open) {
+            pthread_cond_wait(&(psd->work_cond), &(psd->lock));
+            continue;
+        }
+        seen = psd->generation;
+        psd->active++;
+        pthread_mutex_unlock(&(psd->lock));
+
+        psd->runTasks(worker->detector);
+
+        pthread_mutex_lock(&(psd->lock));
+        psd->active--;
+        pthread_cond_signal(&(psd->done_cond));
+    }
+    pthread_mutex_unlock(&(psd->lock));
+
+    delete worker;
+    return NULL;
+}
+
+/** @brief Take the tasks of the current round until there is none left */
+void ParallelSquareDetector::runTasks(SquareDetector *detector) {
+    RISquareGroup *g;
+    int i, top, bottom, height = image->height;
+
+    while((i = __atomic_fetch_add(&next_task, 1, __ATOMIC_ACQ_REL)) < (int)tasks.size()) {
+        g = &groups[tasks[i]];
+        top = cuts[g->first] - RI_PSQ_HALO;
+        bottom = cuts[g->last + 1] + RI_PSQ_HALO;
+        g->squares.clear();
+        g->cut = detector->findRows(image, top > 0 ? top : 0, bottom < height ? bottom : height,
+            threshold, RI_PSQ_GUARD, cuts[g->first], cuts[g->last + 1], &(g->squares));
+        g->done = true;
+
+        pthread_mutex_lock(&lock);
+        finished++;
+        if(finished == (int)tasks.size())
+            pthread_cond_signal(&done_cond);
+        pthread_mutex_unlock(&lock);
+    }
+}
+
+/** @brief Process the groups that are not done, on all threads, and wait for them */
+void ParallelSquareDetector::runRound(void) {
+    pthread_mutex_lock(&lock);
+    finished = 0;
+    __atomic_store_n(&next_task, 0, __ATOMIC_RELEASE);
+    // A single task is not worth waking the workers
+    if(tasks.size() > 1) {
+        generation++;
+        open = true;
+        pthread_cond_broadcast(&work_cond);
+    }
+    pthread_mutex_unlock(&lock);
+
+    runTasks(&detectors[0]);
+
+    // No worker may still be looking at the tasks when they change
+    pthread_mutex_lock(&lock);
+    while(finished < (int)tasks.size())
+        pthread_cond_wait(&done_cond, &lock);
+    open = false;
+    while(active > 0)
+        pthread_cond_wait(&done_cond, &lock);
+    pthread_mutex_unlock(&lock);
+}
+
+/** @brief Cut the rows into bands starting on multiples of 4, one group per band */
+void ParallelSquareDetector::layout(int height) {
+    int i, n = nbands, row;
+
+    if(n > height / RI_PSQ_HALO)
+        n = height / RI_PSQ_HALO;
+    if(n < 1)
+        n = 1;
+
+    cuts.clear();
+    cuts.push_back(0);
+    for(i = 1; i < n; i++) {
+        row = (int)(((long)height * i / n) & ~3L);
+        if(row > cuts.back())
+            cuts.push_back(row);
+    }
+    cuts.push_back(height);
+
+    groups.resize(cuts.size() - 1);
+    for(i = 0; i < (int)groups.size(); i++) {
+        groups[i].first = i;
+        groups[i].last = i;
+        groups[i].cut = 0;
+        groups[i].done = false;
+    }
+}
+
+/**
+ * @param img a 1 plane image, for example a color threshold. It is not modified.
+ * @param threshold The minimum square size argument gives the threshold for the smallest square the detector will detect.
+ * @return the squares found sorted by riSquareLess(), valid until the next call.
+ * @note Not thread safe, one frame at a time.
+ */
+const std::vector<RISquare> &ParallelSquareDetector::find(const IplImage *img, int threshold) {
+    size_t i;
+
+    image = img;
+    this->threshold = threshold;
+    merge_count = 0;
+    layout(img->height);
+
+    while(true) {
+        tasks.clear();
+        for(i = 0; i < groups.size(); i++) {
+            if(!groups[i].done)
+                tasks.push_back(i);
+        }
+        if(tasks.empty())
+            break;
+        runRound();
+
+        // Merge the groups on both sides of an edge either of them is in doubt about
+        for(i = 0; i + 1 < groups.size(); ) {
+            if(!(groups[i].cut & RI_SQ_CUT_BOTTOM) && !(groups[i + 1].cut & RI_SQ_CUT_TOP)) {
+                i++;
+                continue;
+            }
+            groups[i].last = groups[i + 1].last;
+            groups[i].cut = (groups[i].cut & RI_SQ_CUT_TOP) | (groups[i + 1].cut & RI_SQ_CUT_BOTTOM);
+            groups[i].done = false;
+            groups.erase(groups.begin() + i + 1);
+            merge_count++;
+        }
+    }
+
+    squares.clear();
+    for(i = 0; i < groups.size(); i++)
+        squares.insert(squares.end(), groups[i].squares.begin(), groups[i].squares.end());
+    std::sort(squares.begin(), squares.end(), riSquareLess);
+    return squares;
+}
+
+const std::vector<RISquare> &ParallelSquareDetector::result(void) const {
+    return squares;
+}
+
+const RISquare *ParallelSquareDetector::biggest(void) const {
+    const RISquare *big = NULL;
+    size_t i;
+
+    for(i = 0; i < squares.size(); i++) {
+        if(big == NULL || squares[i].area > big->area)
+            big = &squares[i];
+    }
+    return big;
+}
+
+int ParallelSquareDetector::threadCount(void) const {
+    return nthreads;
+}
+
+uint32_t ParallelSquareDetector::merges(void) const {
+    return merge_count;
+}
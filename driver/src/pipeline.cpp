@@ -0,0 +1,434 @@
+/** @file pipeline.cpp
+ *  @brief Vision pipeline of stages running on their own threads, see pipeline.h.
+ *
+ */
+
+#include "pipeline.h"
+
+#include <string.h>
+
+/**********************************************************
+ * Frames
+ **********************************************************/
+/**
+ * @param image the image of a frame, NULL the first time.
+ * @param size the size it must have.
+ * @param channels the number of channels it must have.
+ * @return the image, reallocated only if it was missing or different.
+ */
+IplImage *riFrameImage(IplImage **image, CvSize size, int channels) {
+    if(*image != NULL && (*image)->width == size.width && (*image)->height == size.height && (*image)->nChannels == channels)
+        return *image;
+    if(*image != NULL)
+        cvReleaseImage(image);
+    *image = cvCreateImage(size, IPL_DEPTH_8U, channels);
+    return *image;
+}
+
+void riFrameRetain(RIFrame *frame) {
+    __atomic_add_fetch(&(frame->refs), 1, __ATOMIC_RELAXED);
+}
+
+void riFrameRelease(RIFrame *frame) {
+    if(__atomic_sub_fetch(&(frame->refs), 1, __ATOMIC_ACQ_REL) == 0)
+        frame->pipeline->recycle(frame);
+}
+
+/**********************************************************
+ * Pipeline
+ **********************************************************/
+/**
+ * @param frame_count the number of frames in the pool. A source waits for a frame to come back when they are all in use, so this bounds the memory and the latency of the whole pipeline.
+ */
+Pipeline::Pipeline(uint32_t frame_count) {
+    RIFrame *frame;
+    uint32_t i;
+
+    pthread_mutex_init(&pool_lock, NULL);
+    pthread_cond_init(&pool_freed, NULL);
+    running = false;
+    started = 0;
+    ended = 0;
+
+    frames.reserve(frame_count);
+    free_frames.reserve(frame_count);
+    for(i = 0; i < frame_count; i++) {
+        frame = new RIFrame();
+        frame->refs = 0;
+        frame->pipeline = this;
+        frame->number = 0;
+        frame->timestamp = 0;
+        frame->image = NULL;
+        frame->mask = NULL;
+        frame->user = NULL;
+        frames.push_back(frame);
+        free_frames.push_back(frame);
+    }
+}
+
+Pipeline::~Pipeline() {
+    size_t i;
+
+    stop();
+    for(i = 0; i < stages.size(); i++) {
+        delete stages[i]->queue;
+        pthread_cond_destroy(&(stages[i]->changed));
+        pthread_mutex_destroy(&(stages[i]->lock));
+        delete stages[i];
+    }
+    for(i = 0; i < frames.size(); i++) {
+        if(frames[i]->image != NULL)
+            cvReleaseImage(&(frames[i]->image));
+        if(frames[i]->mask != NULL)
+            cvReleaseImage(&(frames[i]->mask));
+        delete frames[i];
+    }
+    pthread_cond_destroy(&pool_freed);
+    pthread_mutex_destroy(&pool_lock);
+}
+
+int Pipeline::add(const char *name, int input, RIStageFunc func, void *arg, uint32_t depth, int policy) {
+    RIPipeStage *stage;
+
+    if(running || func == NULL || input >= (int)stages.size())
+        return -1;
+
+    stage = new RIPipeStage();
+    strncpy(stage->name, name, RI_PIPE_MAX_NAME - 1);
+    stage->name[RI_PIPE_MAX_NAME - 1] = '\0';
+    stage->func = func;
+    stage->arg = arg;
+    stage->input = input;
+    stage->policy = policy;
+    stage->queue = input >= 0 && policy != RI_PIPE_LATEST ? new SpscRing<RIFrame *>(depth) : NULL;
+    stage->latest = NULL;
+    stage->pipeline = this;
+    pthread_mutex_init(&(stage->lock), NULL);
+    pthread_cond_init(&(stage->changed), NULL);
+    stage->frames = 0;
+    stage->skipped = 0;
+    stage->errors = 0;
+    stage->dropped = 0;
+    stage->busy = 0;
+    stage->max_depth = 0;
+
+    stages.push_back(stage);
+    if(input >= 0)
+        stages[input]->outputs.push_back(stages.size() - 1);
+    return stages.size() - 1;
+}
+
+/**
+ * @param name the name of the stage in the statistics.
+ * @param func fills the frame it is given, a capture for example.
+ * @param arg passed to func.
+ * @return the stage number, -1 if the pipeline is running.
+ */
+int Pipeline::addSource(const char *name, RIStageFunc func, void *arg) {
+    return add(name, -1, func, arg, 0, RI_PIPE_BLOCK);
+}
+
+/**
+ * @param name the name of the stage in the statistics.
+ * @param input the stage whose frames this one takes.
+ * @param func the work on each frame.
+ * @param arg passed to func.
+ * @param depth the number of frames that can wait in front of the stage, rounded up to a power of 2, always 1 for RI_PIPE_LATEST.
+ * @param policy RI_PIPE_BLOCK or RI_PIPE_DROP, what input does when the queue is full, or RI_PIPE_LATEST for a one frame mailbox.
+ * @return the stage number, -1 if the pipeline is running or input is not a stage.
+ */
+int Pipeline::addStage(const char *name, int input, RIStageFunc func, void *arg, uint32_t depth, int policy) {
+    if(input < 0)
+        return -1;
+    return add(name, input, func, arg, depth, policy);
+}
+
+/** @brief Body of a stage thread, until the pipeline stops */
+void *Pipeline::stageThread(void *arg) {
+    RIPipeStage *stage = (RIPipeStage *)arg;
+    Pipeline *p = stage->pipeline;
+    RIFrame *frame;
+    uint64_t start;
+    int ret;
+
+    while(true) {
+        frame = stage->input < 0 ? p->acquire(stage) : p->take(stage);
+        if(frame == NULL)
+            break;
+
+        start = riTimestamp();
+        ret = stage->func(frame, stage->arg);
+        __atomic_add_fetch(&(stage->busy), riTimestamp() - start, __ATOMIC_RELAXED);
+        __atomic_add_fetch(&(stage->frames), 1, __ATOMIC_RELAXED);
+
+        if(ret == RI_RESP_SUCCESS)
+            p->forward(stage, frame);
+        else if(ret == RI_PIPE_SKIP)
+            __atomic_add_fetch(&(stage->skipped), 1, __ATOMIC_RELAXED);
+        else
+            __atomic_add_fetch(&(stage->errors), 1, __ATOMIC_RELAXED);
+        riFrameRelease(frame);
+    }
+    return NULL;
+}
+
+/** @brief A free frame of the pool for a source, NULL once the pipeline stops */
+RIFrame *Pipeline::acquire(RIPipeStage *stage) {
+    RIFrame *frame = NULL;
+
+    pthread_mutex_lock(&pool_lock);
+    while(running && free_frames.empty())
+        pthread_cond_wait(&pool_freed, &pool_lock);
+    if(running) {
+        frame = free_frames.back();
+        free_frames.pop_back();
+    }
+    pthread_mutex_unlock(&pool_lock);
+    if(frame == NULL)
+        return NULL;
+
+    frame->refs = 1;
+    frame->number = (uint32_t)stage->frames;
+    frame->timestamp = riTimestamp();
+    frame->squares.clear();
+    memset(&(frame->trace), 0, sizeof(RITrace));
+    frame->user = NULL;
+    return frame;
+}
+
+/** @brief The next frame queued in front of a stage, NULL once the pipeline stops */
+RIFrame *Pipeline::take(RIPipeStage *stage) {
+    RIFrame *frame;
+
+    if(stage->policy == RI_PIPE_LATEST) {
+        pthread_mutex_lock(&(stage->lock));
+        while(running && stage->latest == NULL)
+            pthread_cond_wait(&(stage->changed), &(stage->lock));
+        frame = running ? stage->latest : NULL;
+        if(frame != NULL)
+            stage->latest = NULL;
+        pthread_mutex_unlock(&(stage->lock));
+        return frame;
+    }
+
+    pthread_mutex_lock(&(stage->lock));
+    while(running && stage->queue->size() == 0)
+        pthread_cond_wait(&(stage->changed), &(stage->lock));
+    pthread_mutex_unlock(&(stage->lock));
+    if(!running)
+        return NULL;
+
+    frame = *(stage->queue->front());
+    stage->queue->release();
+
+    // Room for a producer waiting on a full queue
+    pthread_mutex_lock(&(stage->lock));
+    pthread_cond_broadcast(&(stage->changed));
+    pthread_mutex_unlock(&(stage->lock));
+    return frame;
+}
+
+/** @brief Queue a frame in front of every stage connected to stage, each queue holds a reference */
+void Pipeline::forward(RIPipeStage *stage, RIFrame *frame) {
+    RIPipeStage *next;
+    RIFrame **slot, *old;
+    uint32_t depth;
+    size_t i;
+
+    for(i = 0; i < stage->outputs.size(); i++) {
+        next = stages[stage->outputs[i]];
+
+        // The older frame is worthless to this stage once a newer one is there
+        if(next->policy == RI_PIPE_LATEST) {
+            riFrameRetain(frame);
+            pthread_mutex_lock(&(next->lock));
+            old = next->latest;
+            next->latest = frame;
+            pthread_cond_broadcast(&(next->changed));
+            pthread_mutex_unlock(&(next->lock));
+            if(old != NULL) {
+                riFrameRelease(old);
+                __atomic_add_fetch(&(next->dropped), 1, __ATOMIC_RELAXED);
+            }
+            __atomic_store_n(&(next->max_depth), 1, __ATOMIC_RELAXED);
+            continue;
+        }
+
+        slot = next->queue->claim();
+        if(slot == NULL && next->policy == RI_PIPE_BLOCK) {
+            pthread_mutex_lock(&(next->lock));
+            while(running && (slot = next->queue->claim()) == NULL)
+                pthread_cond_wait(&(next->changed), &(next->lock));
+            pthread_mutex_unlock(&(next->lock));
+        }
+        if(slot == NULL) {
+            __atomic_add_fetch(&(next->dropped), 1, __ATOMIC_RELAXED);
+            continue;
+        }
+
+        riFrameRetain(frame);
+        *slot = frame;
+        next->queue->publish();
+        depth = next->queue->size();
+        if(depth > next->max_depth)
+            __atomic_store_n(&(next->max_depth), depth, __ATOMIC_RELAXED);
+
+        pthread_mutex_lock(&(next->lock));
+        pthread_cond_broadcast(&(next->changed));
+        pthread_mutex_unlock(&(next->lock));
+    }
+}
+
+/** @brief Release the frames left in front of a stage, once no thread runs */
+void Pipeline::drain(RIPipeStage *stage) {
+    RIFrame **slot;
+
+    if(stage->latest != NULL) {
+        riFrameRelease(stage->latest);
+        stage->latest = NULL;
+    }
+    if(stage->queue == NULL)
+        return;
+    while((slot = stage->queue->front()) != NULL) {
+        RIFrame *frame = *slot;
+        stage->queue->release();
+        riFrameRelease(frame);
+    }
+}
+
+/**
+ * @return RI_RESP_SUCCESS, RI_RESP_BUSY if it is already running, RI_RESP_FAILURE if there is no stage or a thread can't be started.
+ */
+int Pipeline::start(void) {
+    size_t i, j;
+
+    if(running)
+        return RI_RESP_BUSY;
+    if(stages.empty())
+        return RI_RESP_FAILURE;
+
+    running = true;
+    started = riTimestamp();
+    ended = 0;
+    for(i = 0; i < stages.size(); i++) {
+        if(pthread_create(&(stages[i]->thread), NULL, stageThread, stages[i]) != 0) {
+            perror("Unable to start a pipeline stage.");
+            // Stop the ones already running
+            running = false;
+            for(j = 0; j < stages.size(); j++) {
+                pthread_mutex_lock(&(stages[j]->lock));
+                pthread_cond_broadcast(&(stages[j]->changed));
+                pthread_mutex_unlock(&(stages[j]->lock));
+            }
+            pthread_mutex_lock(&pool_lock);
+            pthread_cond_broadcast(&pool_freed);
+            pthread_mutex_unlock(&pool_lock);
+            for(j = 0; j < i; j++)
+                pthread_join(stages[j]->thread, NULL);
+            for(j = 0; j < stages.size(); j++)
+                drain(stages[j]);
+            return RI_RESP_FAILURE;
+        }
+    }
+    return RI_RESP_SUCCESS;
+}
+
+/**
+ * @return RI_RESP_SUCCESS.
+ * @note A stage in the middle of its function finishes that frame first.
+ */
+int Pipeline::stop(void) {
+    size_t i;
+
+    if(!running)
+        return RI_RESP_SUCCESS;
+
+    __atomic_store_n(&running, false, __ATOMIC_RELEASE);
+    for(i = 0; i < stages.size(); i++) {
+        pthread_mutex_lock(&(stages[i]->lock));
+        pthread_cond_broadcast(&(stages[i]->changed));
+        pthread_mutex_unlock(&(stages[i]->lock));
+    }
+    pthread_mutex_lock(&pool_lock);
+    pthread_cond_broadcast(&pool_freed);
+    pthread_mutex_unlock(&pool_lock);
+
+    for(i = 0; i < stages.size(); i++)
+        pthread_join(stages[i]->thread, NULL);
+    for(i = 0; i < stages.size(); i++)
+        drain(stages[i]);
+    ended = riTimestamp();
+    return RI_RESP_SUCCESS;
+}
+
+bool Pipeline::isRunning(void) {
+    return running;
+}
+
+/**
+ * @param frame a frame no stage holds anymore.
+ */
+void Pipeline::recycle(RIFrame *frame) {
+    pthread_mutex_lock(&pool_lock);
+    free_frames.push_back(frame);
+    pthread_cond_signal(&pool_freed);
+    pthread_mutex_unlock(&pool_lock);
+}
+
+int Pipeline::stageCount(void) {
+    return stages.size();
+}
+
+/**
+ * @param stage the stage number.
+ * @param stats filled in with its counters.
+ * @return RI_RESP_SUCCESS, RI_RESP_PARAM_RANGE_ERR if there is no such stage.
+ */
+int Pipeline::getStats(int stage, RIStageStats *stats) {
+    RIPipeStage *s;
+
+    if(stage < 0 || stage >= (int)stages.size())
+        return RI_RESP_PARAM_RANGE_ERR;
+
+    s = stages[stage];
+    stats->name = s->name;
+    stats->frames = __atomic_load_n(&(s->frames), __ATOMIC_RELAXED);
+    stats->skipped = __atomic_load_n(&(s->skipped), __ATOMIC_RELAXED);
+    stats->errors = __atomic_load_n(&(s->errors), __ATOMIC_RELAXED);
+    stats->dropped = __atomic_load_n(&(s->dropped), __ATOMIC_RELAXED);
+    stats->busy = __atomic_load_n(&(s->busy), __ATOMIC_RELAXED);
+    if(s->policy == RI_PIPE_LATEST && s->input >= 0) {
+        pthread_mutex_lock(&(s->lock));
+        stats->depth = s->latest != NULL ? 1 : 0;
+        pthread_mutex_unlock(&(s->lock));
+        stats->capacity = 1;
+    } else {
+        stats->depth = s->queue != NULL ? s->queue->size() : 0;
+        stats->capacity = s->queue != NULL ? s->queue->capacity() : 0;
+    }
+    stats->max_depth = __atomic_load_n(&(s->max_depth), __ATOMIC_RELAXED);
+    return RI_RESP_SUCCESS;
+}
+
+/**
+ * @param out where to print, stdout for example.
+ * @note The rates are averages since start(), the load is the share of that time the stage spent working.
+ */
+void Pipeline::printStats(FILE *out) {
+    RIStageStats st;
+    double elapsed;
+    int i;
+
+    elapsed = ((running || ended == 0 ? riTimestamp() : ended) - started) / 1000000.0;
+    if(elapsed <= 0)
+        elapsed = 1;
+
+    fprintf(out, "stage                 fps   load   dropped   skipped    errors  queue\n");
+    for(i = 0; i < (int)stages.size(); i++) {
+        getStats(i, &st);
+        fprintf(out, "%-16s %8.1f %5.1f%% %9llu %9llu %9llu  %u/%u, max %u\n", st.name,
+            st.frames / elapsed, st.busy / 10000.0 / elapsed,
+            (unsigned long long)st.dropped, (unsigned long long)st.skipped, (unsigned long long)st.errors,
+            st.depth, st.capacity, st.max_depth);
+    }
+}
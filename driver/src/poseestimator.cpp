@@ -0,0 +1,221 @@
+/** @file poseestimator.cpp
+ *  @brief Fused pose estimate, see poseestimator.h.
+ *
+ */
+
+#include "poseestimator.h"
+
+#include <unistd.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+/**
+ * @param robot the robot, its connection settings are copied for the North Star polls.
+ * @param odometry a started odometry of the same robot.
+ * @param fix_rate the number of North Star polls per second once start() is called.
+ */
+PoseEstimator::PoseEstimator(RobotInterface *robot, Odometry *odometry, int fix_rate) {
+    robot->getConnection(&conn);
+    this->odometry = odometry;
+    pthread_mutex_init(&lock, NULL);
+    off_x = 0.0;
+    off_y = 0.0;
+    off_theta = 0.0;
+    room_id = -1;
+    nav_signal = RI_ROBOT_NAV_SIGNAL_NO_SIGNAL;
+    last_fix = 0;
+    memset(&last_report, 0, sizeof(RIReport));
+    last_report_time = 0;
+    ns_scale = RI_POSE_NS_TICKS_PER_CM;
+    running = false;
+    rate = fix_rate > 0 ? fix_rate : RI_POSE_DEFAULT_FIX_RATE;
+}
+
+PoseEstimator::~PoseEstimator() {
+    stop();
+    pthread_mutex_destroy(&lock);
+}
+
+void PoseEstimator::setNorthStarScale(double ticks_per_cm) {
+    pthread_mutex_lock(&lock);
+    ns_scale = ticks_per_cm;
+    pthread_mutex_unlock(&lock);
+}
+
+/** @brief The odometry pose at the given time, interpolated between the polls or extrapolated past the latest */
+bool PoseEstimator::odometryAt(uint64_t at, RIOdometrySample *s) {
+    return odometry->sampleAt(at, s) != RI_RESP_FAILURE;
+}
+
+/**
+ * @param report a report from the robot, only x, y, theta, room_id and strength are used.
+ * @param timestamp riTimestamp() when the report was taken, ideally the middle of the request.
+ * @return RI_RESP_SUCCESS, RI_RESP_NO_NS_SIGNAL if the fix was ignored for lack of signal, RI_RESP_FAILURE if the odometry has no sample yet.
+ * @note A fix pulls the estimate towards itself by RI_POSE_GAIN_STRONG, RI_POSE_GAIN_MID or RI_POSE_GAIN_WEAK depending on the signal. The first fix, and the first one after the room changed, is taken as is since the coordinates are relative to the room's beacon.
+ */
+int PoseEstimator::addFix(const RIReport *report, uint64_t timestamp) {
+    RIOdometrySample odo;
+    double gain, c, s, px, py, pth, fx, fy;
+    int signal = riNavStrength(report->strength);
+
+    pthread_mutex_lock(&lock);
+    memcpy(&last_report, report, sizeof(RIReport));
+    last_report_time = timestamp;
+    pthread_mutex_unlock(&lock);
+
+    switch(signal) {
+    case RI_ROBOT_NAV_SIGNAL_STRONG:
+        gain = RI_POSE_GAIN_STRONG;
+        break;
+    case RI_ROBOT_NAV_SIGNAL_MID:
+        gain = RI_POSE_GAIN_MID;
+        break;
+    case RI_ROBOT_NAV_SIGNAL_WEAK:
+        gain = RI_POSE_GAIN_WEAK;
+        break;
+    default:
+        return RI_RESP_NO_NS_SIGNAL;
+    }
+
+    if(!odometryAt(timestamp, &odo))
+        return RI_RESP_FAILURE;
+
+    pthread_mutex_lock(&lock);
+    if(last_fix == 0 || room_id != (int)report->room_id)
+        gain = 1.0;
+
+    // Where we think the robot was when the fix was taken
+    c = cos(off_theta);
+    s = sin(off_theta);
+    px = c * odo.x - s * odo.y + off_x;
+    py = s * odo.x + c * odo.y + off_y;
+    pth = riWrapAngle(odo.theta + off_theta);
+
+    // Move it towards the fix
+    fx = report->x / ns_scale;
+    fy = report->y / ns_scale;
+    px += gain * (fx - px);
+    py += gain * (fy - py);
+    pth = riWrapAngle(pth + gain * riWrapAngle(report->theta - pth));
+
+    // And solve for the transform that maps the odometry pose there
+    off_theta = riWrapAngle(pth - odo.theta);
+    c = cos(off_theta);
+    s = sin(off_theta);
+    off_x = px - (c * odo.x - s * odo.y);
+    off_y = py - (s * odo.x + c * odo.y);
+
+    room_id = report->room_id;
+    nav_signal = signal;
+    last_fix = timestamp;
+    pthread_mutex_unlock(&lock);
+    return RI_RESP_SUCCESS;
+}
+
+/**
+ * @param pose filled in with the estimate.
+ * @param at riTimestamp() to predict the pose for, 0 for now.
+ * @return RI_RESP_SUCCESS, RI_RESP_FAILURE if the odometry has no sample yet.
+ * @note The odometry is interpolated between the polls around at, or extrapolated from the latest one with its velocities by at most RI_ODO_MAX_EXTRAPOLATE. Before the first fix it is in the odometry frame.
+ */
+int PoseEstimator::predict(RIPose *pose, uint64_t at) {
+    RIOdometrySample odo;
+    double c, s, wth;
+
+    if(at == 0)
+        at = riTimestamp();
+    if(!odometryAt(at, &odo))
+        return RI_RESP_FAILURE;
+
+    pthread_mutex_lock(&lock);
+    c = cos(off_theta);
+    s = sin(off_theta);
+    pose->timestamp = at;
+    pose->x = c * odo.x - s * odo.y + off_x;
+    pose->y = s * odo.x + c * odo.y + off_y;
+    pose->theta = riWrapAngle(odo.theta + off_theta);
+    pose->room_id = room_id;
+    pose->nav_signal = nav_signal;
+    pose->last_fix = last_fix;
+    pthread_mutex_unlock(&lock);
+
+    // Robot frame velocity into the estimate frame
+    wth = pose->theta;
+    pose->vx = odo.vx * cos(wth) - odo.vy * sin(wth);
+    pose->vy = odo.vx * sin(wth) + odo.vy * cos(wth);
+    pose->omega = odo.omega;
+    return RI_RESP_SUCCESS;
+}
+
+/**
+ * @param report filled in with the last report given to addFix(), used or not.
+ * @return riTimestamp() the report was taken at, 0 if there is none yet.
+ */
+uint64_t PoseEstimator::lastReport(RIReport *report) {
+    uint64_t timestamp;
+
+    pthread_mutex_lock(&lock);
+    memcpy(report, &last_report, sizeof(RIReport));
+    timestamp = last_report_time;
+    pthread_mutex_unlock(&lock);
+    return timestamp;
+}
+
+bool PoseEstimator::isLocalized(void) {
+    bool localized;
+
+    pthread_mutex_lock(&lock);
+    localized = last_fix != 0;
+    pthread_mutex_unlock(&lock);
+    return localized;
+}
+
+/** @brief Body of the North Star polling thread */
+void *PoseEstimator::fixThread(void *arg) {
+    PoseEstimator *pe = (PoseEstimator *)arg;
+    RIReport report;
+    uint64_t sent, done, period = 1000000 / pe->rate;
+
+    while(pe->running) {
+        sent = riTimestamp();
+        memset(&report, 0, sizeof(RIReport));
+        if(riGetStatus(&(pe->conn), &report) == RI_RESP_SUCCESS) {
+            done = riTimestamp();
+            pe->addFix(&report, sent + (done - sent) / 2);
+        }
+
+        done = riTimestamp();
+        if(done - sent < period)
+            usleep(period - (done - sent));
+    }
+    return NULL;
+}
+
+/**
+ * @return RI_RESP_SUCCESS, RI_RESP_BUSY if the estimator is already polling.
+ */
+int PoseEstimator::start(void) {
+    if(running)
+        return RI_RESP_BUSY;
+
+    running = true;
+    if(pthread_create(&thread, NULL, fixThread, this) != 0) {
+        running = false;
+        perror("Unable to start the North Star thread.");
+        return RI_RESP_FAILURE;
+    }
+    return RI_RESP_SUCCESS;
+}
+
+/**
+ * @return RI_RESP_SUCCESS.
+ */
+int PoseEstimator::stop(void) {
+    if(!running)
+        return RI_RESP_SUCCESS;
+
+    running = false;
+    pthread_join(thread, NULL);
+    return RI_RESP_SUCCESS;
+}
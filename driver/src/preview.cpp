@@ -0,0 +1,221 @@
+/** @file preview.cpp
+ *  @brief Display of frames on a render thread, see preview.h.
+ *
+ */
+
+#include "preview.h"
+
+#include <stdio.h>
+#include <string.h>
+
+/** @brief Reallocate a mailbox image if it can't hold a copy of image */
+static IplImage *riPreviewImage(IplImage **dst, const IplImage *image) {
+    if(*dst != NULL && (*dst)->width == image->width && (*dst)->height == image->height &&
+            (*dst)->nChannels == image->nChannels && (*dst)->depth == image->depth)
+        return *dst;
+    if(*dst != NULL)
+        cvReleaseImage(dst);
+    *dst = cvCreateImage(cvGetSize(image), image->depth, image->nChannels);
+    return *dst;
+}
+
+/**
+ * @param fps the most frames per second rendered per window, the render thread sleeps in between.
+ * @param headless if true, show() only counts the frames and no window is ever created.
+ */
+PreviewDisplay::PreviewDisplay(int fps, bool headless) {
+    window_count = 0;
+    period_ms = fps > 0 ? 1000 / fps : 1000 / RI_PREVIEW_DEFAULT_FPS;
+    if(period_ms < 1)
+        period_ms = 1;
+    this->headless = headless;
+    pthread_mutex_init(&lock, NULL);
+    running = false;
+    last_key = -1;
+}
+
+PreviewDisplay::~PreviewDisplay() {
+    int i;
+
+    stop();
+    for(i = 0; i < window_count; i++) {
+        if(windows[i].back != NULL)
+            cvReleaseImage(&(windows[i].back));
+        if(windows[i].pending != NULL)
+            cvReleaseImage(&(windows[i].pending));
+        if(windows[i].shown != NULL)
+            cvReleaseImage(&(windows[i].shown));
+    }
+    pthread_mutex_destroy(&lock);
+}
+
+/**
+ * @param name the title of the window.
+ * @return the window number, -1 if the display is started or has RI_PREVIEW_MAX_WINDOWS windows.
+ */
+int PreviewDisplay::addWindow(const char *name) {
+    RIPreviewWindow *w;
+
+    if(running || window_count >= RI_PREVIEW_MAX_WINDOWS)
+        return -1;
+
+    w = &windows[window_count];
+    strncpy(w->name, name, RI_PREVIEW_MAX_NAME - 1);
+    w->name[RI_PREVIEW_MAX_NAME - 1] = '\0';
+    w->back = NULL;
+    w->pending = NULL;
+    w->shown = NULL;
+    w->fresh = false;
+    w->posted = 0;
+    w->replaced = 0;
+    w->rendered = 0;
+    return window_count++;
+}
+
+/** @brief Show the frames posted since the last render */
+void PreviewDisplay::render(void) {
+    RIPreviewWindow *w;
+    IplImage *swap;
+    bool fresh;
+    int i;
+
+    for(i = 0; i < window_count; i++) {
+        w = &windows[i];
+
+        // Only the pointers change hands under the lock, never the pixels
+        pthread_mutex_lock(&lock);
+        fresh = w->fresh;
+        if(fresh) {
+            swap = w->shown;
+            w->shown = w->pending;
+            w->pending = swap;
+            w->fresh = false;
+        }
+        pthread_mutex_unlock(&lock);
+
+        if(fresh) {
+            cvShowImage(w->name, w->shown);
+            __atomic_add_fetch(&(w->rendered), 1, __ATOMIC_RELAXED);
+        }
+    }
+}
+
+/** @brief Body of the render thread, renders at most once per period until stopped */
+void *PreviewDisplay::renderThread(void *arg) {
+    PreviewDisplay *pd = (PreviewDisplay *)arg;
+    uint64_t started;
+    int i, wait, key;
+
+    // HighGUI stays on this thread
+    for(i = 0; i < pd->window_count; i++)
+        cvNamedWindow(pd->windows[i].name, CV_WINDOW_AUTOSIZE);
+
+    while(pd->running) {
+        started = riTimestamp();
+        pd->render();
+
+        // The wait for the keys is the pause between two renders
+        wait = pd->period_ms - (int)((riTimestamp() - started) / 1000);
+        key = cvWaitKey(wait > 0 ? wait : 1);
+        if(key >= 0)
+            pd->last_key = key;
+    }
+
+    for(i = 0; i < pd->window_count; i++)
+        cvDestroyWindow(pd->windows[i].name);
+    return NULL;
+}
+
+/**
+ * @return RI_RESP_SUCCESS, RI_RESP_BUSY if it is already started, RI_RESP_FAILURE if the render thread can't be started.
+ */
+int PreviewDisplay::start(void) {
+    if(running)
+        return RI_RESP_BUSY;
+
+    running = true;
+    if(headless)
+        return RI_RESP_SUCCESS;
+    if(pthread_create(&thread, NULL, renderThread, this) != 0) {
+        running = false;
+        perror("Unable to start the preview thread.");
+        return RI_RESP_FAILURE;
+    }
+    return RI_RESP_SUCCESS;
+}
+
+/**
+ * @return RI_RESP_SUCCESS.
+ */
+int PreviewDisplay::stop(void) {
+    if(!running)
+        return RI_RESP_SUCCESS;
+
+    running = false;
+    if(!headless)
+        pthread_join(thread, NULL);
+    return RI_RESP_SUCCESS;
+}
+
+bool PreviewDisplay::isRunning(void) {
+    return running;
+}
+
+bool PreviewDisplay::isHeadless(void) {
+    return headless;
+}
+
+/**
+ * @param window a number returned by addWindow().
+ * @param image the frame, copied so the caller can draw on it again right away.
+ * @return RI_RESP_SUCCESS, RI_RESP_PARAM_RANGE_ERR if there is no such window.
+ * @note Costs one copy of the frame, or nothing at all when headless.
+ */
+int PreviewDisplay::show(int window, const IplImage *image) {
+    RIPreviewWindow *w;
+    IplImage *swap;
+
+    if(window < 0 || window >= window_count)
+        return RI_RESP_PARAM_RANGE_ERR;
+    w = &windows[window];
+    __atomic_add_fetch(&(w->posted), 1, __ATOMIC_RELAXED);
+    if(headless)
+        return RI_RESP_SUCCESS;
+
+    cvCopy(image, riPreviewImage(&(w->back), image), NULL);
+
+    pthread_mutex_lock(&lock);
+    if(w->fresh)
+        __atomic_add_fetch(&(w->replaced), 1, __ATOMIC_RELAXED);
+    swap = w->pending;
+    w->pending = w->back;
+    w->back = swap;
+    w->fresh = true;
+    pthread_mutex_unlock(&lock);
+    return RI_RESP_SUCCESS;
+}
+
+/**
+ * @return the key code, -1 if no key was pressed since the last call.
+ */
+int PreviewDisplay::key(void) {
+    return __atomic_exchange_n(&last_key, -1, __ATOMIC_RELAXED);
+}
+
+uint32_t PreviewDisplay::posted(int window) {
+    if(window < 0 || window >= window_count)
+        return 0;
+    return __atomic_load_n(&(windows[window].posted), __ATOMIC_RELAXED);
+}
+
+uint32_t PreviewDisplay::replaced(int window) {
+    if(window < 0 || window >= window_count)
+        return 0;
+    return __atomic_load_n(&(windows[window].replaced), __ATOMIC_RELAXED);
+}
+
+uint32_t PreviewDisplay::rendered(int window) {
+    if(window < 0 || window >= window_count)
+        return 0;
+    return __atomic_load_n(&(windows[window].rendered), __ATOMIC_RELAXED);
+}
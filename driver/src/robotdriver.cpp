@@ -7,6 +7,11 @@
  */
 
 #include "robotdriver.h"
+#include "telemetry.h"
+#include "squaredetector.h"
+#include "imagesaver.h"
+#include "framerecord.h"
+#include "latency.h"
 #include <iostream>
 
 #include <unistd.h>
@@ -16,6 +21,9 @@
 #include <netdb.h>
 #include <string.h>
 #include <time.h>
+#include <setjmp.h>
+#include <errno.h>
+#include <sys/stat.h>
 #include <jpeglib.h>
 
 
@@ -94,6 +102,7 @@ int httpRequest(RobotIfType *ri, char *cmd, char *response, int rlen, bool game_
     // Receive the header (and some data)
     // Hope that the \r\n\r\n isn't in the break
     data_recvd = recv(ri->sock, req, 512, SOCK_NONBLOCK);
+    ri->first_byte = riTimestamp();
     start_of_data = strstr(req, "\r\n\r\n");
     // We didn't actually recv the header, bail out
     if(start_of_data == NULL)
@@ -380,7 +389,7 @@ int riGetWheelEncoder(RobotIfType *ri, int wheel) {
     return 0;
 }
 /** @brief Robot Movement, get wheel's encoder totally*/
-int riGetWheelEncoderTotals(RobotIfType *ri, int wheel) {
+long long riGetWheelEncoderTotals(RobotIfType *ri, int wheel) {
     // Get the desired wheel
     switch(wheel) {
     case RI_WHEEL_LEFT:
@@ -417,6 +426,47 @@ int riUpdate(RobotIfType *ri) {
     return ret;
 }
 
+/** @brief Classify a raw North Star signal strength */
+int riNavStrength(unsigned int strength) {
+    if(strength > 47000)
+        return RI_ROBOT_NAV_SIGNAL_STRONG;
+    else if(strength > 20000)
+        return RI_ROBOT_NAV_SIGNAL_MID;
+    else if(strength > 5000)
+        return RI_ROBOT_NAV_SIGNAL_WEAK;
+    else // strength < 5000
+        return RI_ROBOT_NAV_SIGNAL_NO_SIGNAL;
+}
+
+/** @brief Monotonic time in microseconds */
+uint64_t riTimestamp(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+}
+
+/**
+ * @param next the start of the current period, from clock_gettime(CLOCK_MONOTONIC) before the first one. Moved to the start of the next period.
+ * @param period_us the length of a period in microseconds.
+ * @return 0, or the number of periods that were already over. They are skipped, the loop keeps its phase and does not run them late.
+ */
+int riWaitPeriod(struct timespec *next, uint64_t period_us) {
+    uint64_t due, now;
+    int missed = 0;
+
+    due = (uint64_t)next->tv_sec * 1000000ULL + next->tv_nsec / 1000 + period_us;
+    now = riTimestamp();
+    if(due < now && period_us > 0) {
+        missed = (int)((now - due) / period_us) + 1;
+        due += missed * period_us;
+    }
+    next->tv_sec = due / 1000000ULL;
+    next->tv_nsec = (due % 1000000ULL) * 1000;
+    clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, next, NULL);
+    return missed;
+}
+
 /** @brief Finds a cosine of angle between vectors from pt0->pt1 and from pt0->pt2*/
 double riAngle(CvPoint* pt1, CvPoint* pt2, CvPoint* pt0) {
     double dx1 = pt1->x - pt0->x;
@@ -435,6 +485,16 @@ double riAngle(CvPoint* pt1, CvPoint* pt2, CvPoint* pt0) {
 RobotInterface::RobotInterface(const char* address, int robot_id) {
 	// Clear the robot interface struct
     memset(&ri, 0, sizeof(RobotIfType));
+    telemetry = NULL;
+    detector = NULL;
+    saver = NULL;
+    recorder = NULL;
+    jpeg = NULL;
+    jpeg_size = 0;
+    jpeg_time = 0;
+    memset(&trace, 0, sizeof(RITrace));
+    trace_frames = 0;
+    latency = NULL;
 
 	// Configure the robot interface
     if(riSetup(&ri, address, robot_id)) {
@@ -445,6 +505,8 @@ RobotInterface::RobotInterface(const char* address, int robot_id) {
 }
 
 RobotInterface::~RobotInterface(){
+    delete detector;
+    free(jpeg);
 	return;
 }
 
@@ -458,6 +520,15 @@ void RobotInterface::APIVersion(int* major, int* minor) {
     *minor = 0;
 }
 
+/**
+ * @param conn filled in with a copy of the robot interface, without an open socket.
+ * @note httpRequest() keeps its socket in the interface, so a thread polling the robot in the background must use its own copy instead of sharing this one.
+ */
+void RobotInterface::getConnection(RobotIfType *conn) {
+    memcpy(conn, &ri, sizeof(RobotIfType));
+    conn->sock = -1;
+}
+
 /**********************************************************
  * Movement control
  **********************************************************/
@@ -487,19 +558,37 @@ void RobotInterface::APIVersion(int* major, int* minor) {
  * </pre>
  */
 int RobotInterface::move(int movement, int speed) {
+    return move(movement, speed, &trace);
+}
+
+/**
+ * @param movement see move().
+ * @param speed see move().
+ * @param trace the trace of the frame the move is based on, from getTrace(). Only its first move is marked.
+ * @return see move().
+ */
+int RobotInterface::move(int movement, int speed, RITrace *trace) {
     char response[512];
     char cmd[128];
     char *start_of_resp;
     int result;
+    uint64_t sent = riTimestamp();
 
     // Send the move command
     sprintf(cmd, "rev.cgi?Cmd=nav&action=18&drive=%i&speed=%i", movement, speed);
     httpRequest(&ri, cmd, response, 512, false);
     start_of_resp = strstr(response, "responses = ");
     if(start_of_resp == NULL)
-        return RI_RESP_FAILURE;
-    sscanf(start_of_resp + 12, "%i", &result);
+        result = RI_RESP_FAILURE;
+    else
+        sscanf(start_of_resp + 12, "%i", &result);
 
+    if(trace != NULL && trace->t[RI_TRACE_REQUEST] != 0 && trace->t[RI_TRACE_COMMAND] == 0) {
+        trace->t[RI_TRACE_COMMAND] = sent;
+        trace->t[RI_TRACE_ACKED] = riTimestamp();
+    }
+    if(telemetry != NULL)
+        telemetry->record(RI_TLM_CMD_MOVE, movement, speed, result, sent, riTimestamp(), &(ri.sensor), &(ri.report));
     return result;
 }
 
@@ -523,6 +612,226 @@ int RobotInterface::goHome(void) {
 
 }
 
+/**********************************************************
+ * Path recording and playback
+ **********************************************************/
+
+/** @brief Percent-encode a path name so it can be passed in a query string */
+static int riUrlEncode(const char *in, char *out, int olen) {
+    static const char hex[] = "0123456789ABCDEF";
+    int n = 0;
+
+    for(; *in != '\0'; in++) {
+        unsigned char c = (unsigned char)*in;
+        if((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '-' || c == '_' || c == '.') {
+            if(n + 1 >= olen)
+                return RI_RESP_PARAM_RANGE_ERR;
+            out[n++] = c;
+        } else {
+            if(n + 3 >= olen)
+                return RI_RESP_PARAM_RANGE_ERR;
+            out[n++] = '%';
+            out[n++] = hex[c >> 4];
+            out[n++] = hex[c & 0xF];
+        }
+    }
+    out[n] = '\0';
+    return RI_RESP_SUCCESS;
+}
+
+/** @brief Send a navigation command and return the robot's response code */
+static int riNavCommand(RobotIfType *ri, const char *cmd, char *response, int rlen) {
+    char *start_of_resp;
+    int result;
+
+    httpRequest(ri, (char *)cmd, response, rlen, false);
+    start_of_resp = strstr(response, "responses = ");
+    if(start_of_resp == NULL)
+        return RI_RESP_FAILURE;
+    sscanf(start_of_resp + 12, "%i", &result);
+    return result;
+}
+
+/** @brief Send a navigation command that takes a path name */
+static int riNavPathCommand(RobotIfType *ri, int action, const char *name) {
+    char response[512];
+    char cmd[256];
+    char enc[3 * RI_MAX_PATH_NAME];
+
+    if(name == NULL || name[0] == '\0' || strlen(name) >= RI_MAX_PATH_NAME)
+        return RI_RESP_NO_PARAM;
+    if(riUrlEncode(name, enc, sizeof(enc)) != RI_RESP_SUCCESS)
+        return RI_RESP_PARAM_RANGE_ERR;
+
+    sprintf(cmd, "rev.cgi?Cmd=nav&action=%i&name=%s", action, enc);
+    return riNavCommand(ri, cmd, response, 512);
+}
+
+/**
+ * @return the response code of the robot.
+ * @note Starts recording a path. Every movement made from now on is stored by the robot until stopPathRecording() or abortPathRecording() is called.
+ */
+int RobotInterface::startPathRecording(void) {
+    char response[512];
+
+    // StartRecording
+    return riNavCommand(&ri, "rev.cgi?Cmd=nav&action=2", response, 512);
+}
+
+/**
+ * @return the response code of the robot.
+ * @note Stops the recording in progress and throws the recorded movements away.
+ */
+int RobotInterface::abortPathRecording(void) {
+    char response[512];
+
+    // AbortRecording
+    return riNavCommand(&ri, "rev.cgi?Cmd=nav&action=3", response, 512);
+}
+
+/**
+ * @param name the name the path is stored under, shorter than RI_MAX_PATH_NAME.
+ * @return the response code of the robot, RI_RESP_NO_PARAM if the name is empty or too long.
+ * @note Stops the recording in progress and stores it on the robot. A stored path with the same name is replaced.
+ */
+int RobotInterface::stopPathRecording(const char *name) {
+    // StopRecording
+    return riNavPathCommand(&ri, 4, name);
+}
+
+/**
+ * @param name the name of the stored path.
+ * @return the response code of the robot.
+ */
+int RobotInterface::deletePath(const char *name) {
+    // DeletePath
+    return riNavPathCommand(&ri, 5, name);
+}
+
+/**
+ * @param name the name of the stored path.
+ * @param new_name the new name of the path, shorter than RI_MAX_PATH_NAME.
+ * @return the response code of the robot, RI_RESP_NO_PARAM if a name is empty or too long.
+ */
+int RobotInterface::renamePath(const char *name, const char *new_name) {
+    char response[512];
+    char enc[3 * RI_MAX_PATH_NAME];
+    char new_enc[3 * RI_MAX_PATH_NAME];
+    char cmd[sizeof(enc) + sizeof(new_enc) + 64];
+
+    if(name == NULL || new_name == NULL || name[0] == '\0' || new_name[0] == '\0')
+        return RI_RESP_NO_PARAM;
+    if(strlen(name) >= RI_MAX_PATH_NAME || strlen(new_name) >= RI_MAX_PATH_NAME)
+        return RI_RESP_NO_PARAM;
+    if(riUrlEncode(name, enc, sizeof(enc)) != RI_RESP_SUCCESS ||
+            riUrlEncode(new_name, new_enc, sizeof(new_enc)) != RI_RESP_SUCCESS)
+        return RI_RESP_PARAM_RANGE_ERR;
+
+    // RenamePath
+    if(snprintf(cmd, sizeof(cmd), "rev.cgi?Cmd=nav&action=11&name=%s&newname=%s", enc, new_enc) >= (int)sizeof(cmd))
+        return RI_RESP_PARAM_RANGE_ERR;
+    return riNavCommand(&ri, cmd, response, 512);
+}
+
+/**
+ * @param paths filled in with the names of the paths stored on the robot.
+ * @return the response code of the robot.
+ * @note At most RI_MAX_PATHS names are returned, longer names are truncated to RI_MAX_PATH_NAME - 1 characters.
+ */
+int RobotInterface::getPathList(RIPathList *paths) {
+    char response[2048];
+    char *start_of_resp;
+    char *tok, *save;
+    int result;
+
+    memset(paths, 0, sizeof(RIPathList));
+
+    // GetPathList
+    result = riNavCommand(&ri, "rev.cgi?Cmd=nav&action=6", response, 2048);
+    if(result != RI_RESP_SUCCESS)
+        return result;
+
+    // The names follow the response code, one "path=<name>" entry per field
+    start_of_resp = strstr(response, "responses = ") + 12;
+    strtok_r(start_of_resp, "|\r\n", &save);
+    while((tok = strtok_r(NULL, "|\r\n", &save)) != NULL && paths->count < RI_MAX_PATHS) {
+        if(strncmp(tok, "path=", 5) == 0)
+            tok += 5;
+        if(tok[0] == '\0')
+            continue;
+        strncpy(paths->name[paths->count], tok, RI_MAX_PATH_NAME - 1);
+        paths->count++;
+    }
+
+    return RI_RESP_SUCCESS;
+}
+
+/**
+ * @return the response code of the robot.
+ */
+int RobotInterface::clearAllPaths(void) {
+    char response[512];
+
+    // ClearAllPaths
+    return riNavCommand(&ri, "rev.cgi?Cmd=nav&action=21", response, 512);
+}
+
+/**
+ * @param name the name of the stored path.
+ * @return the response code of the robot.
+ * @note The robot drives the whole path by itself, poll robotState() after update() to know when it has finished.
+ */
+int RobotInterface::playPathForward(const char *name) {
+    // PlayPathForward
+    return riNavPathCommand(&ri, 7, name);
+}
+
+/**
+ * @param name the name of the stored path.
+ * @return the response code of the robot.
+ * @note Drives the path in reverse, which brings the robot back to where the recording was started.
+ */
+int RobotInterface::playPathBackward(const char *name) {
+    // PlayPathBackward
+    return riNavPathCommand(&ri, 8, name);
+}
+
+/**
+ * @return the response code of the robot.
+ * @note Calling it again resumes the path.
+ */
+int RobotInterface::pausePlaying(void) {
+    char response[512];
+
+    // PausePlaying
+    return riNavCommand(&ri, "rev.cgi?Cmd=nav&action=10", response, 512);
+}
+
+/**
+ * @return the response code of the robot.
+ */
+int RobotInterface::stopPlaying(void) {
+    char response[512];
+
+    // StopPlaying
+    return riNavCommand(&ri, "rev.cgi?Cmd=nav&action=9", response, 512);
+}
+
+/**
+ * @return the robot state of the cached report.
+ * @note The value returned will be one of:
+ * <pre>
+ *      RI_ROBOT_STATE_IDLE
+ *      RI_ROBOT_STATE_DRIVING
+ *      RI_ROBOT_STATE_DOCKING
+ *      RI_ROBOT_STATE_PATH
+ *      RI_ROBOT_STATE_REC_PATH
+ * </pre>
+ */
+int RobotInterface::robotState(void) {
+    return (&ri)->report.state;
+}
+
 /**
  * @param wheel specify the wheel using one of the left, right, or rear.
  * @return the move direction of the wheel.
@@ -580,7 +889,7 @@ int RobotInterface::getWheelEncoder(int wheel) {
  * @return The total movement of the requested wheel encoder since the last reset or initialization.
  * @note  Forward overall movement is represented with a positive number, while backward overall movement is represented with a negative number. Four ticks of an encoder is about 1cm.
  */
-int RobotInterface::getWheelEncoderTotals(int wheel) {
+long long RobotInterface::getWheelEncoderTotals(int wheel) {
     // Get the desired wheel
     switch(wheel) {
     case RI_WHEEL_LEFT:
@@ -649,33 +958,18 @@ bool RobotInterface::IRDetected(void) {
 }
 
 /**
- * @return RI_RESP_SUCCESS.
- * @note Store the result of IR detector,reserve1 if there is obstacle, reserve 0 if there is no obstacle.
+ * @return RI_RESP_SUCCESS, RI_RESP_FAILURE if no telemetry log is attached.
+ * @note Stores the result of the IR detector in the cached sensor data (1 if there is an obstacle, 0 if there is none) as a RI_TLM_CMD_IR_STATUS record of the telemetry log set with setTelemetry().
  */
 int RobotInterface::IRStatus(void){
-     int sta;
-     if(IRDetected())
-         sta = 1;
-     else
-         sta = 0;
-  //printf the sta with the result by IRDetected
-     printf("%d\n",sta);
-  //reserve the 1 or 0 in a file that you can name it
-     FILE *fp = NULL;
-     char fname[32];
-     char filename[50];
-     printf("Please enter the file's name\n");
-     scanf("%s",fname);
-     strcat(fname,".txt");
-     sprintf(filename,"/home/zzy/Rovio-image/%s",fname);
-     fp = fopen(filename,"a+");
-     if(fp==NULL){
-         printf("file open failed!");
-         return -1;
-     }
-     fprintf(fp,"%d\n",sta);
-     fclose(fp);
-return RI_RESP_SUCCESS;
+    uint64_t now;
+
+    if(telemetry == NULL)
+        return RI_RESP_FAILURE;
+
+    now = riTimestamp();
+    telemetry->record(RI_TLM_CMD_IR_STATUS, IRDetected() ? 1 : 0, 0, RI_RESP_SUCCESS, now, now, &(ri.sensor), &(ri.report));
+    return RI_RESP_SUCCESS;
 }
 
 /**
@@ -732,14 +1026,7 @@ float RobotInterface::Theta(void) {
  * </pre>
  */
 int RobotInterface::NavStrength(void) {
-    if((&ri)->report.strength > 47000)
-        return RI_ROBOT_NAV_SIGNAL_STRONG;
-    else if((&ri)->report.strength > 20000)
-        return RI_ROBOT_NAV_SIGNAL_MID;
-    else if((&ri)->report.strength > 5000)
-        return RI_ROBOT_NAV_SIGNAL_WEAK;
-    else // ri->report.strength < 5000
-        return RI_ROBOT_NAV_SIGNAL_NO_SIGNAL;
+    return riNavStrength((&ri)->report.strength);
 }
 /**
  * @return the signal strength of the North Star system indicated by the RoomID.
@@ -849,19 +1136,20 @@ RIReport *RobotInterface::getReport(void) {
  */
 int RobotInterface::update(void) {
     int ret;
+    uint64_t sent = riTimestamp();
 
     ret = riGetSensorData(&ri, &((&ri)->sensor));
-    if(ret != RI_RESP_SUCCESS)
-        return ret;
-
-    ret = riGetStatus(&ri, &((&ri)->report));
-    if(ret != RI_RESP_SUCCESS)
-        return ret;
+    if(ret == RI_RESP_SUCCESS)
+        ret = riGetStatus(&ri, &((&ri)->report));
 
-    (&ri)->right_wheel_enc += riGetWheelEncoder((&ri), RI_WHEEL_RIGHT);
-    (&ri)->left_wheel_enc += riGetWheelEncoder((&ri), RI_WHEEL_LEFT);
-    (&ri)->rear_wheel_enc += riGetWheelEncoder((&ri), RI_WHEEL_REAR);
+    if(ret == RI_RESP_SUCCESS) {
+        (&ri)->right_wheel_enc += riGetWheelEncoder((&ri), RI_WHEEL_RIGHT);
+        (&ri)->left_wheel_enc += riGetWheelEncoder((&ri), RI_WHEEL_LEFT);
+        (&ri)->rear_wheel_enc += riGetWheelEncoder((&ri), RI_WHEEL_REAR);
+    }
 
+    if(telemetry != NULL)
+        telemetry->record(RI_TLM_CMD_UPDATE, 0, 0, ret, sent, riTimestamp(), &(ri.sensor), &(ri.report));
     return ret;
 }
 
@@ -879,45 +1167,235 @@ void RobotInterface::resetState(void) {
     return;
 }
 
+/**
+ * @param log the log to write to, it must stay open while it is attached. NULL detaches the log.
+ * @note Every update() and move() then appends a record with the cached sensor data and report, the response code and the round trip latency.
+ */
+void RobotInterface::setTelemetry(TelemetryLog *log) {
+    telemetry = log;
+}
+
 /**********************************************************
  * Camera Interface
  **********************************************************/
 #include "jpegworkaround.h"
 
-// Get a jpeg image from the robot
 /**
- * @param image image is IplImage format used by OpenCV.
- * @return Captures an image from the camera in the IplImage format used by OpenCV.
- * @note The image must be pre-allocated. The captured image is in BGR format.
+ * @param data set to the JPEG bytes, valid until the next capture.
+ * @param size set to the number of bytes.
+ * @return RI_RESP_SUCCESS, RI_RESP_FAILURE if no image was received.
+ * @note The bytes are kept for lastJpeg() and saveImage(). With a recorder set by setRecorder() the frame is also appended to the recording, with the cached sensor data and report. The trace of the frame before is handed to the LatencyStats set by setLatencyStats() and a new one starts.
  */
-int RobotInterface::getImage(IplImage *image) {
+int RobotInterface::getJpeg(const unsigned char **data, int *size) {
     char cmd[32];
-    unsigned char *response;
-    int data_sz, row;
-#ifdef JPEG_NO_MEMCPY
-    CvScalar s;
-    int col;
-#endif
-    // libJPEG
-    struct jpeg_decompress_struct cinfo;
-    struct jpeg_error_mgr jerr;
-    JSAMPROW row_pointer[1]; // Stores one row
-
-    // Setup the jpeg error handler
-    cinfo.err = jpeg_std_error(&jerr);
 
     // Image number (random as specified in the docs... :p)
     int img_num = rand() % 9999 + 1;
 
-    // Allocate memory for the camera image. We know it's up to a 640x480 camera,
+    // Allocate memory for the camera image once. We know it's up to a 640x480 camera,
     // so at 3 bytes per pixel (max), allocate 1MB, might be wasteful, but safe
-    response = (unsigned char*)calloc(1, RI_CAMERA_MAX_IMG_SIZE);
+    if(jpeg == NULL)
+        jpeg = (unsigned char*)calloc(1, RI_CAMERA_MAX_IMG_SIZE);
 
     // Get the camera image
     sprintf(cmd, "Jpeg/CamImg%i.jpg", img_num);
-    data_sz = httpRequest(&ri, cmd, (char *)response, RI_CAMERA_MAX_IMG_SIZE, false);
-    if(data_sz == 0) {
-        free(response);
+    jpeg_time = riTimestamp();
+
+    // The last frame is done with, whatever it went through
+    if(latency != NULL && trace.t[RI_TRACE_REQUEST] != 0)
+        latency->add(&trace);
+    memset(&trace, 0, sizeof(RITrace));
+    trace.frame = trace_frames++;
+    trace.t[RI_TRACE_REQUEST] = jpeg_time;
+
+    ri.first_byte = 0;
+    jpeg_size = httpRequest(&ri, cmd, (char *)jpeg, RI_CAMERA_MAX_IMG_SIZE, false);
+    *data = jpeg;
+    *size = jpeg_size;
+    trace.t[RI_TRACE_FIRST_BYTE] = ri.first_byte;
+    if(jpeg_size <= 0)
+        return RI_RESP_FAILURE;
+    trace.t[RI_TRACE_RECEIVED] = riTimestamp();
+
+    if(recorder != NULL)
+        recorder->record(jpeg, jpeg_size, jpeg_time, &(ri.sensor), &(ri.report));
+    return RI_RESP_SUCCESS;
+}
+
+/**
+ * @param data set to the JPEG bytes of the last getImage() or getJpeg(), valid until the next capture.
+ * @param size set to the number of bytes.
+ * @return RI_RESP_SUCCESS, RI_RESP_FAILURE if no image was captured yet.
+ */
+int RobotInterface::lastJpeg(const unsigned char **data, int *size) {
+    *data = jpeg;
+    *size = jpeg_size;
+    return jpeg_size > 0 ? RI_RESP_SUCCESS : RI_RESP_FAILURE;
+}
+
+/**
+ * @param trace the trace to mark.
+ * @param point one of RI_TRACE_*.
+ */
+void riTraceMark(RITrace *trace, int point) {
+    if(point < 0 || point >= RI_TRACE_POINTS || trace->t[point] != 0)
+        return;
+    trace->t[point] = riTimestamp();
+}
+
+/**
+ * @param point one of RI_TRACE_*, RI_TRACE_PROCESSED once a tracker is done with the frame for example.
+ */
+void RobotInterface::traceMark(int point) {
+    riTraceMark(&trace, point);
+}
+
+/**
+ * @param trace filled with the trace of the last captured frame. Pass it to move() to mark the command on it.
+ */
+void RobotInterface::getTrace(RITrace *trace) {
+    memcpy(trace, &(this->trace), sizeof(RITrace));
+}
+
+/**
+ * @param stats the statistics to add the traces to, they must stay valid while set. NULL stops collecting.
+ * @note A trace is added when the next frame is captured, with the points it reached by then.
+ */
+void RobotInterface::setLatencyStats(LatencyStats *stats) {
+    latency = stats;
+}
+
+/**
+ * @param resolution one of RI_CAMERA_RES_*.
+ * @return the size of the frames the camera sends at that resolution.
+ */
+CvSize riCameraSize(int resolution) {
+    switch(resolution) {
+    case RI_CAMERA_RES_176:
+        return cvSize(176, 144);
+    case RI_CAMERA_RES_320:
+        return cvSize(320, 240);
+    case RI_CAMERA_RES_352:
+        return cvSize(352, 288);
+    default:
+        return cvSize(640, 480);
+    }
+}
+
+/** @brief libjpeg error manager returning to the decoder, the default one exits */
+typedef struct {
+    struct jpeg_error_mgr pub;
+    jmp_buf jump;
+} RIJpegError;
+
+/** @brief error_exit of RIJpegError, back to the setjmp() of the decoder */
+static void riJpegErrorExit(j_common_ptr cinfo) {
+    longjmp(((RIJpegError *)cinfo->err)->jump, 1);
+}
+
+/**
+ * @param jpeg the bytes of a JPEG file.
+ * @param size the number of bytes.
+ * @param dim set to the size of the image.
+ * @return RI_RESP_SUCCESS, RI_RESP_FAILURE if the header can't be read.
+ */
+int riJpegSize(const unsigned char *jpeg, int size, CvSize *dim) {
+    struct jpeg_decompress_struct cinfo;
+    RIJpegError jerr;
+
+    cinfo.err = jpeg_std_error(&(jerr.pub));
+    jerr.pub.error_exit = riJpegErrorExit;
+    if(setjmp(jerr.jump)) {
+        jpeg_destroy_decompress(&cinfo);
+        return RI_RESP_FAILURE;
+    }
+    jpeg_create_decompress(&cinfo);
+    if(jj_mem_src(&cinfo, (unsigned char *)jpeg, size) == RI_RESP_FAILURE ||
+            jpeg_read_header(&cinfo, TRUE) != JPEG_HEADER_OK) {
+        jpeg_destroy_decompress(&cinfo);
+        return RI_RESP_FAILURE;
+    }
+    *dim = cvSize(cinfo.image_width, cinfo.image_height);
+    jpeg_destroy_decompress(&cinfo);
+    return RI_RESP_SUCCESS;
+}
+
+/**
+ * @param jpeg the bytes of a JPEG file.
+ * @param size the number of bytes.
+ * @param image a pre-allocated 1 channel image of an eighth of the size of the JPEG, rounded up.
+ * @return RI_RESP_SUCCESS, RI_RESP_FAILURE if the JPEG can't be decoded into image.
+ * @note Every pixel is the mean gray level of an 8x8 block. At 1/8 scale libjpeg only uses the DC coefficient of each block, so this costs the entropy decoding and none of the inverse DCT, upsampling or color conversion.
+ */
+int riDecodeJpegDC(const unsigned char *jpeg, int size, IplImage *image) {
+    struct jpeg_decompress_struct cinfo;
+    RIJpegError jerr;
+    JSAMPROW row_pointer[1];
+
+    cinfo.err = jpeg_std_error(&(jerr.pub));
+    jerr.pub.error_exit = riJpegErrorExit;
+    if(setjmp(jerr.jump)) {
+        jpeg_destroy_decompress(&cinfo);
+        return RI_RESP_FAILURE;
+    }
+    jpeg_create_decompress(&cinfo);
+    if(jj_mem_src(&cinfo, (unsigned char *)jpeg, size) == RI_RESP_FAILURE ||
+            jpeg_read_header(&cinfo, TRUE) != JPEG_HEADER_OK) {
+        jpeg_destroy_decompress(&cinfo);
+        return RI_RESP_FAILURE;
+    }
+
+    // Only the luminance, one pixel per block
+    cinfo.out_color_space = JCS_GRAYSCALE;
+    cinfo.scale_num = 1;
+    cinfo.scale_denom = 8;
+    cinfo.dct_method = JDCT_IFAST;
+    cinfo.do_fancy_upsampling = FALSE;
+    jpeg_start_decompress(&cinfo);
+
+    if((int)cinfo.output_width != image->width || (int)cinfo.output_height != image->height || image->nChannels != 1) {
+        jpeg_abort_decompress(&cinfo);
+        jpeg_destroy_decompress(&cinfo);
+        return RI_RESP_FAILURE;
+    }
+
+    // Straight into the rows of the image
+    while(cinfo.output_scanline < cinfo.output_height) {
+        row_pointer[0] = (JSAMPROW)(image->imageData + image->widthStep * cinfo.output_scanline);
+        jpeg_read_scanlines(&cinfo, row_pointer, 1);
+    }
+
+    jpeg_finish_decompress(&cinfo);
+    jpeg_destroy_decompress(&cinfo);
+    return RI_RESP_SUCCESS;
+}
+
+/**
+ * @param jpeg the bytes of a JPEG file, from the camera or a recording.
+ * @param size the number of bytes.
+ * @param image a pre-allocated 3 channel image of the size of the JPEG.
+ * @return RI_RESP_SUCCESS, RI_RESP_FAILURE if the JPEG can't be decoded into image. The image is then zeroed.
+ * @note The decoded image is in BGR format.
+ */
+int riDecodeJpeg(const unsigned char *jpeg, int size, IplImage *image) {
+    int row;
+#ifdef JPEG_NO_MEMCPY
+    CvScalar s;
+    int col;
+#endif
+    // libJPEG
+    struct jpeg_decompress_struct cinfo;
+    RIJpegError jerr;
+    JSAMPROW row_pointer[1]; // Stores one row
+    unsigned char * volatile row_buffer = NULL; // Freed after a jump
+
+    // Setup the jpeg error handler, a corrupt frame returns here instead of exiting
+    cinfo.err = jpeg_std_error(&(jerr.pub));
+    jerr.pub.error_exit = riJpegErrorExit;
+    if(setjmp(jerr.jump)) {
+        printf("Unable to decode the JPEG\n");
+        jpeg_destroy_decompress(&cinfo);
+        free(row_buffer);
         cvZero(image);
         return RI_RESP_FAILURE;
     }
@@ -925,7 +1403,7 @@ int RobotInterface::getImage(IplImage *image) {
 #ifdef DEBUG_DUMP_JPEG
     FILE *f;
     f = fopen("test.jpg", "w");
-    fwrite(response, 1, data_sz, f);
+    fwrite(jpeg, 1, size, f);
     fclose(f);
 #endif
 
@@ -933,17 +1411,21 @@ int RobotInterface::getImage(IplImage *image) {
     jpeg_create_decompress(&cinfo);
 
     // Make the JPEG library read from memory (the image we captured from the camera)
-    if(jj_mem_src(&cinfo, response, data_sz) == RI_RESP_FAILURE) {
+    if(jj_mem_src(&cinfo, (unsigned char *)jpeg, size) == RI_RESP_FAILURE) {
         // Cleanup
         jpeg_destroy_decompress(&cinfo);
-        free(response);
         printf("Unable to set up the decompression routine\n");
         cvZero(image);
         return RI_RESP_FAILURE;
     }
 
     // Read the header information
-    jpeg_read_header(&cinfo, TRUE);
+    if(jpeg_read_header(&cinfo, TRUE) != JPEG_HEADER_OK) {
+        jpeg_destroy_decompress(&cinfo);
+        printf("Unable to read the JPEG header\n");
+        cvZero(image);
+        return RI_RESP_FAILURE;
+    }
 #ifdef DEBUG_JPEG
     printf("W: %i, H: %i, NC: %i\n", cinfo.image_width, cinfo.image_height, cinfo.num_components);
 #endif
@@ -951,8 +1433,19 @@ int RobotInterface::getImage(IplImage *image) {
     // Start decompressing
     jpeg_start_decompress(&cinfo);
 
+    // The rows are copied as they are, they must fit
+    if((int)cinfo.output_width != image->width || (int)cinfo.output_height != image->height ||
+            cinfo.output_components != image->nChannels) {
+        printf("The image is %ix%i, not %ix%i\n", cinfo.output_width, cinfo.output_height, image->width, image->height);
+        jpeg_abort_decompress(&cinfo);
+        jpeg_destroy_decompress(&cinfo);
+        cvZero(image);
+        return RI_RESP_FAILURE;
+    }
+
     // Allocate the row buffer
-    row_pointer[0] = (unsigned char *)malloc(cinfo.output_width * cinfo.num_components);
+    row_buffer = (unsigned char *)malloc(cinfo.output_width * cinfo.num_components);
+    row_pointer[0] = row_buffer;
 
     // Copy the data into the IPL Image
     // Perhaps fix this to just memcpy?
@@ -987,160 +1480,100 @@ int RobotInterface::getImage(IplImage *image) {
     jpeg_destroy_decompress(&cinfo);
 
     // Cleanup
-    free(row_pointer[0]);
-    free(response);
+    free(row_buffer);
     return RI_RESP_SUCCESS;
 }
 
+// Get a jpeg image from the robot
 /**
  * @param image image is IplImage format used by OpenCV.
- * @return  RI_RESP_SUCCESS;
- * @note save an image from the camera in the IplImage format used by OpenCV.
+ * @return Captures an image from the camera in the IplImage format used by OpenCV.
+ * @note The image must be pre-allocated. The captured image is in BGR format.
  */
-int RobotInterface::saveImage(IplImage *image,int image_number){
-    // Create an image to store the image from the camera
-    image = cvCreateImage(cvSize(640, 480), IPL_DEPTH_8U, 3);
-    getImage(image);
-    char cvLog[400] = {0};
-   int number =  image_number;
-    sprintf(cvLog,"/home/zzy/Rovio-image/%d.jpeg",number);
-    cvSaveImage(cvLog , image); 
+int RobotInterface::getImage(IplImage *image) {
+    const unsigned char *response;
+    int data_sz;
+
+    // Get the camera image
+    if(getJpeg(&response, &data_sz) != RI_RESP_SUCCESS) {
+        cvZero(image);
+        return RI_RESP_FAILURE;
+    }
+    if(riDecodeJpeg(response, data_sz, image) != RI_RESP_SUCCESS)
+        return RI_RESP_FAILURE;
+    riTraceMark(&trace, RI_TRACE_DECODED);
     return RI_RESP_SUCCESS;
 }
 
+/**
+ * @param image the image returned by the last getImage(), only encoded if no JPEG was received yet.
+ * @param image_number the file name, <image_number>.jpeg.
+ * @return RI_RESP_SUCCESS, RI_RESP_BUSY if the saver dropped the frame, RI_RESP_FAILURE if the file or RI_SAVE_DEFAULT_DIR could not be written.
+ * @note The JPEG is written as the robot sent it, without decoding or encoding it again. With a saver set by setImageSaver() it is queued and written into the saver's directory by its thread, otherwise it is written into RI_SAVE_DEFAULT_DIR on the calling thread, created if missing.
+ */
+int RobotInterface::saveImage(IplImage *image,int image_number){
+    char path[RI_SAVE_MAX_PATH + 16];
+
+    // The saver made its own directory when it started
+    if((jpeg_size <= 0 || saver == NULL) && mkdir(RI_SAVE_DEFAULT_DIR, 0755) != 0 && errno != EEXIST) {
+        perror("Unable to create the image directory " RI_SAVE_DEFAULT_DIR ".");
+        return RI_RESP_FAILURE;
+    }
+    if(jpeg_size <= 0) {
+        snprintf(path, sizeof(path), "%s/%d.jpeg", RI_SAVE_DEFAULT_DIR, image_number);
+        return cvSaveImage(path, image) ? RI_RESP_SUCCESS : RI_RESP_FAILURE;
+    }
+    if(saver != NULL)
+        return saver->save(jpeg, jpeg_size, image_number);
+    return riWriteJpeg(RI_SAVE_DEFAULT_DIR, image_number, jpeg, jpeg_size);
+}
+
+/**
+ * @param saver a started ImageSaver, it is not deleted with the interface.
+ */
+void RobotInterface::setImageSaver(ImageSaver *saver) {
+    this->saver = saver;
+}
+
+/**
+ * @param recorder an open recorder, it is not deleted with the interface. NULL detaches it.
+ */
+void RobotInterface::setRecorder(FrameRecorder *recorder) {
+    this->recorder = recorder;
+}
+
 // Returns a sequence of squares detected on the image
 /**
  * @param img image is IplImage format used by OpenCV.
  * @param threshold The minimum square size argument gives the threshold for the smallest square the detector will detect.
  * @return Takes a 1 plane image and returns a list of the squares in an image.
  * @note Each squares_t structure contains the center of the square as a CvPoint named center and the area of the square as an int named area, along with a pointer to the next square in the list, named next. This pointer will be NULL at the end of the list.
+ * The detection runs in a SquareDetector kept by the interface. Use a SquareDetector directly to get the squares in a reusable vector instead of a list that has to be deleted.
  */
 SquaresType *RobotInterface::findSquares(IplImage* img, int threshold) {
-	CvSeq* contours;
-	CvMemStorage *storage;
-	int i, j, area;
-	CvPoint ul, lr, pt, centroid;
-	CvSize sz = cvSize( img->width, img->height);
-	IplImage * canny = cvCreateImage(sz, 8, 1);
     SquaresType *sq_head, *sq, *sq_last;
-    	CvSeqReader reader;
-    
-	// Create storage
-	storage = cvCreateMemStorage(0);
-	
-	// Pyramid images for blurring the result
-	IplImage* pyr = cvCreateImage(cvSize(sz.width/2, sz.height/2), 8, 1);
-	IplImage* pyr2 = cvCreateImage(cvSize(sz.width/4, sz.height/4), 8, 1);
-
-	CvSeq* result;
-	double s, t;
-
-	// Create an empty sequence that will contain the square's vertices
-	CvSeq* squares = cvCreateSeq(0, sizeof(CvSeq), sizeof(CvPoint), storage);
-    
-	// Select the maximum ROI in the image with the width and height divisible by 2
-	cvSetImageROI(img, cvRect(0, 0, sz.width, sz.height));
-    
-	// Down and up scale the image to reduce noise
-	cvPyrDown( img, pyr, CV_GAUSSIAN_5x5 );
-	cvPyrDown( pyr, pyr2, CV_GAUSSIAN_5x5 );
-	cvPyrUp( pyr2, pyr, CV_GAUSSIAN_5x5 );
-	cvPyrUp( pyr, img, CV_GAUSSIAN_5x5 );
-
-	// Apply the canny edge detector and set the lower to 0 (which forces edges merging) 
-	cvCanny(img, canny, 0, 50, 3);
-		
-	// Dilate canny output to remove potential holes between edge segments 
-	cvDilate(canny, canny, 0, 2);
-
-#ifdef DEBUG_SQUARE_CANNY
-	cvShowImage("Debug - CANNY", canny);
-#endif
-		
-	// Find the contours and store them all as a list
-	cvFindContours(canny, storage, &contours, sizeof(CvContour), CV_RETR_LIST, CV_CHAIN_APPROX_SIMPLE, cvPoint(0,0));
-            
-	// Test each contour to find squares
-	while(contours) {
-		// Approximate a contour with accuracy proportional to the contour perimeter
-		result = cvApproxPoly(contours, sizeof(CvContour), storage, CV_POLY_APPROX_DP, cvContourPerimeter(contours)*0.10, 0 );
-                // Square contours should have
-		//	* 4 vertices after approximation
-		// 	* Relatively large area (to filter out noisy contours)
-		// 	* Ne convex.
-		// Note: absolute value of an area is used because
-		// area may be positive or negative - in accordance with the
-		// contour orientation
-                if(result->total == 4 && fabs(cvContourArea(result,CV_WHOLE_SEQ,0)) > threshold && cvCheckContourConvexity(result)) {
-			s=0;
-                    	for(i=0; i<5; i++) {
-                        	// Find the minimum angle between joint edges (maximum of cosine)
-				if(i >= 2) {
-                    t = fabs(riAngle((CvPoint*)cvGetSeqElem(result, i),(CvPoint*)cvGetSeqElem(result, i-2),(CvPoint*)cvGetSeqElem( result, i-1 )));
-					s = s > t ? s : t;
-        	                }
-			}
-                    
-			// If cosines of all angles are small (all angles are ~90 degree) then write the vertices to the sequence 
-			if( s < 0.2 ) {
-				for( i = 0; i < 4; i++ ) {
-					cvSeqPush(squares, (CvPoint*)cvGetSeqElem(result, i));
-				}
-			}
-                }
-                
-                // Get the next contour
-		contours = contours->h_next;
-	}
+    size_t i;
+
+    if(detector == NULL)
+        detector = new SquareDetector();
+    const std::vector<RISquare> &found = detector->find(img, threshold);
 
-    	// initialize reader of the sequence
-	cvStartReadSeq(squares, &reader, 0);
-	sq_head = NULL; sq_last = NULL; sq = NULL;
-	// Now, we have a list of contours that are squares, find the centroids and area
-	for(i=0; i<squares->total; i+=4) {
-		// Find the upper left and lower right coordinates
-		ul.x = 1000; ul.y = 1000; lr.x = 0; lr.y = 0;
-		for(j=0; j<4; j++) {
-			CV_READ_SEQ_ELEM(pt, reader);
-			// Upper Left
-			if(pt.x < ul.x)
-				ul.x = pt.x;
-			if(pt.y < ul.y)
-				ul.y = pt.y;
-			// Lower right
-			if(pt.x > lr.x)
-				lr.x = pt.x;
-			if(pt.y > lr.y)
-				lr.y = pt.y;
-		}
-
-		// Find the centroid
-		centroid.x = ((lr.x - ul.x) / 2) + ul.x;
-		centroid.y = ((lr.y - ul.y) / 2) + ul.y;
-
-		// Find the area
-		area = (lr.x - ul.x) * (lr.y - ul.y);
-
-		// Add it to the storage
+    // Copy the squares into a list
+    sq_head = NULL; sq_last = NULL;
+    for(i = 0; i < found.size(); i++) {
         sq = new SquaresType;
-		// Fill in the data
-		sq->area = area;
-		sq->center.x = centroid.x;
-		sq->center.y = centroid.y;
-		sq->next = NULL;
-		if(sq_last == NULL) 
-			sq_head = sq;	
-		else 
-			sq_last->next = sq;
-		sq_last = sq;
-	}	
-    
-	// Release the temporary images and data
-	cvReleaseImage(&canny);
-	cvReleaseImage(&pyr);
-	cvReleaseImage(&pyr2);
-	cvReleaseMemStorage(&storage);
-	return sq_head;
+        sq->area = found[i].area;
+        sq->center.x = found[i].center.x;
+        sq->center.y = found[i].center.y;
+        sq->next = NULL;
+        if(sq_last == NULL)
+            sq_head = sq;
+        else
+            sq_last->next = sq;
+        sq_last = sq;
+    }
+    riTraceMark(&trace, RI_TRACE_PROCESSED);
+    return sq_head;
 }
 
 // Configure the camera
@@ -1203,6 +1636,31 @@ int RobotInterface::cameraConfigure(int brightness, int contrast, int framerate,
     // No response (pg. 23 of the API)
 #endif
 
+    // Set the camera resolution and quality
+    cameraResolution(resolution, quality);
+
+    // Set the camera framerate
+    if(framerate < 2)
+        framerate = 2;
+    if(framerate > 32)
+        framerate = 32;
+    sprintf(cmd, "ChangeFramerate.cgi?Framerate=%i", framerate);
+    httpRequest(&ri, cmd, response, 512, false);
+    // No response
+
+    return RI_RESP_SUCCESS;
+}
+
+/**
+ * @param resolution one of RI_CAMERA_RES_*, see cameraConfigure().
+ * @param quality one of RI_CAMERA_QUALITY_*.
+ * @return RI_RESP_SUCCESS.
+ * @note Only changes what the frames are made of, it can be called between captures to switch between cheap and detailed frames. The frames already in the camera keep their size, check it before decoding.
+ */
+int RobotInterface::cameraResolution(int resolution, int quality) {
+    char cmd[48];
+    char response[512];
+
     // Set the camera resolution
     if(resolution < 0)
         resolution = 0;
@@ -1221,15 +1679,6 @@ int RobotInterface::cameraConfigure(int brightness, int contrast, int framerate,
     httpRequest(&ri, cmd, response, 512, false);
     // No response
 
-    // Set the camera framerate
-    if(framerate < 2)
-        framerate = 2;
-    if(framerate > 32)
-        framerate = 32;
-    sprintf(cmd, "ChangeFramerate.cgi?Framerate=%i", framerate);
-    httpRequest(&ri, cmd, response, 512, false);
-    // No response
-
     return RI_RESP_SUCCESS;
 }
 
@@ -1261,6 +1710,89 @@ int RobotInterface::volumeConfigure(int mic_volume, int speaker_volume) {
     return RI_RESP_SUCCESS;
 }
 
+/**
+ * @param text the answer of game.cgi?MAP, "score1:score2" then MAP_MAX_Y lines of MAP_MAX_X comma separated hex cells.
+ * @param map the map to update.
+ * @return RI_RESP_SUCCESS, RI_RESP_FAILURE if text is not a map, the map is then left as it was with nothing marked changed.
+ * @note A short line leaves the rest of its row empty. The points of the cells other than pellets are dropped.
+ */
+int riParseMap(const char *text, RIMap *map) {
+    unsigned char cells[MAP_MAX_Y][MAP_MAX_X];
+    const char *p;
+    char *end;
+    long value;
+    int score1, score2, x, y;
+
+    map->changed = 0;
+    map->scores_changed = false;
+
+    score1 = strtol(text, &end, 10);
+    if(end == text || *end != ':')
+        return RI_RESP_FAILURE;
+    p = end + 1;
+    score2 = strtol(p, &end, 10);
+    if(end == p)
+        return RI_RESP_FAILURE;
+
+    // Parse into a scratch grid first, a truncated map changes nothing
+    memset(cells, MAP_OBJ_ENC(MAP_OBJ_EMPTY, 0), sizeof(cells));
+    p = end;
+    for(y = 0; y < MAP_MAX_Y; y++) {
+        p = strchr(p, '\n');
+        if(p == NULL)
+            return RI_RESP_FAILURE;
+        p++;
+        for(x = 0; x < MAP_MAX_X && *p != '\n' && *p != '\r' && *p != '\0'; x++) {
+            value = strtol(p, &end, 16);
+            if(end == p)
+                break;
+            cells[y][x] = MAP_OBJ_TYPE(value) == MAP_OBJ_PELLET ? (unsigned char)value : MAP_OBJ_ENC(MAP_OBJ_TYPE(value), 0);
+            p = end;
+            if(*p == ',')
+                p++;
+        }
+    }
+
+    for(y = 0; y < MAP_MAX_Y; y++) {
+        for(x = 0; x < MAP_MAX_X; x++) {
+            if(map->polls == 0 || map->cells[y][x] != cells[y][x])
+                map->changed |= MAP_CELL_BIT(x, y);
+        }
+    }
+    memcpy(map->cells, cells, sizeof(cells));
+    map->scores_changed = map->polls == 0 || map->score1 != score1 || map->score2 != score2;
+    map->score1 = score1;
+    map->score2 = score2;
+    map->polls++;
+    return RI_RESP_SUCCESS;
+}
+
+/**
+ * @param map a map updated by getMap() or riParseMap().
+ * @param changes filled with the cells that changed, by row, each linked to the next.
+ * @param max the room in changes.
+ * @return the number of cells written, at most max.
+ */
+int riMapChanges(const RIMap *map, MapObjType *changes, int max) {
+    int x, y, n = 0;
+
+    for(y = 0; y < MAP_MAX_Y && n < max; y++) {
+        for(x = 0; x < MAP_MAX_X && n < max; x++) {
+            if(!(map->changed & MAP_CELL_BIT(x, y)))
+                continue;
+            changes[n].x = x;
+            changes[n].y = y;
+            changes[n].type = MAP_OBJ_TYPE(map->cells[y][x]);
+            changes[n].points = MAP_OBJ_SCORE(map->cells[y][x]);
+            changes[n].next = NULL;
+            if(n > 0)
+                changes[n - 1].next = &changes[n];
+            n++;
+        }
+    }
+    return n;
+}
+
 // Game API
 /**
  * @param x  X coordinate of the robot.
@@ -1321,64 +1853,54 @@ int RobotInterface::reserveMap(int x, int y) {
 * </pre>
  */
 MapObjType *RobotInterface::getMap(int *score1, int *score2) {
-        MapObjType *map_start = NULL, *mo, *last_mo;
-        char response[512];
-        char cmd[128];
-        char *tok;
-        char *map[MAP_MAX_Y];
-        int x,y,value;
+        MapObjType *map_start = NULL, *mo, *last_mo = NULL;
+        RIMap map;
+        int x,y;
 
         // Get the map
-        sprintf(cmd, "cgi-bin/game.cgi?MAP");
-        httpRequest(&ri, cmd, response, 512, true);
-        sscanf(response, "%i:%i\n", score1, score2);
-
-            // Read in the map data
-        strtok(response, "\n");
-            for(y=0; y<MAP_MAX_Y; y++) {
-                    // Get a line
-            tok = strtok(NULL, "\n");
-            if(tok != NULL)
-                map[y] = tok;
-        }
+        memset(&map, 0, sizeof(RIMap));
+        if(getMap(&map) != RI_RESP_SUCCESS)
+            return NULL;
+        *score1 = map.score1;
+        *score2 = map.score2;
 
-        // Now parse the lines
         for(y=0; y<MAP_MAX_Y; y++) {
-                    tok = strtok(map[y], ",");
-                    /* Parse the line */
-                    x = 0;
-                    while(tok != NULL && tok[0] != '\n') {
-                            sscanf(tok, "%X,", &value);
-
-                            // Allocate a map object
-                            mo = (MapObjType *) malloc(sizeof(MapObjType));
-
-                            // Assign the map object values
-                            mo->x = x;
-                            mo->y = y;
-                            mo->type = MAP_OBJ_TYPE(value);
-                            if(mo->type == MAP_OBJ_PELLET)
-                                    mo->points = MAP_OBJ_SCORE(value);
-                            else
-                                    mo->points = 0;
-
-                            // Assign the map objects
-                            if(map_start == NULL)
-                                    map_start = mo;
-                            else
-                                    last_mo->next = mo;
-
-                            // Clear the next pointer
-                            mo->next = NULL;
-
-                            // Save the map object for the next pointer
-                            last_mo = mo;
-
-                            // Get the next token
-                            tok = strtok(NULL, ",");
-                            x++;
-                    }
+            for(x=0; x<MAP_MAX_X; x++) {
+                // Allocate a map object
+                mo = (MapObjType *) malloc(sizeof(MapObjType));
+
+                // Assign the map object values
+                mo->x = x;
+                mo->y = y;
+                mo->type = MAP_OBJ_TYPE(map.cells[y][x]);
+                mo->points = MAP_OBJ_SCORE(map.cells[y][x]);
+                mo->next = NULL;
+
+                // Assign the map objects
+                if(map_start == NULL)
+                    map_start = mo;
+                else
+                    last_mo->next = mo;
+                last_mo = mo;
             }
+        }
 
         return map_start;
 }
+
+/**
+ * @param map the map to update, zeroed before the first poll.
+ * @return RI_RESP_SUCCESS, RI_RESP_FAILURE if the server did not answer with a map, the map is then left as it was with nothing marked changed.
+ * @note Nothing is allocated, poll into the same map to get the cells that changed since the previous poll in map->changed.
+ */
+int RobotInterface::getMap(RIMap *map) {
+    char response[512];
+    char cmd[32];
+
+    sprintf(cmd, "cgi-bin/game.cgi?MAP");
+    if(httpRequest(&ri, cmd, response, sizeof(response) - 1, true) <= 0)
+        return RI_RESP_FAILURE;
+    // httpRequest only clears the bytes it was given, terminate the last one here
+    response[sizeof(response) - 1] = '\0';
+    return riParseMap(response, map);
+}
@@ -0,0 +1,171 @@
+/** @file sentry.cpp
+ *  @brief Motion gated capture, see sentry.h.
+ *
+ */
+
+#include "sentry.h"
+
+/**
+ * @param robot the robot whose camera is watched, it must outlive the sentry.
+ */
+SentryCapture::SentryCapture(RobotInterface *robot) {
+    this->robot = robot;
+    level = RI_SENTRY_DEFAULT_LEVEL;
+    pixels = RI_SENTRY_DEFAULT_PIXELS;
+    quiet = RI_SENTRY_DEFAULT_QUIET;
+    state = RI_SENTRY_IDLE;
+    moving = false;
+    last_motion = 0;
+    watch_size = riCameraSize(RI_SENTRY_WATCH_RES);
+    small = cvCreateImage(watch_size, IPL_DEPTH_8U, 3);
+    full = NULL;
+    gray = cvCreateImage(watch_size, IPL_DEPTH_8U, 1);
+    previous = cvCreateImage(watch_size, IPL_DEPTH_8U, 1);
+    diff = cvCreateImage(watch_size, IPL_DEPTH_8U, 1);
+    primed = false;
+    last_size = cvSize(0, 0);
+    frame_count = 0;
+    full_count = 0;
+    byte_count = 0;
+}
+
+SentryCapture::~SentryCapture() {
+    if(full != NULL)
+        cvReleaseImage(&full);
+    cvReleaseImage(&diff);
+    cvReleaseImage(&previous);
+    cvReleaseImage(&gray);
+    cvReleaseImage(&small);
+}
+
+/**
+ * @param level the change of a pixel, out of 255, over which the pixel changed.
+ * @param pixels the number of changed pixels, at 176x144, over which there is motion.
+ */
+void SentryCapture::setMotion(int level, int pixels) {
+    this->level = level;
+    this->pixels = pixels;
+}
+
+void SentryCapture::setQuiet(uint64_t us) {
+    quiet = us;
+}
+
+/** @brief Switch the camera to the resolution of a state */
+int SentryCapture::setState(int state) {
+    int ret;
+
+    if(state == RI_SENTRY_WATCH)
+        ret = robot->cameraResolution(RI_SENTRY_WATCH_RES, RI_SENTRY_WATCH_QUALITY);
+    else
+        ret = robot->cameraResolution(RI_SENTRY_ALERT_RES, RI_SENTRY_ALERT_QUALITY);
+    this->state = state;
+    return ret;
+}
+
+/**
+ * @return RI_RESP_SUCCESS.
+ */
+int SentryCapture::start(void) {
+    primed = false;
+    moving = false;
+    return setState(RI_SENTRY_WATCH);
+}
+
+/**
+ * @return RI_RESP_SUCCESS.
+ */
+int SentryCapture::stop(void) {
+    if(state == RI_SENTRY_IDLE)
+        return RI_RESP_SUCCESS;
+    return setState(RI_SENTRY_IDLE);
+}
+
+/** @brief Number of pixels of gray that changed since previous */
+int SentryCapture::changedPixels(void) {
+    cvAbsDiff(gray, previous, diff);
+    cvThreshold(diff, diff, level, 255, CV_THRESH_BINARY);
+    return cvCountNonZero(diff);
+}
+
+/**
+ * @param frame set to the decoded BGR frame if it is larger than the watch resolution, NULL otherwise. It belongs to the sentry and is overwritten by the next poll().
+ * @return RI_RESP_SUCCESS, RI_RESP_FAILURE if no frame could be captured or decoded.
+ * @note Every frame, whatever its size, is shrunk to 176x144 gray and compared to the one before. Motion switches to full resolution, a quiet period switches back. The size of each frame is read from its JPEG header, because the camera takes a few frames to apply a new resolution.
+ */
+int SentryCapture::poll(IplImage **frame) {
+    const unsigned char *jpeg;
+    int size;
+    CvSize dim;
+    IplImage *target, *swap;
+    uint64_t now;
+
+    *frame = NULL;
+    if(robot->getJpeg(&jpeg, &size) != RI_RESP_SUCCESS)
+        return RI_RESP_FAILURE;
+    frame_count++;
+    byte_count += size;
+    if(riJpegSize(jpeg, size, &dim) != RI_RESP_SUCCESS)
+        return RI_RESP_FAILURE;
+
+    if(dim.width == watch_size.width && dim.height == watch_size.height) {
+        target = small;
+    } else {
+        if(full == NULL || full->width != dim.width || full->height != dim.height) {
+            if(full != NULL)
+                cvReleaseImage(&full);
+            full = cvCreateImage(dim, IPL_DEPTH_8U, 3);
+        }
+        target = full;
+    }
+    if(riDecodeJpeg(jpeg, size, target) != RI_RESP_SUCCESS)
+        return RI_RESP_FAILURE;
+    if(target == full)
+        cvResize(full, small, CV_INTER_AREA);
+    cvCvtColor(small, gray, CV_BGR2GRAY);
+
+    // Another resolution or quality changes every pixel a little, that is not motion
+    now = riTimestamp();
+    if(primed && dim.width == last_size.width && dim.height == last_size.height)
+        moving = changedPixels() > pixels;
+    else
+        moving = false;
+    if(moving)
+        last_motion = now;
+    last_size = dim;
+    primed = true;
+    swap = previous;
+    previous = gray;
+    gray = swap;
+
+    if(state == RI_SENTRY_WATCH && moving)
+        setState(RI_SENTRY_ALERT);
+    else if(state == RI_SENTRY_ALERT && now - last_motion > quiet)
+        setState(RI_SENTRY_WATCH);
+
+    if(target == full) {
+        full_count++;
+        *frame = full;
+    }
+    return RI_RESP_SUCCESS;
+}
+
+int SentryCapture::getState(void) {
+    return state;
+}
+
+bool SentryCapture::motion(void) {
+    return moving;
+}
+
+uint32_t SentryCapture::frames(void) {
+    return frame_count;
+}
+
+uint32_t SentryCapture::fullFrames(void) {
+    return full_count;
+}
+
+uint64_t SentryCapture::bytes(void) {
+    return byte_count;
+}
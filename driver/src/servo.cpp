@@ -0,0 +1,257 @@
+/** @file servo.cpp
+ *  @brief Visual servoing, see servo.h.
+ *
+ */
+
+#include "servo.h"
+#include "bundle.h"
+#include "latency.h"
+
+#include <string.h>
+#include <math.h>
+#include <time.h>
+
+/** @brief A speed from RI_SLOWEST at 0 to RI_FASTEST at 1 */
+static int riServoSpeed(double f) {
+    if(f < 0.0)
+        f = 0.0;
+    else if(f > 1.0)
+        f = 1.0;
+    return RI_SLOWEST - (int)((RI_SLOWEST - RI_FASTEST) * f + 0.5);
+}
+
+/**
+ * @param robot the robot to drive, used by the servo only.
+ * @param frame the size of the frames the targets are tracked in.
+ * @param odometry a started odometry of the robot to correct the turn done since a frame was captured, NULL to use the target motion instead.
+ * @param rate the number of control steps per second.
+ */
+VisualServo::VisualServo(RobotInterface *robot, CvSize frame, Odometry *odometry, int rate) {
+    this->robot = robot;
+    this->odometry = odometry;
+    width = frame.width;
+    px_per_rad = frame.width / (RI_SERVO_HFOV_DEG * M_PI / 180.0);
+    this->rate = rate > 0 ? rate : RI_SERVO_DEFAULT_RATE;
+    reference = 0;
+    pthread_mutex_init(&lock, NULL);
+    memset(&latest, 0, sizeof(RIServoTarget));
+    memset(&previous, 0, sizeof(RIServoTarget));
+    memset(&stats, 0, sizeof(RIServoStats));
+    taken = 0;
+    latency = NULL;
+    running = false;
+}
+
+VisualServo::~VisualServo() {
+    stop();
+    pthread_mutex_destroy(&lock);
+}
+
+/**
+ * @param box_height the height of the box at the distance to keep, the first tracked box for example.
+ */
+void VisualServo::setReference(int box_height) {
+    pthread_mutex_lock(&lock);
+    reference = box_height > 0 ? box_height : 0;
+    pthread_mutex_unlock(&lock);
+}
+
+/**
+ * @param stats the statistics to add the traces to, they must stay valid while set.
+ * @note Detach the robot the frames are captured with from the statistics, the servo adds every posted trace itself.
+ */
+void VisualServo::setLatencyStats(LatencyStats *stats) {
+    if(running)
+        return;
+    latency = stats;
+}
+
+/**
+ * @param box the box of the target in the frame.
+ * @param found false if the tracker lost the target in that frame.
+ * @param trace the trace of the frame, from getTrace(), its capture time is taken with riTraceCaptureTime().
+ */
+void VisualServo::post(CvRect box, bool found, const RITrace *trace) {
+    pthread_mutex_lock(&lock);
+    // A frame replaced before any step took it gets no command
+    if(latency != NULL && latest.timestamp != 0 && taken != stats.posted)
+        latency->add(&latest.trace);
+    if(latest.found)
+        previous = latest;
+    latest.timestamp = riTraceCaptureTime(trace);
+    latest.box = box;
+    latest.found = found;
+    memcpy(&latest.trace, trace, sizeof(RITrace));
+    stats.posted++;
+    pthread_mutex_unlock(&lock);
+}
+
+/**
+ * @brief Where the center of the target is now, in pixels
+ *
+ * If the robot turned by dtheta since the capture, the scene moved by dtheta the other way
+ * across the image. Without odometry the target is moved along at the speed it had between
+ * the last two frames it was found in, as long as the robot kept the same move since: that
+ * speed is the target's plus the one the move gave the scene, and a new move changes it.
+ */
+double VisualServo::predictCenter(const RIServoTarget *target, const RIServoTarget *before, uint64_t now, uint64_t changed) {
+    RIOdometrySample then, current;
+    double cx = target->box.x + target->box.width / 2.0;
+    double bx, dt, ahead;
+
+    if(odometry != NULL) {
+        if(odometry->sampleAt(target->timestamp, &then) != RI_RESP_FAILURE && odometry->latest(&current))
+            cx += riWrapAngle(current.theta - then.theta) * px_per_rad;
+        return cx;
+    }
+
+    if(before->found && before->timestamp < target->timestamp && before->timestamp >= changed) {
+        bx = before->box.x + before->box.width / 2.0;
+        dt = (double)(target->timestamp - before->timestamp);
+        // No further ahead than the two frames are apart, the speed is not known past that
+        ahead = now > target->timestamp ? (double)(now - target->timestamp) : 0.0;
+        cx += (cx - bx) * (ahead < dt ? ahead : dt) / dt;
+    }
+    return cx;
+}
+
+/** @brief Body of the control thread */
+void *VisualServo::servoThread(void *arg) {
+    VisualServo *vs = (VisualServo *)arg;
+    RIServoTarget target, before;
+    RITrace acting;
+    struct timespec next;
+    uint64_t now, age = 0, changed = 0, period = 1000000ULL / vs->rate;
+    int movement, speed, last_movement = RI_STOP, last_speed = 0, reference;
+    double offset, size;
+    bool acted, moved, fresh, traced = false;
+
+    clock_gettime(CLOCK_MONOTONIC, &next);
+    while(vs->running) {
+        pthread_mutex_lock(&vs->lock);
+        target = vs->latest;
+        before = vs->previous;
+        reference = vs->reference;
+        fresh = vs->taken != vs->stats.posted;
+        vs->taken = vs->stats.posted;
+        pthread_mutex_unlock(&vs->lock);
+
+        // The moves are marked on the trace of the latest frame, the previous one is done
+        if(fresh) {
+            if(traced && vs->latency != NULL)
+                vs->latency->add(&acting);
+            memcpy(&acting, &target.trace, sizeof(RITrace));
+            traced = true;
+        }
+
+        now = riTimestamp();
+        movement = RI_STOP;
+        speed = RI_SLOWEST;
+        acted = target.found && target.timestamp != 0 && now < target.timestamp + RI_SERVO_MAX_AGE;
+        if(acted) {
+            age = now > target.timestamp ? now - target.timestamp : 0;
+            offset = (vs->predictCenter(&target, &before, now, changed) - vs->width / 2.0) / vs->width;
+
+            // Face the target first, then keep it at the reference size
+            if(fabs(offset) > RI_SERVO_DEADBAND) {
+                movement = offset < 0.0 ? RI_TURN_LEFT : RI_TURN_RIGHT;
+                speed = riServoSpeed((fabs(offset) - RI_SERVO_DEADBAND) / (RI_SERVO_FULL_TURN - RI_SERVO_DEADBAND));
+            } else if(reference > 0) {
+                size = (double)target.box.height / reference - 1.0;
+                if(fabs(size) > RI_SERVO_SIZE_TOLERANCE) {
+                    movement = size < 0.0 ? RI_MOVE_FORWARD : RI_MOVE_BACKWARD;
+                    speed = riServoSpeed(fabs(size) - RI_SERVO_SIZE_TOLERANCE);
+                }
+            }
+        }
+
+        // Every step renews the drive pulse, a stop is sent once
+        moved = false;
+        if(movement != RI_STOP || last_movement != RI_STOP) {
+            if(movement != last_movement || speed != last_speed)
+                changed = riTimestamp();
+            vs->robot->move(movement, speed, acted ? &acting : NULL);
+            last_movement = movement;
+            last_speed = speed;
+            moved = true;
+        }
+
+        pthread_mutex_lock(&vs->lock);
+        vs->stats.steps++;
+        if(moved)
+            vs->stats.commands++;
+        if(acted) {
+            vs->stats.acted++;
+            vs->stats.age_sum += age;
+            if(age > vs->stats.age_max)
+                vs->stats.age_max = (uint32_t)age;
+        } else {
+            vs->stats.lost++;
+        }
+        pthread_mutex_unlock(&vs->lock);
+
+        // Wait for the next period, skip the missed ones on overrun
+        riWaitPeriod(&next, period);
+    }
+
+    if(last_movement != RI_STOP)
+        vs->robot->move(RI_STOP, RI_SLOWEST);
+    if(traced && vs->latency != NULL)
+        vs->latency->add(&acting);
+    return NULL;
+}
+
+/**
+ * @return RI_RESP_SUCCESS, RI_RESP_BUSY if the servo is already started, RI_RESP_FAILURE if the control thread can't be started.
+ */
+int VisualServo::start(void) {
+    if(running)
+        return RI_RESP_BUSY;
+
+    memset(&stats, 0, sizeof(RIServoStats));
+    running = true;
+    if(pthread_create(&thread, NULL, servoThread, this) != 0) {
+        running = false;
+        perror("Unable to start the servo thread.");
+        return RI_RESP_FAILURE;
+    }
+    return RI_RESP_SUCCESS;
+}
+
+/**
+ * @return RI_RESP_SUCCESS.
+ * @note The robot is stopped if it was moving.
+ */
+int VisualServo::stop(void) {
+    if(!running)
+        return RI_RESP_SUCCESS;
+
+    running = false;
+    pthread_join(thread, NULL);
+    return RI_RESP_SUCCESS;
+}
+
+bool VisualServo::isRunning(void) {
+    return running;
+}
+
+/**
+ * @param out filled with a copy of the statistics.
+ */
+void VisualServo::getStats(RIServoStats *out) {
+    pthread_mutex_lock(&lock);
+    memcpy(out, &stats, sizeof(RIServoStats));
+    pthread_mutex_unlock(&lock);
+}
+
+/**
+ * @param out where to print, stdout for example.
+ */
+void VisualServo::printStats(FILE *out) {
+    RIServoStats s;
+
+    getStats(&s);
+    fprintf(out, "servo: targets %u, steps %u, steered %u, lost %u, commands %u, frame age mean %.1f ms max %.1f ms\n",
+        s.posted, s.steps, s.acted, s.lost, s.commands,
+        s.acted > 0 ? s.age_sum / 1000.0 / s.acted : 0.0, s.age_max / 1000.0);
+}
@@ -0,0 +1,295 @@
+/** @file squaredetector.cpp
+ *  @brief Reusable square detector, see squaredetector.h.
+ *
+ */
+
+#include "squaredetector.h"
+
+#include <math.h>
+
+SquareDetector::SquareDetector() {
+    size = cvSize(0, 0);
+    smooth = NULL;
+    canny = NULL;
+    pyr = NULL;
+    pyr2 = NULL;
+    storage = cvCreateMemStorage(0);
+    squares.reserve(16);
+}
+
+SquareDetector::~SquareDetector() {
+    release();
+    cvReleaseMemStorage(&storage);
+}
+
+/** @brief Release the work images */
+void SquareDetector::release(void) {
+    if(smooth != NULL)
+        cvReleaseImage(&smooth);
+    if(canny != NULL)
+        cvReleaseImage(&canny);
+    if(pyr != NULL)
+        cvReleaseImage(&pyr);
+    if(pyr2 != NULL)
+        cvReleaseImage(&pyr2);
+    size = cvSize(0, 0);
+}
+
+/** @brief Make sure the work images can hold the input and select a region of that size */
+int SquareDetector::prepare(CvSize sz) {
+    if(sz.width > size.width || sz.height > size.height) {
+        CvSize alloc = cvSize(sz.width > size.width ? sz.width : size.width, sz.height > size.height ? sz.height : size.height);
+
+        release();
+        smooth = cvCreateImage(alloc, 8, 1);
+        canny = cvCreateImage(alloc, 8, 1);
+        // Pyramid images for blurring the input
+        pyr = cvCreateImage(cvSize(alloc.width/2, alloc.height/2), 8, 1);
+        pyr2 = cvCreateImage(cvSize(alloc.width/4, alloc.height/4), 8, 1);
+        size = alloc;
+    }
+
+    cvSetImageROI(smooth, cvRect(0, 0, sz.width, sz.height));
+    cvSetImageROI(canny, cvRect(0, 0, sz.width, sz.height));
+    cvSetImageROI(pyr, cvRect(0, 0, sz.width/2, sz.height/2));
+    cvSetImageROI(pyr2, cvRect(0, 0, sz.width/4, sz.height/4));
+    return RI_RESP_SUCCESS;
+}
+
+/**
+ * @brief Test a contour with the polygon tests of findSquares()
+ * @return true and the square in sq if the contour approximates to a convex quadrilateral bigger than threshold with right angles.
+ */
+bool SquareDetector::isSquare(CvSeq *contour, int threshold, RISquare *sq) {
+    CvSeq *result;
+    CvPoint *pt[4];
+    CvPoint ul, lr;
+    double s, t;
+    int i;
+
+    // Approximate a contour with accuracy proportional to the contour perimeter
+    result = cvApproxPoly(contour, sizeof(CvContour), storage, CV_POLY_APPROX_DP, cvContourPerimeter(contour)*0.10, 0);
+
+    // Square contours should have 4 vertices, a large area and be convex
+    if(result->total != 4 || fabs(cvContourArea(result, CV_WHOLE_SEQ, 0)) <= threshold || !cvCheckContourConvexity(result))
+        return false;
+
+    for(i = 0; i < 4; i++)
+        pt[i] = (CvPoint *)cvGetSeqElem(result, i);
+
+    // Find the minimum angle between joint edges (maximum of cosine), at vertices 1, 2 and 3
+    s = 0;
+    for(i = 2; i < 5; i++) {
+        t = fabs(riAngle(pt[i % 4], pt[i - 2], pt[i - 1]));
+        s = s > t ? s : t;
+    }
+    // If cosines of all angles are small (all angles are ~90 degree) keep it
+    if(s >= 0.2)
+        return false;
+
+    // Find the upper left and lower right coordinates
+    ul = *pt[0];
+    lr = *pt[0];
+    for(i = 1; i < 4; i++) {
+        if(pt[i]->x < ul.x)
+            ul.x = pt[i]->x;
+        if(pt[i]->y < ul.y)
+            ul.y = pt[i]->y;
+        if(pt[i]->x > lr.x)
+            lr.x = pt[i]->x;
+        if(pt[i]->y > lr.y)
+            lr.y = pt[i]->y;
+    }
+
+    // Find the centroid and the area
+    sq->center.x = ((lr.x - ul.x) / 2) + ul.x;
+    sq->center.y = ((lr.y - ul.y) / 2) + ul.y;
+    sq->area = (lr.x - ul.x) * (lr.y - ul.y);
+    sq->box = cvRect(ul.x, ul.y, lr.x - ul.x, lr.y - ul.y);
+    return true;
+}
+
+/**
+ * @param img a 1 plane image, for example a color threshold. It is not modified.
+ * @param threshold The minimum square size argument gives the threshold for the smallest square the detector will detect.
+ * @return the squares found, valid until the next call.
+ * @note The detection is the one of RobotInterface::findSquares(): the image is blurred through a pyramid, edges are found with Canny and dilated, and the contours that approximate to convex quadrilaterals with right angles are kept. Contours whose bounding rectangle is not bigger than the threshold cannot hold a big enough square and are dropped before the polygon approximation.
+ */
+const std::vector<RISquare> &SquareDetector::find(const IplImage *img, int threshold) {
+    squares.clear();
+    findRows(img, 0, img->height, threshold, 0, 0, img->height, &squares);
+    return squares;
+}
+
+/**
+ * @param mask a 1 plane binary image, for example a cvInRangeS() or riColorThreshold() mask. It is not modified.
+ * @param threshold The minimum square size argument gives the threshold for the smallest square the detector will detect.
+ * @return the squares found, valid until the next call.
+ * @note The blur, Canny and dilation of find() only turn the mask into the outline of its regions, which the outer contours of the regions already are. This skips them and applies the polygon tests of find() to the outer contours of the mask. The outline follows the border pixels of the regions where the dilated edges lie a pixel or two outside, so the squares can be slightly smaller, and squares nested in a hole of another region are not seen.
+ */
+const std::vector<RISquare> &SquareDetector::findBinary(const IplImage *mask, int threshold) {
+    return findIn(mask, cvRect(0, 0, mask->width, mask->height), threshold, true);
+}
+
+/**
+ * @param img a 1 plane image. It is not modified.
+ * @param area the part of the image to search, clipped to the image.
+ * @param threshold the smallest square area.
+ * @param binary true to take img as a mask and skip the edge detection, like findBinary().
+ * @return the squares found in image coordinates, valid until the next call.
+ * @note Without binary, the area starts on a multiple of 4 like the full frame pyramid does. A square is only seen if its outline is inside the area.
+ */
+const std::vector<RISquare> &SquareDetector::findIn(const IplImage *img, CvRect area, int threshold, bool binary) {
+    CvSeq *contours;
+    CvRect rect;
+    RISquare sq;
+    int right, bottom;
+
+    squares.clear();
+
+    right = area.x + area.width < img->width ? area.x + area.width : img->width;
+    bottom = area.y + area.height < img->height ? area.y + area.height : img->height;
+    area.x = area.x > 0 ? area.x : 0;
+    area.y = area.y > 0 ? area.y : 0;
+    if(!binary) {
+        area.x &= ~3;
+        area.y &= ~3;
+    }
+    if(right - area.x < 8 || bottom - area.y < 8)
+        return squares;
+    area.width = right - area.x;
+    area.height = bottom - area.y;
+
+    contours = contoursIn(img, area, binary);
+    for(; contours != NULL; contours = contours->h_next) {
+        // The polygon lies within the contour's bounding rectangle, too small to pass
+        rect = cvBoundingRect(contours, 1);
+        if(rect.width * rect.height <= threshold)
+            continue;
+        if(isSquare(contours, threshold, &sq))
+            squares.push_back(sq);
+    }
+    return squares;
+}
+
+/**
+ * @brief The contours of a part of an image, in image coordinates
+ *
+ * Without binary, the part is blurred through a pyramid, edges are found with Canny and
+ * dilated, and all the contours of the edges are listed. With binary the part is taken as
+ * a mask and the outer contours of its regions are listed.
+ */
+CvSeq *SquareDetector::contoursIn(const IplImage *img, CvRect area, bool binary) {
+    CvSeq *contours = NULL;
+    CvSize sz = cvSize(area.width, area.height);
+
+    prepare(sz);
+    cvClearMemStorage(storage);
+
+    // Work on the area in place
+    cvInitImageHeader(&band, sz, img->depth, img->nChannels);
+    band.widthStep = img->widthStep;
+    band.imageData = img->imageData + area.y * img->widthStep + area.x * img->nChannels;
+    band.imageSize = sz.height * img->widthStep;
+
+    if(binary) {
+        // cvFindContours() writes to its input
+        cvCopy(&band, canny, NULL);
+        cvFindContours(canny, storage, &contours, sizeof(CvContour), CV_RETR_EXTERNAL, CV_CHAIN_APPROX_SIMPLE, cvPoint(area.x, area.y));
+        return contours;
+    }
+
+    // Down and up scale the image to reduce noise
+    cvPyrDown(&band, pyr, CV_GAUSSIAN_5x5);
+    cvPyrDown(pyr, pyr2, CV_GAUSSIAN_5x5);
+    cvPyrUp(pyr2, pyr, CV_GAUSSIAN_5x5);
+    cvPyrUp(pyr, smooth, CV_GAUSSIAN_5x5);
+
+    // Apply the canny edge detector and set the lower to 0 (which forces edges merging)
+    cvCanny(smooth, canny, 0, 50, 3);
+
+    // Dilate canny output to remove potential holes between edge segments
+    cvDilate(canny, canny, 0, 2);
+
+#ifdef DEBUG_SQUARE_CANNY
+    cvShowImage("Debug - CANNY", canny);
+#endif
+
+    // Find the contours and store them all as a list
+    cvFindContours(canny, storage, &contours, sizeof(CvContour), CV_RETR_LIST, CV_CHAIN_APPROX_SIMPLE, cvPoint(area.x, area.y));
+    return contours;
+}
+
+/**
+ * @param img a 1 plane image. It is not modified.
+ * @param top first row to process.
+ * @param bottom row after the last row to process.
+ * @param threshold the smallest square area.
+ * @param guard distance to a cut edge (top or bottom unless they are the image border) under which a contour is not trusted, the blur and the edge detection reach that far into rows that were not processed.
+ * @param own_top first row a square center must be on to be reported.
+ * @param own_bottom row after the last row a square center may be on.
+ * @param out the squares are appended to it, in image coordinates.
+ * @return RI_SQ_CUT_TOP and/or RI_SQ_CUT_BOTTOM if a contour that could hold a square came within guard of that cut edge and was left out, 0 otherwise.
+ * @note Used by ParallelSquareDetector to process overlapping bands of a frame. The rows should be a multiple of 4 apart for the pyramid to match the full frame one.
+ */
+int SquareDetector::findRows(const IplImage *img, int top, int bottom, int threshold, int guard, int own_top, int own_bottom, std::vector<RISquare> *out) {
+    CvSeq *contours;
+    CvRect rect;
+    RISquare sq;
+    int cut = 0;
+
+    contours = contoursIn(img, cvRect(0, top, img->width, bottom - top), false);
+
+    // Test each contour to find squares
+    for(; contours != NULL; contours = contours->h_next) {
+        rect = cvBoundingRect(contours, 1);
+
+        // Too close to a cut edge to be the same contour as in the full frame, and only part
+        // of it may be in the band so a quarter of the threshold is enough to be in doubt
+        if(top > 0 && rect.y < top + guard) {
+            if(rect.width * rect.height * 4 > threshold)
+                cut |= RI_SQ_CUT_TOP;
+            continue;
+        }
+        if(bottom < img->height && rect.y + rect.height > bottom - guard) {
+            if(rect.width * rect.height * 4 > threshold)
+                cut |= RI_SQ_CUT_BOTTOM;
+            continue;
+        }
+
+        // The polygon lies within the contour's bounding rectangle, too small to pass
+        if(rect.width * rect.height <= threshold)
+            continue;
+
+        if(!isSquare(contours, threshold, &sq))
+            continue;
+        if(sq.center.y < own_top || sq.center.y >= own_bottom)
+            continue;
+        out->push_back(sq);
+    }
+
+    return cut;
+}
+
+const std::vector<RISquare> &SquareDetector::result(void) const {
+    return squares;
+}
+
+const RISquare *SquareDetector::biggest(void) const {
+    const RISquare *big = NULL;
+    size_t i;
+
+    for(i = 0; i < squares.size(); i++) {
+        if(big == NULL || squares[i].area > big->area)
+            big = &squares[i];
+    }
+    return big;
+}
+
+bool riSquareLess(const RISquare &a, const RISquare &b) {
+    if(a.center.y != b.center.y)
+        return a.center.y < b.center.y;
+    if(a.center.x != b.center.x)
+        return a.center.x < b.center.x;
+    return a.area < b.area;
+}
@@ -0,0 +1,198 @@
+/** @file squaretracker.cpp
+ *  @brief Square tracking across frames, see squaretracker.h.
+ *
+ */
+
+#include "squaretracker.h"
+
+#include <math.h>
+#include <algorithm>
+
+static bool riTrackPairLess(const RITrackPair &a, const RITrackPair &b) {
+    return a.distance < b.distance;
+}
+
+/**
+ * @param threshold the smallest square area, like findSquares().
+ * @param binary true if the images are binary masks, searched with SquareDetector::findBinary().
+ */
+SquareTracker::SquareTracker(int threshold, bool binary) {
+    this->threshold = threshold;
+    this->binary = binary;
+    refresh = RI_TRACK_DEFAULT_REFRESH;
+    frame = 0;
+    next_id = 0;
+    full_scan = false;
+}
+
+void SquareTracker::setRefresh(int frames) {
+    refresh = frames;
+}
+
+void SquareTracker::reset(void) {
+    tracks.clear();
+    frame = 0;
+}
+
+/** @brief Move a square by its velocity, one frame ahead */
+void SquareTracker::predict(RITrack *track) {
+    int dx = (int)floor(track->vx + 0.5), dy = (int)floor(track->vy + 0.5);
+
+    track->square.center.x += dx;
+    track->square.center.y += dy;
+    track->square.box.x += dx;
+    track->square.box.y += dy;
+}
+
+/** @brief Take a detection of a predicted square, the velocity follows the prediction error */
+void SquareTracker::correct(RITrack *track, const RISquare &sq) {
+    float ex = (sq.center.x - track->square.center.x) / (float)(track->missed + 1);
+    float ey = (sq.center.y - track->square.center.y) / (float)(track->missed + 1);
+
+    // The first motion is all there is to go by
+    if(track->hits == 1) {
+        track->vx += ex;
+        track->vy += ey;
+    } else {
+        track->vx += RI_TRACK_VELOCITY_GAIN * ex;
+        track->vy += RI_TRACK_VELOCITY_GAIN * ey;
+    }
+    track->square = sq;
+    track->hits++;
+    track->missed = 0;
+}
+
+/**
+ * @brief Search the area a square is predicted in
+ * @return true and the detection nearest to the prediction in sq, false if the square is not there.
+ */
+bool SquareTracker::searchAround(const IplImage *img, const RITrack &track, RISquare *sq) {
+    const CvRect &box = track.square.box;
+    int mw = (int)(box.width * RI_TRACK_MARGIN + fabs(track.vx)) + 4;
+    int mh = (int)(box.height * RI_TRACK_MARGIN + fabs(track.vy)) + 4;
+    double d, best = -1;
+    size_t i;
+
+    const std::vector<RISquare> &near = detector.findIn(img,
+        cvRect(box.x - mw, box.y - mh, box.width + 2 * mw, box.height + 2 * mh), threshold, binary);
+    for(i = 0; i < near.size(); i++) {
+        d = hypot(near[i].center.x - track.square.center.x, near[i].center.y - track.square.center.y);
+        if(best < 0 || d < best) {
+            best = d;
+            *sq = near[i];
+        }
+    }
+    return best >= 0;
+}
+
+/** @brief Search the whole frame and match the squares to the tracks, nearest first */
+void SquareTracker::scan(const IplImage *img) {
+    RITrackPair pair;
+    RITrack track;
+    double gate;
+    size_t t, s;
+
+    found = binary ? detector.findBinary(img, threshold) : detector.find(img, threshold);
+
+    // Pairs close enough to be the same square
+    pairs.clear();
+    for(t = 0; t < tracks.size(); t++) {
+        const RISquare &p = tracks[t].square;
+        gate = std::max(p.box.width, p.box.height) + (fabs(tracks[t].vx) + fabs(tracks[t].vy)) * (tracks[t].missed + 1);
+        for(s = 0; s < found.size(); s++) {
+            pair.distance = hypot(found[s].center.x - p.center.x, found[s].center.y - p.center.y);
+            if(pair.distance > gate)
+                continue;
+            pair.track = t;
+            pair.square = s;
+            pairs.push_back(pair);
+        }
+    }
+    std::sort(pairs.begin(), pairs.end(), riTrackPairLess);
+
+    track_used.assign(tracks.size(), false);
+    square_used.assign(found.size(), false);
+    for(t = 0; t < pairs.size(); t++) {
+        if(track_used[pairs[t].track] || square_used[pairs[t].square])
+            continue;
+        track_used[pairs[t].track] = true;
+        square_used[pairs[t].square] = true;
+        correct(&tracks[pairs[t].track], found[pairs[t].square]);
+    }
+
+    // Tracks not seen for too long are dropped
+    for(t = 0, s = 0; t < tracks.size(); t++) {
+        if(!track_used[t] && ++tracks[t].missed > RI_TRACK_MAX_MISSED)
+            continue;
+        tracks[s++] = tracks[t];
+    }
+    tracks.resize(s);
+
+    // New squares
+    for(s = 0; s < found.size(); s++) {
+        if(square_used[s])
+            continue;
+        track.id = next_id++;
+        track.square = found[s];
+        track.vx = 0;
+        track.vy = 0;
+        track.hits = 1;
+        track.missed = 0;
+        tracks.push_back(track);
+    }
+}
+
+/**
+ * @param img the next image, a 1 plane mask if the tracker is binary.
+ * @return the tracked squares, missed ones included with their predicted position, valid until the next call.
+ * @note The whole frame is scanned on the first frame, every setRefresh() frames, and as soon as a square is not found around its prediction or two squares are predicted onto the same detection.
+ */
+const std::vector<RITrack> &SquareTracker::update(const IplImage *img) {
+    size_t i, j;
+
+    frame++;
+    matches.resize(tracks.size());
+    full_scan = tracks.empty() || (refresh > 0 && frame % refresh == 0);
+    for(i = 0; i < tracks.size(); i++) {
+        predict(&tracks[i]);
+        if(tracks[i].missed > 0)
+            full_scan = true;
+    }
+
+    // Only around the predictions, the tracks are only touched if every square was found
+    for(i = 0; !full_scan && i < tracks.size(); i++) {
+        if(!searchAround(img, tracks[i], &matches[i]))
+            full_scan = true;
+        for(j = 0; !full_scan && j < i; j++) {
+            if(matches[j].center.x == matches[i].center.x && matches[j].center.y == matches[i].center.y)
+                full_scan = true;
+        }
+    }
+
+    if(full_scan) {
+        scan(img);
+    } else {
+        for(i = 0; i < tracks.size(); i++)
+            correct(&tracks[i], matches[i]);
+    }
+    return tracks;
+}
+
+const std::vector<RITrack> &SquareTracker::result(void) const {
+    return tracks;
+}
+
+const RITrack *SquareTracker::biggest(void) const {
+    const RITrack *big = NULL;
+    size_t i;
+
+    for(i = 0; i < tracks.size(); i++) {
+        if(tracks[i].missed == 0 && (big == NULL || tracks[i].square.area > big->square.area))
+            big = &tracks[i];
+    }
+    return big;
+}
+
+bool SquareTracker::fullScan(void) const {
+    return full_scan;
+}
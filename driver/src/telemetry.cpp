@@ -0,0 +1,261 @@
+/** @file telemetry.cpp
+ *  @brief Binary telemetry log writer and reader, see telemetry.h.
+ *
+ */
+
+#include "telemetry.h"
+
+#include <unistd.h>
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/**********************************************************
+ * Writer
+ **********************************************************/
+TelemetryLog::TelemetryLog() {
+    fd = -1;
+    header = NULL;
+    records = NULL;
+    map_size = 0;
+}
+
+TelemetryLog::~TelemetryLog() {
+    close();
+}
+
+/**
+ * @param path the ring file, an existing file is overwritten.
+ * @param capacity the number of records kept, the oldest ones are overwritten when it is full.
+ * @return RI_RESP_SUCCESS or RI_RESP_FAILURE.
+ * @note The whole file is allocated and mapped here so that record() never touches the file system.
+ */
+int TelemetryLog::open(const char *path, uint32_t capacity) {
+    void *map;
+
+    close();
+    if(capacity == 0)
+        return RI_RESP_PARAM_RANGE_ERR;
+
+    fd = ::open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if(fd == -1) {
+        perror("Unable to create the telemetry file.");
+        return RI_RESP_FAILURE;
+    }
+
+    map_size = sizeof(RITelemetryHeader) + (size_t)capacity * sizeof(RITelemetryRecord);
+    if(ftruncate(fd, map_size) == -1) {
+        perror("Unable to size the telemetry file.");
+        ::close(fd);
+        fd = -1;
+        return RI_RESP_FAILURE;
+    }
+
+    map = mmap(NULL, map_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, 0);
+    if(map == MAP_FAILED) {
+        perror("Unable to map the telemetry file.");
+        ::close(fd);
+        fd = -1;
+        return RI_RESP_FAILURE;
+    }
+
+    header = (RITelemetryHeader *)map;
+    records = (RITelemetryRecord *)(header + 1);
+    memset(header, 0, sizeof(RITelemetryHeader));
+    header->version = RI_TLM_VERSION;
+    header->record_size = sizeof(RITelemetryRecord);
+    header->capacity = capacity;
+    header->created = riTimestamp();
+    // Readers check the magic last
+    __atomic_store_n(&header->magic, RI_TLM_MAGIC, __ATOMIC_RELEASE);
+    return RI_RESP_SUCCESS;
+}
+
+/**
+ * @return RI_RESP_SUCCESS.
+ */
+int TelemetryLog::close(void) {
+    if(header == NULL)
+        return RI_RESP_SUCCESS;
+
+    msync(header, map_size, MS_SYNC);
+    munmap(header, map_size);
+    ::close(fd);
+    fd = -1;
+    header = NULL;
+    records = NULL;
+    return RI_RESP_SUCCESS;
+}
+
+bool TelemetryLog::isOpen(void) {
+    return header != NULL;
+}
+
+/**
+ * @param command one of RI_TLM_CMD_*, or a code from RI_TLM_CMD_USER on.
+ * @param arg the argument of the command.
+ * @param speed the speed of a movement, 0 otherwise.
+ * @param result the response code of the robot.
+ * @param sent riTimestamp() when the request was sent.
+ * @param done riTimestamp() when the response was received.
+ * @param sensor the sensor data to store, may be NULL.
+ * @param report the report to store, may be NULL.
+ */
+void TelemetryLog::record(int command, int arg, int speed, int result, uint64_t sent, uint64_t done, const RIData *sensor, const RIReport *report) {
+    RITelemetryRecord *rec;
+    uint64_t idx;
+
+    if(header == NULL)
+        return;
+
+    idx = header->written;
+    rec = &records[idx % header->capacity];
+    rec->timestamp = sent;
+    rec->latency = (uint32_t)(done - sent);
+    rec->command = command;
+    rec->arg = arg;
+    rec->result = result;
+    rec->speed = speed;
+    if(sensor != NULL)
+        memcpy(&rec->sensor, sensor, sizeof(RIData));
+    else
+        memset(&rec->sensor, 0, sizeof(RIData));
+    if(report != NULL)
+        memcpy(&rec->report, report, sizeof(RIReport));
+    else
+        memset(&rec->report, 0, sizeof(RIReport));
+
+    // Publish the record
+    __atomic_store_n(&header->written, idx + 1, __ATOMIC_RELEASE);
+}
+
+uint64_t TelemetryLog::written(void) {
+    if(header == NULL)
+        return 0;
+    return header->written;
+}
+
+/**********************************************************
+ * Reader
+ **********************************************************/
+TelemetryReader::TelemetryReader() {
+    fd = -1;
+    header = NULL;
+    records = NULL;
+    map_size = 0;
+    first = 0;
+    last = 0;
+}
+
+TelemetryReader::~TelemetryReader() {
+    close();
+}
+
+/**
+ * @param path the ring file.
+ * @return RI_RESP_SUCCESS, RI_RESP_FAILURE if the file can't be read or is not a telemetry file.
+ */
+int TelemetryReader::open(const char *path) {
+    struct stat st;
+    void *map;
+
+    close();
+    fd = ::open(path, O_RDONLY);
+    if(fd == -1) {
+        perror("Unable to open the telemetry file.");
+        return RI_RESP_FAILURE;
+    }
+    if(fstat(fd, &st) == -1 || (size_t)st.st_size < sizeof(RITelemetryHeader)) {
+        printf("Not a telemetry file: %s\n", path);
+        ::close(fd);
+        fd = -1;
+        return RI_RESP_FAILURE;
+    }
+
+    map_size = st.st_size;
+    map = mmap(NULL, map_size, PROT_READ, MAP_SHARED, fd, 0);
+    if(map == MAP_FAILED) {
+        perror("Unable to map the telemetry file.");
+        ::close(fd);
+        fd = -1;
+        return RI_RESP_FAILURE;
+    }
+    header = (const RITelemetryHeader *)map;
+    records = (const RITelemetryRecord *)(header + 1);
+
+    // Check the layout before trusting any record
+    if(__atomic_load_n(&header->magic, __ATOMIC_ACQUIRE) != RI_TLM_MAGIC ||
+            header->version != RI_TLM_VERSION ||
+            header->record_size != sizeof(RITelemetryRecord) ||
+            map_size < sizeof(RITelemetryHeader) + (size_t)header->capacity * sizeof(RITelemetryRecord)) {
+        printf("Not a telemetry file: %s\n", path);
+        close();
+        return RI_RESP_FAILURE;
+    }
+
+    refresh();
+    return RI_RESP_SUCCESS;
+}
+
+/**
+ * @return RI_RESP_SUCCESS.
+ */
+int TelemetryReader::close(void) {
+    if(header == NULL)
+        return RI_RESP_SUCCESS;
+
+    munmap((void *)header, map_size);
+    ::close(fd);
+    fd = -1;
+    header = NULL;
+    records = NULL;
+    first = 0;
+    last = 0;
+    return RI_RESP_SUCCESS;
+}
+
+/**
+ * @return the number of records available.
+ * @note Call it again to follow a log that is still being written.
+ */
+uint64_t TelemetryReader::refresh(void) {
+    if(header == NULL)
+        return 0;
+
+    // Once the ring has wrapped, the oldest slot is the one the writer fills next
+    last = __atomic_load_n(&header->written, __ATOMIC_ACQUIRE);
+    first = last >= header->capacity ? last - header->capacity + 1 : 0;
+    return last - first;
+}
+
+uint64_t TelemetryReader::count(void) {
+    return last - first;
+}
+
+/**
+ * @param i the record number, 0 is the oldest record.
+ * @param rec filled in with the record.
+ * @return true on success, false if i is out of range or the writer has overwritten the record meanwhile.
+ */
+bool TelemetryReader::get(uint64_t i, RITelemetryRecord *rec) {
+    uint64_t idx = first + i;
+
+    if(header == NULL || idx >= last)
+        return false;
+
+    memcpy(rec, &records[idx % header->capacity], sizeof(RITelemetryRecord));
+
+    // The writer fills slot idx again once written reaches idx + capacity
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    if(__atomic_load_n(&header->written, __ATOMIC_RELAXED) >= idx + header->capacity)
+        return false;
+    return true;
+}
+
+uint64_t TelemetryReader::created(void) {
+    if(header == NULL)
+        return 0;
+    return header->created;
+}